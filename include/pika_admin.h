@@ -170,12 +170,13 @@ class FlushallCmd : public Cmd {
 
  private:
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class FlushdbCmd : public Cmd {
@@ -219,6 +220,7 @@ class InfoCmd : public Cmd {
     kInfoClients,
     kInfoStats,
     kInfoExecCount,
+    kInfoCommandStats,
     kInfoCPU,
     kInfoReplication,
     kInfoKeyspace,
@@ -248,6 +250,7 @@ class InfoCmd : public Cmd {
   const static std::string kClientsSection;
   const static std::string kStatsSection;
   const static std::string kExecCountSection;
+  const static std::string kCommandStatsSection;
   const static std::string kCPUSection;
   const static std::string kReplicationSection;
   const static std::string kKeyspaceSection;
@@ -265,6 +268,7 @@ class InfoCmd : public Cmd {
   void InfoClients(std::string& info);
   void InfoStats(std::string& info);
   void InfoExecCount(std::string& info);
+  void InfoCommandStats(std::string& info);
   void InfoCPU(std::string& info);
   void InfoShardingReplication(std::string& info);
   void InfoReplication(std::string& info);
@@ -417,12 +421,13 @@ class PaddingCmd : public Cmd {
 
  private:
   virtual void DoInitial();
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 #ifdef TCMALLOC_EXTENSION
@@ -14,12 +14,19 @@ class PikaAuxiliaryThread : public pink::Thread {
  public:
   PikaAuxiliaryThread() :
       mu_(),
-      cv_(&mu_) {}
+      cv_(&mu_),
+      signaled_(false) {}
   virtual ~PikaAuxiliaryThread();
+  // Wake up the thread, will not be lost if it is not waiting
+  void Signal();
   slash::Mutex mu_;
   slash::CondVar cv_;
  private:
   virtual void* ThreadMain();
+  // Wait until signaled or timeout, in ms
+  void WaitSignal(uint32_t timeout);
+  // protected by mu_
+  bool signaled_;
 };
 
 #endif
@@ -6,11 +6,16 @@
 #ifndef PIKA_BINLOG_H_
 #define PIKA_BINLOG_H_
 
+#include <deque>
+#include <memory>
+#include <vector>
+
 #include "slash/include/env.h"
 #include "slash/include/slash_mutex.h"
 #include "slash/include/slash_status.h"
 
 #include "include/pika_define.h"
+#include "include/pika_binlog_cache.h"
 
 using slash::Status;
 using slash::Slice;
@@ -26,6 +31,11 @@ class Version {
 
   // RWLock should be held when access members.
   Status StableSave();
+  // Persist the saved members to disk
+  Status Sync();
+
+  // pro_num_, pro_offset_ and logic_id_ as StableSave lays them out
+  static const size_t kEncodedSize = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint64_t);
 
   uint32_t pro_num_;
   uint64_t pro_offset_;
@@ -55,8 +65,17 @@ class Binlog {
   void Lock()         { mutex_.Lock(); }
   void Unlock()       { mutex_.Unlock(); }
 
-  Status Put(const std::string &item);
+  Status Put(const Slice &item);
   Status Put(const char* item, int len);
+  // Append items with one flush and manifest save, mutex lock should be held
+  Status BatchPut(const std::vector<Slice>& items);
+
+  /*
+   * Group commit, mutex_ should NOT be held.
+   * The logic id, filenum and offset of item are filled in by the
+   * group leader, filenum and offset return where the item starts
+   */
+  Status GroupPut(std::string* item, uint32_t* filenum = NULL, uint64_t* offset = NULL);
 
   Status GetProducerStatus(uint32_t* filenum, uint64_t* pro_offset, uint64_t* logic_id = NULL);
   /*
@@ -66,8 +85,17 @@ class Binlog {
 
   static Status AppendPadding(slash::WritableFile* file, uint64_t* len);
 
+  /*
+   * fdatasync binlog and manifest if there is unsynced write,
+   * mutex_ should NOT be held, and is not held while syncing
+   */
+  Status Sync();
+
   slash::WritableFile *queue() { return queue_; }
 
+  // Recent items for replication
+  std::shared_ptr<BinlogCache> cache() { return cache_; }
+
   uint64_t file_size() {
     return file_size_;
   }
@@ -76,9 +104,20 @@ class Binlog {
 
  private:
 
+  struct Writer;
+
   void InitLogFile();
   Status EmitPhysicalRecord(RecordType t, const char *ptr, size_t n, int *temp_pro_offset);
 
+  /*
+   * Append one item without flush and manifest save, mutex lock should be held
+   */
+  Status AppendItem(const Slice &item);
+  Status RollFile();
+  Status FlushAndSave();
+  Status SyncInternal();
+  void WriteGroup(const std::vector<Writer*>& group);
+
 
   /*
    * Produce
@@ -94,9 +133,14 @@ class Binlog {
 
   slash::Mutex mutex_;
 
+  // Group commit use, protect writers_
+  slash::Mutex writers_mu_;
+  std::deque<Writer*> writers_;
+
   uint32_t pro_num_;
 
   int block_offset_;
+  bool unsynced_;
 
   char* pool_;
   bool exit_all_consume_;
@@ -104,6 +148,10 @@ class Binlog {
 
   uint64_t file_size_;
 
+  std::shared_ptr<BinlogCache> cache_;
+  // Appended but not flushed yet, cached once they are
+  std::vector<BinlogCacheItem> uncached_;
+
   // Not use
   //int32_t retry_;
 
@@ -0,0 +1,76 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef PIKA_BINLOG_CACHE_H_
+#define PIKA_BINLOG_CACHE_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "slash/include/slash_mutex.h"
+#include "slash/include/slash_slice.h"
+#include "slash/include/slash_status.h"
+
+#include "include/pika_define.h"
+
+using slash::Status;
+using slash::Slice;
+
+struct BinlogCacheItem {
+  // where the item ends in binlog, as PikaBinlogReader::Get returns
+  BinlogOffset end_offset;
+  std::string item;
+  // when the item was cached, in us
+  uint64_t produce_time;
+  BinlogCacheItem(const BinlogOffset& end, const Slice& content, uint64_t time)
+      : end_offset(end), item(content.data(), content.size()), produce_time(time) {}
+};
+
+/*
+ * The most recent encoded binlog items of a partition, bounded by bytes,
+ * in-sync slaves are fed from here instead of reading the binlog file
+ */
+class BinlogCache {
+ public:
+  BinlogCache();
+  ~BinlogCache();
+
+  // Drop all items, the next item will follow offset
+  void Reset(const BinlogOffset& offset);
+
+  // Pushes should be serialized and in binlog order
+  // produce_time 0 means now
+  void Push(const Slice& item, const BinlogOffset& end_offset,
+            uint64_t capacity, uint64_t produce_time = 0);
+
+  // Whether the item after offset can be served, or offset is the latest
+  bool Contains(const BinlogOffset& offset);
+
+  /*
+   * Copy at most count items after offset to items,
+   * return NotFound if offset has slid out of the window
+   */
+  Status Read(const BinlogOffset& offset, int count,
+              std::vector<BinlogCacheItem>* items);
+
+  uint64_t Size();
+
+ private:
+  // rwlock_ should be held, return the index of the item after offset
+  bool Locate(const BinlogOffset& offset, size_t* index);
+
+  pthread_rwlock_t rwlock_;
+  std::deque<BinlogCacheItem> items_;
+  // where the item before items_.front() ends
+  BinlogOffset begin_offset_;
+  uint64_t bytes_;
+
+  // No copying allowed
+  BinlogCache(const BinlogCache&);
+  void operator=(const BinlogCache&);
+};
+
+#endif  // PIKA_BINLOG_CACHE_H_
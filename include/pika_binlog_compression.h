@@ -0,0 +1,66 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef PIKA_BINLOG_COMPRESSION_H_
+#define PIKA_BINLOG_COMPRESSION_H_
+
+#include <atomic>
+#include <string>
+
+#include "slash/include/slash_status.h"
+
+#include "src/pika_inner_message.pb.h"
+
+using slash::Status;
+
+// binlog messages smaller than it are shipped uncompressed
+#define kBinlogCompressMinSize 1024
+
+/*
+ * Compression of binlog shipped from master to slave, the codec is
+ * asked by slave and accepted by master at TrySync
+ */
+
+// name is "none", "lz4" or "zstd", return false if unknown
+bool BinlogCompressionFromString(const std::string& name,
+                                 InnerMessage::CompressionType* type);
+std::string BinlogCompressionToString(InnerMessage::CompressionType type);
+// Whether the codec is compiled in
+bool BinlogCompressionSupported(InnerMessage::CompressionType type);
+
+Status BinlogCompress(InnerMessage::CompressionType type,
+                      const std::string& input, std::string* output);
+Status BinlogUncompress(InnerMessage::CompressionType type,
+                        const std::string& input, size_t raw_size,
+                        std::string* output);
+
+// Bytes and cpu time of compressed binlog messages
+class BinlogCompressionStatistic {
+ public:
+  BinlogCompressionStatistic();
+  void AddCompress(uint64_t raw_bytes, uint64_t compressed_bytes, uint64_t cpu_us);
+  void AddUncompress(uint64_t cpu_us);
+  void Reset();
+
+  uint64_t messages() { return messages_.load(); }
+  uint64_t raw_bytes() { return raw_bytes_.load(); }
+  uint64_t compressed_bytes() { return compressed_bytes_.load(); }
+  uint64_t compress_us() { return compress_us_.load(); }
+  uint64_t uncompress_us() { return uncompress_us_.load(); }
+  // raw bytes / compressed bytes, 0 if nothing compressed
+  double ratio();
+
+ private:
+  std::atomic<uint64_t> messages_;
+  std::atomic<uint64_t> raw_bytes_;
+  std::atomic<uint64_t> compressed_bytes_;
+  std::atomic<uint64_t> compress_us_;
+  std::atomic<uint64_t> uncompress_us_;
+};
+
+// Cpu time consumed by the calling thread, in us
+uint64_t ThreadCpuMicros();
+
+#endif  // PIKA_BINLOG_COMPRESSION_H_
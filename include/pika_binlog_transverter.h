@@ -77,6 +77,28 @@ class PikaBinlogTransverter{
                                     const std::string& content,
                                     const std::vector<std::string>& extends);
 
+    // Same as above, but encode into binlog to reuse its memory
+    static void BinlogEncode(BinlogType type,
+                             uint32_t exec_time,
+                             uint32_t server_id,
+                             uint64_t logic_id,
+                             uint32_t filenum,
+                             uint64_t offset,
+                             const std::string& content,
+                             const std::vector<std::string>& extends,
+                             std::string* binlog);
+
+    // Append only the item header to binlog, the caller
+    // should append content_length bytes content after it
+    static void BinlogHeaderEncode(BinlogType type,
+                                   uint32_t exec_time,
+                                   uint32_t server_id,
+                                   uint64_t logic_id,
+                                   uint32_t filenum,
+                                   uint64_t offset,
+                                   uint32_t content_length,
+                                   std::string* binlog);
+
     static bool BinlogDecode(BinlogType type,
                              const std::string& binlog,
                              BinlogItem* binlog_item);
@@ -86,6 +108,12 @@ class PikaBinlogTransverter{
     static bool BinlogItemWithoutContentDecode(BinlogType type,
                                                const std::string& binlog,
                                                BinlogItem* binlog_item);
+
+    // Overwrite logic id, filenum and offset of an encoded binlog item
+    static bool BinlogItemPositionUpdate(uint64_t logic_id,
+                                         uint32_t filenum,
+                                         uint64_t offset,
+                                         std::string* binlog);
 };
 
 #endif
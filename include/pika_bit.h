@@ -125,6 +125,12 @@ class BitOpCmd : public Cmd {
   BitOpCmd(const std::string& name, int arity, uint16_t flag)
         : Cmd(name, arity, flag) {};
   virtual void Do(std::shared_ptr<Partition> partition = nullptr) override;
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(dest_key_);
+    res.insert(res.end(), src_keys_.begin(), src_keys_.end());
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new BitOpCmd(*this);
   }
@@ -14,6 +14,9 @@ class PikaClientConn: public pink::RedisConn {
     std::shared_ptr<PikaClientConn> pcc;
     std::vector<pink::RedisCmdArgsType> redis_cmds;
     std::string* response;
+    // when the batch was scheduled, in us
+    uint64_t schedule_us;
+    ExecMode mode;
   };
 
   // Auth related
@@ -43,6 +46,15 @@ class PikaClientConn: public pink::RedisConn {
   void BatchExecRedisCmd(const std::vector<pink::RedisCmdArgsType>& argvs, std::string* response);
   int DealMessage(const pink::RedisCmdArgsType& argv, std::string* response);
   static void DoBackgroundTask(void* arg);
+  // Write the queued replies in place with writev, then what pink buffered
+  pink::WriteStatus SendReply() override;
+  /*
+   * Write part of the reply of the running command straight to the socket,
+   * replies queued by the batch before go first, wait while the client is
+   * not reading until the deadline of the batch, only called by the thread
+   * executing the batch
+   */
+  bool StreamReply(const std::string& data);
 
   bool IsPubSub() { return is_pubsub_; }
   void SetIsPubSub(bool is_pubsub) { is_pubsub_ = is_pubsub; }
@@ -60,8 +72,34 @@ class PikaClientConn: public pink::RedisConn {
   pink::ServerThread* const server_thread_;
   std::string current_table_;
   bool is_pubsub_;
-
-  std::string DoCmd(const PikaCmdArgsType& argv, const std::string& opt);
+  // thread pool shard the commands of the connection are executed in
+  size_t shard_;
+
+  // The shard of the partition argv[1] belongs to
+  size_t PartitionShard(const pink::RedisCmdArgsType& argv);
+  /*
+   * Where the batch is executed: the slow pool if any command is slow,
+   * the prior pool if all are prior, inline if it is short, all cheap
+   * reads and the shard is idle enough, or else the thread pool
+   */
+  ExecMode BatchExecMode(const std::vector<pink::RedisCmdArgsType>& argvs, size_t shard);
+
+  std::string DoCmd(const PikaCmdArgsType& argv, int cmd_id);
+  bool WriteAll(const char* data, size_t len);
+
+  /*
+   * Replies of the commands executed in the thread pool, queued without
+   * being copied into one buffer, written before the next batch is read
+   */
+  std::vector<std::string> replies_;
+  // the first reply not fully written, and how much of it is written
+  size_t reply_pos_;
+  size_t reply_offset_;
+  // whether the running batch streamed any reply, and failed to
+  bool streamed_;
+  bool stream_broken_;
+  // when streaming of the running batch gives up, 0 before it starts
+  uint64_t stream_deadline_us_;
 
   void ProcessSlowlog(const PikaCmdArgsType& argv, uint64_t start_us);
   void ProcessMonitor(const PikaCmdArgsType& argv);
@@ -69,6 +107,40 @@ class PikaClientConn: public pink::RedisConn {
   AuthStat auth_stat_;
 };
 
+/*
+ * Multi bulk reply of a command sent to its client chunk by chunk as it
+ * is built, memory stays bounded however many elements, the array length
+ * must be known before the first element, without a client connection
+ * the reply is built in res as usual
+ */
+class ReplyStream {
+ public:
+  // The db lock of partition held by cmd is released while a chunk is
+  // written, so cmd must not keep any db iterator across appends
+  ReplyStream(Cmd* cmd, std::shared_ptr<Partition> partition);
+
+  void AppendArrayLen(int64_t len);
+  void AppendString(const std::string& value);
+  void AppendNil();
+  // Send what is left, the reply of cmd is empty if anything was streamed
+  void Finish();
+
+  // Bytes of a bulk string of len in the reply
+  static size_t BulkSize(size_t len);
+
+ private:
+  void Flush();
+
+  std::shared_ptr<PikaClientConn> conn_;
+  // null if cmd holds no db lock
+  std::shared_ptr<Partition> partition_;
+  CmdRes* res_;
+  std::string buf_;
+  bool streamed_;
+  // the client is gone, the rest is dropped
+  bool broken_;
+};
+
 struct ClientInfo {
   int fd;
   std::string ip_port;
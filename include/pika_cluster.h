@@ -111,4 +111,25 @@ class PkClusterSlotsSlaveofCmd : public Cmd {
   }
 };
 
+class PkClusterSplitSlotCmd : public Cmd {
+ public:
+  PkClusterSplitSlotCmd(const std::string& name, int arity, uint16_t flag)
+      : Cmd(name, arity, flag), slot_(0) {}
+  // None, a slave applies it from the binlog once every lane drained
+  virtual std::vector<std::string> current_key() const {
+    return std::vector<std::string>();
+  }
+  // partition is set if a slave applies it from the binlog of its master
+  virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual Cmd* Clone() override {
+    return new PkClusterSplitSlotCmd(*this);
+  }
+ private:
+  uint32_t slot_;
+  virtual void DoInitial() override;
+  virtual void Clear() {
+    slot_ = 0;
+  }
+};
+
 #endif  // PIKA_CLUSTER_H_
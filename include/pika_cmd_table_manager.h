@@ -6,27 +6,81 @@
 #ifndef PIKA_CMD_TABLE_MANAGER_H_
 #define PIKA_CMD_TABLE_MANAGER_H_
 
+#include <atomic>
+#include <memory>
+
 #include "include/pika_command.h"
 #include "include/pika_data_distribution.h"
 
+/*
+ * Cmd instances cloned from the cmd table and reused by one thread,
+ * an instance is free again once the last reference handed out is
+ * dropped, maybe on another thread
+ */
+class PikaCmdPool {
+ public:
+  PikaCmdPool() = default;
+  std::shared_ptr<Cmd> Acquire(Cmd* prototype);
+
+ private:
+  struct Slot {
+    // null if the last instance was freed for holding too much
+    std::unique_ptr<Cmd> cmd;
+    std::atomic<bool> in_use;
+    Slot() : in_use(false) {}
+  };
+  // Deleter of the references handed out, it outlives the pool
+  struct Releaser {
+    std::shared_ptr<Slot> slot;
+    void operator()(Cmd* cmd) const;
+  };
+  struct Instances {
+    std::vector<std::shared_ptr<Slot>> slots;
+    // where to look for a free one next
+    size_t next;
+    Instances() : next(0) {}
+  };
+  std::unordered_map<Cmd*, Instances> cmds_;
+
+  // No copying allowed
+  PikaCmdPool(const PikaCmdPool&);
+  void operator=(const PikaCmdPool&);
+};
 
 class PikaCmdTableManager {
  public:
   PikaCmdTableManager();
   virtual ~PikaCmdTableManager();
   std::shared_ptr<Cmd> GetCmd(const std::string& opt);
-  uint32_t DistributeKey(const std::string& key, uint32_t partition_num);
+  std::shared_ptr<Cmd> GetCmd(int cmd_id);
+  // Id of the command argv asks for, "pkcluster" takes the next argument
+  // as part of the name, -1 if unknown
+  int GetCmdId(const PikaCmdArgsType& argv);
+  int GetCmdId(const std::string& name);
+  const std::string& GetCmdName(int cmd_id);
+  // Whether the command is a cheap read, checked without creating it
+  bool IsFastCmd(int cmd_id);
+  bool IsPriorCmd(int cmd_id);
+  // Flagged slow and costly lately, see SetSlowByCost
+  bool IsSlowCmd(int cmd_id);
+  // Mean latency of a command flagged slow, measured by the caller,
+  // decides whether it goes to the slow lane, every one does at start
+  void SetSlowByCost(int cmd_id, bool slow);
+  // With hash_tag, a key with a {tag} is hashed by the tag only
+  uint32_t DistributeKey(const std::string& key, uint32_t partition_num,
+                         KeyHashType key_hash = kKeyHashCrc32,
+                         bool hash_tag = false);
  private:
-  std::shared_ptr<Cmd> NewCommand(const std::string& opt);
+  std::shared_ptr<Cmd> NewCommand(int cmd_id);
 
-  void InsertCurrentThreadDistributionMap();
-  bool CheckCurrentThreadDistributionMapExist(const pid_t& tid);
-
-  void TryChangeToAlias(std::string *internal_opt);
+  int TryChangeToAlias(int cmd_id);
 
   CmdTable* cmds_;
-
-  pthread_rwlock_t map_protector_;
-  std::unordered_map<pid_t, PikaDataDistribution*> thread_distribution_map_;
+  CmdNameIndex cmd_index_;
+  // prototypes by command id
+  std::vector<Cmd*> cmds_by_id_;
+  std::unique_ptr<std::atomic<bool>[]> slow_by_cost_;
+  int slaveof_id_;
+  int pkcluster_slots_slaveof_id_;
 };
 #endif
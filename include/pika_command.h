@@ -207,6 +207,7 @@ const std::string kCmdNamePkClusterInfo = "pkclusterinfo";
 const std::string kCmdNamePkClusterAddSlots = "pkclusteraddslots";
 const std::string kCmdNamePkClusterDelSlots = "pkclusterdelslots";
 const std::string kCmdNamePkClusterSlotsSlaveof = "pkclusterslotsslaveof";
+const std::string kCmdNamePkClusterSplitSlot = "pkclustersplitslot";
 
 const std::string kClusterPrefix = "pkcluster";
 typedef pink::RedisCmdArgsType PikaCmdArgsType;
@@ -219,7 +220,9 @@ enum CmdFlagsMask {
   kCmdFlagsMaskSuspend       = 64,
   kCmdFlagsMaskPrior         = 128,
   kCmdFlagsMaskAdminRequire  = 256,
-  kCmdFlagsMaskPartition     = 1536
+  kCmdFlagsMaskPartition     = 1536,
+  kCmdFlagsMaskFast          = 2048,
+  kCmdFlagsMaskSlow          = 4096
 };
 
 enum CmdFlags {
@@ -245,7 +248,11 @@ enum CmdFlags {
   kCmdFlagsAdminRequire          = 256,
   kCmdFlagsDoNotSpecifyPartition = 0, //default do not specify partition
   kCmdFlagsSinglePartition       = 512,
-  kCmdFlagsMultiPartition        = 1024
+  kCmdFlagsMultiPartition        = 1024,
+  kCmdFlagsNoFast                = 0, //default not fast
+  kCmdFlagsFast                  = 2048, //cheap read of a fixed number of keys, may run on network thread
+  kCmdFlagsNoSlow                = 0,    //default not slow
+  kCmdFlagsSlow                  = 4096  //expensive, run in the slow lane
 };
 
 
@@ -279,6 +286,8 @@ public:
     kInvalidDbType,
     kInvalidTable,
     kErrOther,
+    kTryAgain,
+    kCrossSlot,
   };
 
   CmdRes():ret_(kNone) {}
@@ -293,9 +302,21 @@ public:
     message_.clear();
     ret_ = kNone;
   }
+  size_t capacity() const {
+    return message_.capacity();
+  }
   std::string raw_message() const {
     return message_;
   }
+  // Same as message(), but a built reply is moved out instead of copied
+  std::string TakeMessage() {
+    if (ret_ != kNone) {
+      return message();
+    }
+    std::string result;
+    result.swap(message_);
+    return result;
+  }
   std::string message() const {
     std::string result;
     switch (ret_) {
@@ -359,6 +380,16 @@ public:
       result.append(message_);
       result.append(kNewLine);
       break;
+    case kTryAgain:
+      result = "-TRYAGAIN ";
+      result.append(message_);
+      result.append(kNewLine);
+      break;
+    case kCrossSlot:
+      result = "-CROSSSLOT ";
+      result.append(message_);
+      result.append(kNewLine);
+      break;
     default:
       break;
     }
@@ -400,10 +431,12 @@ private:
 class Cmd {
  public:
   Cmd(const std::string& name, int arity, uint16_t flag)
-    : name_(name), arity_(arity), flag_(flag) {}
+    : name_(name), arity_(arity), flag_(flag), keys_cached_(false), keys_locked_(false) {}
   virtual ~Cmd() {}
 
   virtual std::vector<std::string> current_key() const;
+  // current_key() computed once per request
+  const std::vector<std::string>& keys();
   virtual void Execute();
   virtual void ProcessFlushDBCmd();
   virtual void ProcessFlushAllCmd();
@@ -415,31 +448,50 @@ class Cmd {
 
   void Initial(const PikaCmdArgsType& argv,
                const std::string& table_name);
+  // Drop the state of the former request before the instance is reused
+  void Reset();
+  // Heap bytes held by argv and reply of the last request
+  size_t RetainedBytes() const;
 
   bool is_write()            const;
   bool is_local()            const;
   bool is_suspend()          const;
+  bool is_admin()            const;
   bool is_admin_require()    const;
   bool is_single_partition() const;
   bool is_multi_partition()  const;
+  bool is_fast()             const;
+  bool is_prior()            const;
+  bool is_slow()             const;
 
   std::string name() const;
   CmdRes& res();
+  const PikaCmdArgsType& argv() const;
 
-  virtual std::string ToBinlog(uint32_t exec_time,
-                               const std::string& server_id,
-                               uint64_t logic_id,
-                               uint32_t filenum,
-                               uint64_t offset);
+  // Encode the binlog item of this command into binlog, whose previous
+  // content is dropped, an empty binlog means nothing to write
+  virtual void ToBinlog(uint32_t exec_time,
+                        const std::string& server_id,
+                        uint64_t logic_id,
+                        uint32_t filenum,
+                        uint64_t offset,
+                        std::string* binlog);
 
   void SetConn(const std::shared_ptr<pink::PinkConn> conn);
   std::shared_ptr<pink::PinkConn> GetConn();
+  // The caller holds the record locks of keys(), ProcessCommand takes none
+  void SetKeysLocked(bool keys_locked);
+  // Append the command to the binlog of partition, whatever its flags
+  Status WriteBinlog(std::shared_ptr<Partition> partition);
+
+  // Run on partition as it is, routed is true if the partition was
+  // picked by the keys, they are checked against a split meanwhile
+  void ProcessCommand(std::shared_ptr<Partition> partition, bool routed = false);
 
  protected:
   // enable copy, used default copy
   //Cmd(const Cmd&);
-  void ProcessCommand(std::shared_ptr<Partition> partition);
-  void DoCommand(std::shared_ptr<Partition> partition);
+  void DoCommand(std::shared_ptr<Partition> partition, bool routed);
   void DoBinlog(std::shared_ptr<Partition> partition);
   bool CheckArg(int num) const;
   void LogCommand() const;
@@ -455,6 +507,12 @@ class Cmd {
   std::weak_ptr<pink::PinkConn> conn_;
 
  private:
+  std::vector<std::string> keys_;
+  bool keys_cached_;
+  // record lock stripes held by ProcessCommand
+  std::vector<uint32_t> lock_stripes_;
+  bool keys_locked_;
+
   virtual void DoInitial() = 0;
   virtual void Clear() {};
 
@@ -468,6 +526,40 @@ void InitCmdTable(CmdTable* cmd_table);
 Cmd* GetCmdFromTable(const std::string& opt, const CmdTable& cmd_table);
 void DestoryCmdTable(CmdTable* cmd_table);
 
+/*
+ * Case insensitive perfect hash over the command names of a cmd table,
+ * every name gets an id in [0, size), ids follow the sorted names so
+ * indexes built from InitCmdTable agree with each other
+ */
+class CmdNameIndex {
+ public:
+  CmdNameIndex();
+  void Build(const CmdTable& cmd_table);
+
+  // Match the raw name without copying or lowering it, -1 if unknown
+  int Find(const char* name, size_t len) const;
+  int Find(const std::string& name) const {
+    return Find(name.data(), name.size());
+  }
+
+  size_t size() const {
+    return names_.size();
+  }
+  // Name of the command in the cmd table
+  const std::string& name(int id) const {
+    return names_[id];
+  }
+
+ private:
+  static uint32_t Hash(const char* name, size_t len, uint32_t seed);
+
+  uint32_t seed_;
+  uint32_t mask_;
+  // command id of every hash slot, -1 if empty
+  std::vector<int> slots_;
+  std::vector<std::string> names_;
+};
+
 void RedisAppendContent(std::string& str, const std::string& value) {
   str.append(value.data(), value.size());
   str.append(kNewLine);
@@ -10,6 +10,7 @@
 #include <set>
 #include <unordered_set>
 #include <atomic>
+#include <memory>
 
 #include "slash/include/base_conf.h"
 #include "slash/include/slash_mutex.h"
@@ -23,6 +24,25 @@
 
 typedef slash::RWLock RWLock;
 
+/*
+ * Immutable copy of the config items read by every request, a new one is
+ * published whenever any of them is set, readers only load a pointer
+ */
+struct PikaConfSnapshot {
+  bool write_binlog;
+  bool slave_read_only;
+  int64_t max_client_response_size;
+  int inline_exec_queue_threshold;
+  std::string server_id;
+  std::string default_table;
+  std::string requirepass;
+  std::string userpass;
+  std::vector<std::string> user_blacklist;
+  PikaConfSnapshot()
+      : write_binlog(true), slave_read_only(true), max_client_response_size(0),
+        inline_exec_queue_threshold(0) {}
+};
+
 // global class, class members well initialized
 class PikaConf : public slash::BaseConf {
  public:
@@ -33,10 +53,15 @@ class PikaConf : public slash::BaseConf {
   int port()                                        { RWLock l(&rwlock_, false); return port_; }
   std::string slaveof()                             { RWLock l(&rwlock_, false); return slaveof_;}
   int slave_priority()                              { RWLock l(&rwlock_, false); return slave_priority_;}
-  bool write_binlog()                               { RWLock l(&rwlock_, false); return write_binlog_;}
+  bool write_binlog()                               { return snapshot()->write_binlog; }
   int thread_num()                                  { RWLock l(&rwlock_, false); return thread_num_; }
   int thread_pool_size()                            { RWLock l(&rwlock_, false); return thread_pool_size_; }
+  int thread_pool_shards()                          { RWLock l(&rwlock_, false); return thread_pool_shards_; }
+  bool thread_pool_route_by_partition()             { return thread_pool_route_by_partition_.load(); }
+  int prior_thread_pool_size()                      { RWLock l(&rwlock_, false); return prior_thread_pool_size_; }
+  int slow_thread_pool_size()                       { RWLock l(&rwlock_, false); return slow_thread_pool_size_; }
   int sync_thread_num()                             { RWLock l(&rwlock_, false); return sync_thread_num_; }
+  int sync_apply_thread_num()                       { RWLock l(&rwlock_, false); return sync_apply_thread_num_; }
   std::string log_path()                            { RWLock l(&rwlock_, false); return log_path_; }
   std::string db_path()                             { RWLock l(&rwlock_, false); return db_path_; }
   std::string db_sync_path()                        { RWLock l(&rwlock_, false); return db_sync_path_; }
@@ -45,22 +70,23 @@ class PikaConf : public slash::BaseConf {
   std::string compact_interval()                    { RWLock l(&rwlock_, false); return compact_interval_; }
   int64_t write_buffer_size()                       { RWLock l(&rwlock_, false); return write_buffer_size_; }
   int64_t max_write_buffer_size()                   { RWLock l(&rwlock_, false); return max_write_buffer_size_; }
-  int64_t max_client_response_size()                { RWLock L(&rwlock_, false); return max_client_response_size_;}
+  int64_t max_client_response_size()                { return snapshot()->max_client_response_size; }
+  int inline_exec_queue_threshold()                 { return snapshot()->inline_exec_queue_threshold; }
   int timeout()                                     { RWLock l(&rwlock_, false); return timeout_; }
-  std::string server_id()                           { RWLock l(&rwlock_, false); return server_id_; }
-  std::string requirepass()                         { RWLock l(&rwlock_, false); return requirepass_; }
+  const std::string& server_id()                    { return snapshot()->server_id; }
+  const std::string& requirepass()                  { return snapshot()->requirepass; }
   std::string masterauth()                          { RWLock l(&rwlock_, false); return masterauth_; }
   std::string bgsave_path()                         { RWLock l(&rwlock_, false); return bgsave_path_; }
   int expire_dump_days()                            { RWLock l(&rwlock_, false); return expire_dump_days_; }
   std::string bgsave_prefix()                       { RWLock l(&rwlock_, false); return bgsave_prefix_; }
-  std::string userpass()                            { RWLock l(&rwlock_, false); return userpass_; }
+  const std::string& userpass()                     { return snapshot()->userpass; }
   const std::string suser_blacklist()               { RWLock l(&rwlock_, false); return slash::StringConcat(user_blacklist_, COMMA); }
-  const std::vector<std::string>& vuser_blacklist() { RWLock l(&rwlock_, false); return user_blacklist_;}
+  const std::vector<std::string>& vuser_blacklist() { return snapshot()->user_blacklist; }
   bool classic_mode()                               { return classic_mode_.load();}
   int databases()                                   { RWLock l(&rwlock_, false); return databases_;}
   int default_slot_num()                            { RWLock l(&rwlock_, false); return default_slot_num_;}
   const std::vector<TableStruct>& table_structs()   { RWLock l(&rwlock_, false); return table_structs_; }
-  std::string default_table()                       { RWLock l(&rwlock_, false); return default_table_;}
+  const std::string& default_table()                { return snapshot()->default_table; }
   std::string compression()                         { RWLock l(&rwlock_, false); return compression_; }
   int target_file_size_base()                       { RWLock l(&rwlock_, false); return target_file_size_base_; }
   int max_cache_statistic_keys()                    { RWLock l(&rwlock_, false); return max_cache_statistic_keys_;}
@@ -78,7 +104,7 @@ class PikaConf : public slash::BaseConf {
   int expire_logs_nums()                            { RWLock l(&rwlock_, false); return expire_logs_nums_; }
   int expire_logs_days()                            { RWLock l(&rwlock_, false); return expire_logs_days_; }
   std::string conf_path()                           { RWLock l(&rwlock_, false); return conf_path_; }
-  bool slave_read_only()                            { RWLock l(&rwlock_, false); return slave_read_only_; }
+  bool slave_read_only()                            { return snapshot()->slave_read_only; }
   int maxclients()                                  { RWLock l(&rwlock_, false); return maxclients_; }
   int root_connection_num()                         { RWLock l(&rwlock_, false); return root_connection_num_; }
   bool slowlog_write_errorlog()                     { return slowlog_write_errorlog_.load();}
@@ -87,6 +113,23 @@ class PikaConf : public slash::BaseConf {
   std::string network_interface()                   { RWLock l(&rwlock_, false); return network_interface_; }
   int sync_window_size()                            { return sync_window_size_.load(); }
   int max_conn_rbuf_size()                          { return max_conn_rbuf_size_.load(); }
+  bool binlog_group_commit()                        { return binlog_group_commit_.load(); }
+  BinlogSyncPolicy binlog_sync_policy()             { return static_cast<BinlogSyncPolicy>(binlog_sync_policy_.load()); }
+  std::string binlog_sync_policy_str();
+  int64_t binlog_cache_size()                       { return binlog_cache_size_.load(); }
+  int binlog_ack_batch_items()                      { return binlog_ack_batch_items_.load(); }
+  int binlog_ack_interval_us()                      { return binlog_ack_interval_us_.load(); }
+  std::string replication_compression()             { RWLock l(&rwlock_, false); return replication_compression_; }
+
+  // The result and the references into it stay valid for
+  // kConfSnapshotGraceSec after a newer one is published, long enough for
+  // the request reading them, they should not be kept any longer
+  const PikaConfSnapshot* snapshot() {
+    return snapshot_.load(std::memory_order_acquire);
+  }
+  // Free the snapshots replaced over kConfSnapshotGraceSec ago,
+  // called by the timing task
+  void FreeRetiredSnapshots();
 
   // Immutable config items, we don't use lock.
   bool daemonize()                                  { return daemonize_; }
@@ -125,6 +168,7 @@ class PikaConf : public slash::BaseConf {
     RWLock l(&rwlock_, true);
     TryPushDiffCommands("write-binlog", value);
     write_binlog_ = (value == "yes") ? true : false;
+    PublishSnapshot();
   }
   void SetMaxCacheStatisticKeys(const int value) {
     RWLock l(&rwlock_, true);
@@ -140,6 +184,13 @@ class PikaConf : public slash::BaseConf {
     RWLock l(&rwlock_, true);
     TryPushDiffCommands("max-client-response-size", std::to_string(value));
     max_client_response_size_ = value;
+    PublishSnapshot();
+  }
+  void SetInlineExecQueueThreshold(const int value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("inline-exec-queue-threshold", std::to_string(value));
+    inline_exec_queue_threshold_ = value;
+    PublishSnapshot();
   }
   void SetBgsavePath(const std::string &value) {
     RWLock l(&rwlock_, true);
@@ -162,6 +213,7 @@ class PikaConf : public slash::BaseConf {
     RWLock l(&rwlock_, true);
     TryPushDiffCommands("requirepass", value);
     requirepass_ = value;
+    PublishSnapshot();
   }
   void SetMasterAuth(const std::string &value) {
     RWLock l(&rwlock_, true);
@@ -172,6 +224,7 @@ class PikaConf : public slash::BaseConf {
     RWLock l(&rwlock_, true);
     TryPushDiffCommands("userpass", value);
     userpass_ = value;
+    PublishSnapshot();
   }
   void SetUserBlackList(const std::string &value) {
     RWLock l(&rwlock_, true);
@@ -180,6 +233,7 @@ class PikaConf : public slash::BaseConf {
     for (auto& item : user_blacklist_) {
       slash::StringToLower(item);
     }
+    PublishSnapshot();
   }
   void SetExpireLogsNums(const int value) {
     RWLock l(&rwlock_, true);
@@ -239,6 +293,38 @@ class PikaConf : public slash::BaseConf {
     TryPushDiffCommands("max-conn-rbuf-size", std::to_string(value));
     max_conn_rbuf_size_.store(value);
   }
+  void SetThreadPoolRouteByPartition(const bool value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("thread-pool-route-by-partition", value == true ? "yes" : "no");
+    thread_pool_route_by_partition_.store(value);
+  }
+  void SetBinlogGroupCommit(const bool value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("binlog-group-commit", value == true ? "yes" : "no");
+    binlog_group_commit_.store(value);
+  }
+  // value should be one of "no", "everysec", "always"
+  bool SetBinlogSyncPolicy(const std::string& value);
+  void SetBinlogCacheSize(const int64_t value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("binlog-cache-size", std::to_string(value));
+    binlog_cache_size_.store(value);
+  }
+  void SetBinlogAckBatchItems(const int value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("binlog-ack-batch-items", std::to_string(value));
+    binlog_ack_batch_items_.store(value);
+  }
+  void SetBinlogAckIntervalUs(const int value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("binlog-ack-interval-us", std::to_string(value));
+    binlog_ack_interval_us_.store(value);
+  }
+  void SetReplicationCompression(const std::string& value) {
+    RWLock l(&rwlock_, true);
+    TryPushDiffCommands("replication-compression", value);
+    replication_compression_ = value;
+  }
 
   Status TablePartitionsSanityCheck(const std::string& table_name,
                                     const std::set<uint32_t>& partition_ids,
@@ -247,6 +333,14 @@ class PikaConf : public slash::BaseConf {
                             const std::set<uint32_t>& partition_ids);
   Status RemoveTablePartitions(const std::string& table_name,
                                const std::set<uint32_t>& partition_ids);
+  // Record partition split into itself and child_id, both with hash_mod,
+  // with clean both are to be cleaned until FinishSplitClean
+  Status SplitTablePartition(const std::string& table_name,
+                             uint32_t partition_id,
+                             uint32_t child_id,
+                             uint32_t hash_mod,
+                             bool clean);
+  Status FinishSplitClean(const std::string& table_name, uint32_t partition_id);
 
   int Load();
   int ConfigRewrite();
@@ -260,7 +354,12 @@ class PikaConf : public slash::BaseConf {
   int slave_priority_;
   int thread_num_;
   int thread_pool_size_;
+  int thread_pool_shards_;
+  std::atomic<bool> thread_pool_route_by_partition_;
+  int prior_thread_pool_size_;
+  int slow_thread_pool_size_;
   int sync_thread_num_;
+  int sync_apply_thread_num_;
   std::string log_path_;
   std::string db_path_;
   std::string db_sync_path_;
@@ -271,6 +370,7 @@ class PikaConf : public slash::BaseConf {
   int64_t write_buffer_size_;
   int64_t max_write_buffer_size_;
   int64_t max_client_response_size_;
+  int inline_exec_queue_threshold_;
   bool daemonize_;
   int timeout_;
   std::string server_id_;
@@ -317,6 +417,8 @@ class PikaConf : public slash::BaseConf {
   // diff commands between cached commands and config file commands
   std::map<std::string, std::string> diff_commands_;
   void TryPushDiffCommands(const std::string& command, const std::string& value);
+  // rwlock_ should be held for writing
+  void PublishSnapshot();
 
   //
   // Critical configure items
@@ -324,10 +426,20 @@ class PikaConf : public slash::BaseConf {
   bool write_binlog_;
   int target_file_size_base_;
   int binlog_file_size_;
+  std::atomic<bool> binlog_group_commit_;
+  std::atomic<int> binlog_sync_policy_;
+  std::atomic<int64_t> binlog_cache_size_;
+  std::atomic<int> binlog_ack_batch_items_;
+  std::atomic<int> binlog_ack_interval_us_;
+  std::string replication_compression_;
 
   PikaMeta* local_meta_;
 
   pthread_rwlock_t rwlock_;
+
+  std::atomic<const PikaConfSnapshot*> snapshot_;
+  // Replaced snapshots with the time they were replaced, protected by rwlock_
+  std::vector<std::pair<const PikaConfSnapshot*, time_t>> retired_snapshots_;
 };
 
 #endif
@@ -8,8 +8,12 @@
 
 #include "slash/include/slash_status.h"
 
+#include "include/pika_define.h"
+
 // polynomial reserved Crc32 magic num
 const uint32_t IEEE_POLY = 0xedb88320;
+// polynomial reserved Crc32c magic num, the one of the sse4.2 crc32 instruction
+const uint32_t CASTAGNOLI_POLY = 0x82f63b78;
 
 class PikaDataDistribution {
  public:
@@ -37,4 +41,25 @@ class Crc32 : public PikaDataDistribution {
   uint32_t crc32tab[256];
 };
 
+// Eight bytes a step by the sse4.2 crc32 instruction, a table is only
+// built when the instruction is not compiled in
+class Crc32c : public PikaDataDistribution {
+ public:
+  virtual void Init();
+  virtual uint32_t Distribute(const std::string& str, uint32_t partition_num);
+ private:
+  uint32_t Crc32cUpdate(uint32_t crc, const char* buf, size_t len);
+#ifndef __SSE4_2__
+  uint32_t crc32ctab[256];
+#endif
+};
+
+// name is "crc32" or "crc32c", return false if unknown
+bool KeyHashFromString(const std::string& name, KeyHashType* type);
+std::string KeyHashToString(KeyHashType type);
+
+// Where the tag of key is, the part between the first '{' and the '}'
+// after it, return false if key has no such part or it is empty
+bool HashTagOf(const std::string& key, size_t* pos, size_t* len);
+
 #endif
@@ -6,6 +6,7 @@
 #ifndef PIKA_DEFINE_H_
 #define PIKA_DEFINE_H_
 
+#include <map>
 #include <set>
 #include <glog/logging.h>
 
@@ -30,20 +31,46 @@ const std::string kPikaPidFile = "pika.pid";
 const std::string kPikaSecretFile = "rsync.secret";
 const std::string kDefaultRsyncAuth = "default";
 
+// A partition is split no further than this many ways of the key hash
+const uint32_t kMaxPartitionHashMod = 1u << 30;
+
+// Hash routing keys to partitions in sharding mode, a table keeps the
+// one it was created with
+enum KeyHashType {
+  kKeyHashCrc32  = 0,
+  kKeyHashCrc32c = 1
+};
+
 struct TableStruct {
   TableStruct(const std::string& tn,
               const uint32_t pn,
-              const std::set<uint32_t>& pi)
-      : table_name(tn), partition_num(pn), partition_ids(pi) {}
+              const std::set<uint32_t>& pi,
+              const std::map<uint32_t, uint32_t>& hm = std::map<uint32_t, uint32_t>(),
+              KeyHashType kh = kKeyHashCrc32,
+              bool ht = false)
+      : table_name(tn), partition_num(pn), partition_ids(pi), hash_mods(hm),
+        key_hash(kh), hash_tag(ht) {}
 
   bool operator == (const TableStruct& table_struct) const {
     return table_name == table_struct.table_name
         && partition_num == table_struct.partition_num
-        && partition_ids == table_struct.partition_ids;
+        && partition_ids == table_struct.partition_ids
+        && hash_mods == table_struct.hash_mods
+        && key_hash == table_struct.key_hash
+        && hash_tag == table_struct.hash_tag;
   }
   std::string table_name;
   uint32_t partition_num;
   std::set<uint32_t> partition_ids;
+  // partition id -> hash mod of the partitions split, a split partition
+  // holds the keys whose hash % hash mod is its id
+  std::map<uint32_t, uint32_t> hash_mods;
+  KeyHashType key_hash;
+  // Whether keys route by their {tag}
+  bool hash_tag;
+  // partitions split whose keys of the other half are not deleted yet,
+  // local progress, not compared
+  std::set<uint32_t> split_cleaning;
 };
 
 struct WorkerCronTask {
@@ -393,6 +420,20 @@ static const size_t kBlockSize = 64 * 1024;
  */
 static const size_t kHeaderSize = 1 + 3 + 4;
 
+/*
+ * When binlog and manifest are fdatasync'ed
+ */
+enum BinlogSyncPolicy {
+  kBinlogSyncNo = 0,        // leave it to the os
+  kBinlogSyncEverysec = 1,  // background sync every second
+  kBinlogSyncAlways = 2,    // sync after every write
+};
+
+/*
+ * the max size of binlog items a group commit leader appends at once
+ */
+static const size_t kBinlogGroupMaxSize = 1024 * 1024;
+
 /*
  * the size of memory when we use memory mode
  * the default memory size is 2GB
@@ -427,4 +468,51 @@ const uint32_t kDBSyncMaxGap = 50;
 const std::string kDBSyncModule = "document";
 
 const std::string kBgsaveInfoFile = "info";
+
+const size_t kCacheLineSize = 64;
+
+// replies written by one writev
+const int kReplyIovecNum = 64;
+
+// record lock stripes of a partition, power of 2
+const uint32_t kKeyLockStripeNum = 1024;
+
+// a multi bulk reply larger than it is streamed to the client in chunks
+const size_t kReplyStreamChunkSize = 4 * 1024 * 1024;
+// how long the streamed replies of a batch may take to be written in all
+const int kReplyStreamTimeoutMs = 30000;
+
+// larger batches are never executed on the network thread
+const size_t kInlineExecMaxCmds = 16;
+
+// commands flagged slow only go to the slow lane while their mean
+// latency over the last timing task period is above this
+const uint64_t kSlowCmdMeanUsec = 1000;
+
+// a partition holding keys with a ttl is counted again by SLOTSINFO at
+// most this often when not written, its keys expire without a write
+const time_t kKeyNumExpireRecountSec = 60;
+
+// a replaced config snapshot is freed by the timing task once it has been
+// retired this long, no request reads a snapshot for so long
+const time_t kConfSnapshotGraceSec = 60;
+
+// Where the commands of a client are executed
+enum ExecMode {
+  kExecInline = 0,     // on the network thread
+  kExecPool = 1,       // in the thread pool
+  kExecPriorPool = 2,  // in the prior thread pool
+  kExecSlowPool = 3,   // in the slow thread pool
+  kExecModeNum = 4
+};
+
+/*
+ * cmd pool
+ */
+// instances of one command kept by a thread for reuse, replicated
+// commands of a batch are alive together
+const size_t kCmdPoolSizePerCmd = 64;
+// an instance holding more bytes of argv and reply than this when it
+// is released is freed instead of being kept for reuse
+const size_t kCmdPoolRetainedBytes = 4096;
 #endif
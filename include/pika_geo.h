@@ -128,6 +128,14 @@ class GeoRadiusCmd : public Cmd {
   GeoRadiusCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name, arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(key_);
+    if (range_.store || range_.storedist) {
+      res.push_back(range_.storekey);
+    }
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new GeoRadiusCmd(*this);
   }
@@ -153,6 +161,14 @@ class GeoRadiusByMemberCmd : public Cmd {
   GeoRadiusByMemberCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name, arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(key_);
+    if (range_.store || range_.storedist) {
+      res.push_back(range_.storekey);
+    }
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new GeoRadiusByMemberCmd(*this);
   }
@@ -67,6 +67,10 @@ class HGetallCmd : public Cmd {
  private:
   std::string key_;
   virtual void DoInitial() override;
+  // The hash is too large to be replied from memory, cursor and
+  // total_fv tell how far it has been scanned
+  void StreamReply(std::shared_ptr<Partition> partition,
+                   int64_t cursor, int64_t total_fv, size_t raw_size);
 };
 
 class HSetCmd : public Cmd {
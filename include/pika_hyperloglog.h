@@ -39,6 +39,9 @@ class PfCountCmd : public Cmd {
   PfCountCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    return keys_;
+  }
   virtual Cmd* Clone() override {
     return new PfCountCmd(*this);
   }
@@ -55,6 +58,9 @@ class PfMergeCmd : public Cmd {
   PfMergeCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    return keys_;
+  }
   virtual Cmd* Clone() override {
     return new PfMergeCmd(*this);
   }
@@ -0,0 +1,55 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef PIKA_KEY_LOCK_H_
+#define PIKA_KEY_LOCK_H_
+
+#include <pthread.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "include/pika_define.h"
+
+/*
+ * Record locks of a partition striped by key hash, write commands lock
+ * the stripes of their keys in ascending order, so multi-key commands
+ * never deadlock, keys in different stripes never block each other
+ */
+class KeyLockTable {
+ public:
+  KeyLockTable();
+  ~KeyLockTable();
+
+  // Stripes locked are stored in stripes for Unlock, its capacity is reused
+  void Lock(const std::vector<std::string>& keys, std::vector<uint32_t>* stripes);
+  void Unlock(const std::vector<uint32_t>& stripes);
+  // Every stripe, waits for all writes in flight on the partition
+  void LockAll(std::vector<uint32_t>* stripes);
+
+  // Only acquisitions which had to wait are counted
+  uint64_t waits() { return waits_.load(std::memory_order_relaxed); }
+  uint64_t wait_us() { return wait_us_.load(std::memory_order_relaxed); }
+  void ResetStatistic();
+
+ private:
+  // One per cache line, neighbour stripes are locked by different threads
+  struct Stripe {
+    pthread_mutex_t mu;
+    char pad[kCacheLineSize > sizeof(pthread_mutex_t)
+             ? kCacheLineSize - sizeof(pthread_mutex_t) : 1];
+  };
+  Stripe stripes_[kKeyLockStripeNum];
+
+  std::atomic<uint64_t> waits_;
+  std::atomic<uint64_t> wait_us_;
+
+  // No copying allowed
+  KeyLockTable(const KeyLockTable&);
+  void operator=(const KeyLockTable&);
+};
+
+#endif  // PIKA_KEY_LOCK_H_
@@ -43,12 +43,13 @@ class SetCmd : public Cmd {
     success_ = 0;
     condition_ = kNONE;
   }
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class GetCmd : public Cmd {
@@ -271,12 +272,13 @@ class SetnxCmd : public Cmd {
   std::string value_;
   int32_t success_;
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class SetexCmd : public Cmd {
@@ -297,12 +299,13 @@ class SetexCmd : public Cmd {
   int64_t sec_;
   std::string value_;
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class PsetexCmd : public Cmd {
@@ -323,12 +326,13 @@ class PsetexCmd : public Cmd {
   int64_t usec_;
   std::string value_;
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class DelvxCmd : public Cmd {
@@ -376,6 +380,13 @@ class MsetnxCmd : public Cmd {
   MsetnxCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name, arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    for (auto& kv : kvs_) {
+      res.push_back(kv.key);
+    }
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new MsetnxCmd(*this);
   }
@@ -477,12 +488,13 @@ class ExpireCmd : public Cmd {
   std::string key_;
   int64_t sec_;
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class PexpireCmd : public Cmd {
@@ -502,12 +514,13 @@ class PexpireCmd : public Cmd {
   std::string key_;
   int64_t msec_;
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class ExpireatCmd : public Cmd {
@@ -546,12 +559,13 @@ class PexpireatCmd : public Cmd {
   std::string key_;
   int64_t time_stamp_ms_;
   virtual void DoInitial() override;
-  virtual std::string ToBinlog(
+  virtual void ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) override;
+      uint64_t offset,
+      std::string* binlog) override;
 };
 
 class TtlCmd : public Cmd {
@@ -237,6 +237,12 @@ class RPopLPushCmd : public Cmd {
   RPopLPushCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name, arity, flag) {};
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(source_);
+    res.push_back(receiver_);
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new RPopLPushCmd(*this);
   }
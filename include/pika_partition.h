@@ -8,12 +8,15 @@
 
 #include "blackwidow/blackwidow.h"
 #include "blackwidow/backupable.h"
-#include "slash/include/scope_record_lock.h"
 
 #include "include/pika_binlog.h"
+#include "include/pika_key_lock.h"
 
 class Cmd;
 
+std::string PartitionPath(const std::string& table_path,
+                          uint32_t partition_id);
+
 /*
  *Keyscan used
  */
@@ -54,7 +57,9 @@ class Partition : public std::enable_shared_from_this<Partition> {
   Partition(const std::string& table_name,
             uint32_t partition_id,
             const std::string& table_db_path,
-            const std::string& table_log_path);
+            const std::string& table_log_path,
+            KeyHashType key_hash = kKeyHashCrc32,
+            bool hash_tag = false);
   virtual ~Partition();
 
   std::string GetTableName() const;
@@ -65,13 +70,28 @@ class Partition : public std::enable_shared_from_this<Partition> {
 
   void Compact(const blackwidow::DataType& type);
   // needd to hold logger_->Lock()
-  Status WriteBinlog(const std::string& binlog);
+  Status WriteBinlog(const Slice& binlog);
+  // group commit, do NOT hold logger_->Lock()
+  Status GroupWriteBinlog(std::string* binlog);
+  // fdatasync binlog if there is unsynced write, do NOT hold logger_->Lock()
+  Status SyncBinlog();
+  // Replication picked up the binlog produced, the next write notifies again
+  void ClearBinlogProduced();
 
   void DbRWLockWriter();
   void DbRWLockReader();
   void DbRWUnLock();
 
-  slash::lock::LockMgr* LockMgr();
+  KeyLockTable* KeyLocks();
+
+  // Split use, hash mod 0 means never split
+  uint32_t hash_mod() const;
+  void SetHashMod(uint32_t hash_mod);
+  // Whether key still routes here, false once the partition was split
+  // and key went to the child
+  bool OwnsKey(const std::string& key) const;
+  // Copy the db as it is now to path, the caller keeps writes out
+  Status Checkpoint(const std::string& path);
 
   void SetBinlogIoError(bool error);
   bool IsBinlogIoError();
@@ -102,10 +122,17 @@ class Partition : public std::enable_shared_from_this<Partition> {
   // key scan info use
   Status GetKeyNum(std::vector<blackwidow::KeyInfo>* key_info);
   KeyScanInfo GetKeyScanInfo();
+  // Keys may have changed since the last count
+  void MarkKeysDirty();
+  // Count keys again if written since the last count, or if some of
+  // them carry a ttl and the count is kKeyNumExpireRecountSec old
+  Status RefreshKeyNum();
 
  private:
   std::string table_name_;
   uint32_t partition_id_;
+  KeyHashType key_hash_;
+  bool hash_tag_;
 
   std::string db_path_;
   std::string log_path_;
@@ -116,15 +143,20 @@ class Partition : public std::enable_shared_from_this<Partition> {
   bool opened_;
   std::shared_ptr<Binlog> logger_;
   std::atomic<bool> binlog_io_error_;
+  // Whether replication has been notified of binlog written
+  std::atomic<bool> binlog_produced_;
+  void NotifyBinlogProduced();
 
   pthread_rwlock_t db_rwlock_;
-  slash::lock::LockMgr* lock_mgr_;
+  KeyLockTable* key_locks_;
+  std::atomic<uint32_t> hash_mod_;
   std::shared_ptr<blackwidow::BlackWidow> db_;
 
   bool full_sync_;
 
   slash::Mutex key_info_protector_;
   KeyScanInfo key_scan_info_;
+  std::atomic<bool> keys_dirty_;
 
   /*
    * BgSave use
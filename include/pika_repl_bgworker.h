@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "pink/include/pb_conn.h"
 #include "pink/include/bg_thread.h"
@@ -36,7 +37,13 @@ class PikaReplBgWorker {
 
  private:
   pink::BGThread bg_thread_;
+  // binlog items and their commands of the batch in hand,
+  // items are appended to local binlog at once before commands are applied
+  std::vector<Slice> binlogs_;
+  std::vector<std::shared_ptr<Cmd>> cmds_;
+
   static int HandleWriteBinlog(pink::RedisParser* parser, const pink::RedisCmdArgsType& argv);
+  void ApplyBatch(const std::shared_ptr<Partition>& partition);
 };
 
 #endif  // PIKA_REPL_BGWROKER_H_
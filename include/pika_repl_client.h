@@ -47,21 +47,22 @@ struct ReplClientWriteBinlogTaskArg {
       res_private_data(_res_private_data), worker(_worker) {}
 };
 
+// Ack of binlog received by a slave partition
+struct BinlogSyncAck {
+  PartitionInfo p_info;
+  BinlogOffset ack_start;
+  BinlogOffset ack_end;
+  int32_t session_id;
+  uint64_t items;
+  BinlogSyncAck() : session_id(0), items(0) {}
+};
+
+// Commands of one apply lane from a received batch, applied in order
 struct ReplClientWriteDBTaskArg {
-  PikaCmdArgsType* argv;
-  BinlogItem* binlog_item;
-  std::string table_name;
-  uint32_t partition_id;
-  ReplClientWriteDBTaskArg(PikaCmdArgsType* _argv,
-                           BinlogItem* _binlog_item,
-                           const std::string _table_name,
-                           uint32_t _partition_id)
-      : argv(_argv), binlog_item(_binlog_item),
-        table_name(_table_name), partition_id(_partition_id) {}
-  ~ReplClientWriteDBTaskArg() {
-    delete argv;
-    delete binlog_item;
-  }
+  std::shared_ptr<Partition> partition;
+  std::vector<std::shared_ptr<Cmd>> cmds;
+  explicit ReplClientWriteDBTaskArg(const std::shared_ptr<Partition>& _partition)
+      : partition(_partition) {}
 };
 
 
@@ -81,9 +82,9 @@ class PikaReplClient {
                                const std::shared_ptr<InnerMessage::InnerResponse> res,
                                std::shared_ptr<pink::PbConn> conn,
                                void* req_private_data);
-  void ScheduleWriteDBTask(const std::string& dispatch_key,
-                           PikaCmdArgsType* argv, BinlogItem* binlog_item,
-                           const std::string& table_name, uint32_t partition_id);
+  // Commands on the same key go to the same apply lane, cmds are moved
+  void ScheduleWriteDBTask(const std::shared_ptr<Partition>& partition,
+                           std::vector<std::shared_ptr<Cmd>>* cmds);
 
   Status SendMetaSync();
   Status SendPartitionDBSync(const std::string& ip,
@@ -106,13 +107,32 @@ class PikaReplClient {
                                  const BinlogOffset& ack_end,
                                  const std::string& local_ip,
                                  bool is_frist_send);
+  // Acks of partitions synced from the same master, in one frame
+  // if batch is set, otherwise one binlog_sync frame per ack
+  Status SendBinlogSyncAcks(const std::string& ip,
+                            uint32_t port,
+                            const std::string& local_ip,
+                            const std::vector<BinlogSyncAck>& acks,
+                            bool batch);
   Status SendRemoveSlaveNode(const std::string& ip,
                              uint32_t port,
                              const std::string& table_name,
                              uint32_t partition_id,
                              const std::string& local_ip);
  private:
-  size_t GetHashIndex(std::string key, bool upper_half);
+  Status SendBinlogSyncAck(const std::string& ip,
+                           uint32_t port,
+                           const std::string& local_ip,
+                           const BinlogSyncAck& ack);
+  size_t GetBinlogWorkerIndex(const std::string& table_partition);
+  size_t GetApplyWorkerIndex(const std::string& key);
+  // The apply lanes the keys of the command map to, false if the
+  // command has to wait for every lane
+  bool GetApplyWorkerIndexes(const std::shared_ptr<Cmd>& c_ptr,
+                             std::vector<size_t>* indexes);
+  void ScheduleLanes(std::vector<ReplClientWriteDBTaskArg*>* lanes);
+  // Block until the lanes of indexes have run the tasks scheduled so far
+  void DrainApplyWorkers(const std::vector<size_t>& indexes);
   void UpdateNextAvail() {
     next_avail_ = (next_avail_ + 1) % bg_workers_.size();
   }
@@ -120,6 +140,9 @@ class PikaReplClient {
   PikaReplClientThread* client_thread_;
   int next_avail_;
   std::hash<std::string> str_hash;
+  // binlog workers come first, followed by apply workers
+  int binlog_worker_num_;
+  int apply_worker_num_;
   std::vector<PikaReplBgWorker*> bg_workers_;
 };
 
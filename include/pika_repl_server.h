@@ -29,7 +29,8 @@ class PikaReplServer {
   int Start();
   int Stop();
 
-  slash::Status SendSlaveBinlogChips(const std::string& ip, int port, const std::vector<WriteTask>& tasks);
+  slash::Status SendSlaveBinlogChips(const std::string& ip, int port, const std::vector<WriteTask>& tasks,
+                                     InnerMessage::CompressionType compression = InnerMessage::kNoCompression);
   void BuildBinlogSyncResp(const std::vector<WriteTask>& tasks, InnerMessage::InnerResponse* resp);
   slash::Status Write(const std::string& ip, const int port, const std::string& msg);
 
@@ -44,6 +45,11 @@ class PikaReplServer {
 
   pthread_rwlock_t client_conn_rwlock_;
   std::map<std::string, int> client_conn_map_;
+
+  // Serialize response, compressed if it is worth
+  slash::Status SerializeBinlogSyncResp(const InnerMessage::InnerResponse& response,
+                                        InnerMessage::CompressionType compression,
+                                        std::string* output);
 };
 
 #endif
@@ -8,8 +8,10 @@
 
 #include <string>
 #include <memory>
+#include <atomic>
 #include <unordered_map>
-#include <queue>
+#include <unordered_set>
+#include <deque>
 #include <vector>
 
 #include "slash/include/slash_status.h"
@@ -17,9 +19,12 @@
 #include "include/pika_binlog_reader.h"
 #include "include/pika_repl_client.h"
 #include "include/pika_repl_server.h"
+#include "include/pika_binlog_compression.h"
 
 #define kBinlogSendPacketNum 40
 #define kBinlogSendBatchNum 100
+// bytes of binlog the shared file reader of a partition keeps for its followers
+#define kBinlogSharedReadWindowSize (4 * 1024 * 1024)
 
 // unit seconds
 #define kSendKeepAliveTimeout (10 * 1000000)
@@ -30,42 +35,157 @@ using slash::Status;
 struct SyncWinItem {
   BinlogOffset offset_;
   bool acked_;
+  // when the binlog was produced, or read from file, in us
+  uint64_t produce_time_;
   bool operator==(const SyncWinItem& other) const {
     if (offset_.filenum == other.offset_.filenum && offset_.offset == other.offset_.offset) {
       return true;
     }
     return false;
   }
-  explicit SyncWinItem(const BinlogOffset& offset) : offset_(offset), acked_(false) {
+  SyncWinItem()
+    : offset_(), acked_(false), produce_time_(0) {
   }
-  SyncWinItem(uint32_t filenum, uint64_t offset) : offset_(filenum, offset), acked_(false) {
+  explicit SyncWinItem(const BinlogOffset& offset, uint64_t produce_time = 0)
+    : offset_(offset), acked_(false), produce_time_(produce_time) {
+  }
+  SyncWinItem(uint32_t filenum, uint64_t offset)
+    : offset_(filenum, offset), acked_(false), produce_time_(0) {
   }
   std::string ToString() const {
     return offset_.ToString() + " acked: " + std::to_string(acked_);
   }
 };
 
+// Replication lag from binlog produced to acked by slave, in us
+class ReplLagStatistic {
+ public:
+  ReplLagStatistic();
+  void Add(uint64_t lag);
+  void Reset();
+  uint64_t Count();
+  // percentile in (0, 100], returns the upper bound of its bucket
+  uint64_t Percentile(double percentile);
+
+ private:
+  // every power of 2 is split into 4 buckets
+  static const int kSubBuckets = 4;
+  static const int kBuckets = 64 * kSubBuckets;
+  static int BucketIndex(uint64_t lag);
+  static uint64_t BucketUpperBound(int index);
+  std::atomic<uint64_t> buckets_[kBuckets];
+};
+
+// Binlog acks sent to master, acks of several partitions share one frame
+class BinlogAckStatistic {
+ public:
+  BinlogAckStatistic();
+  void Add(uint64_t frames, uint64_t acks, uint64_t items);
+  void Reset();
+  // Refresh the per second rates if a second has passed
+  void Refresh(uint64_t now);
+
+  uint64_t frames() { return frames_.load(); }
+  uint64_t acks() { return acks_.load(); }
+  uint64_t items() { return items_.load(); }
+  uint64_t frames_per_sec() { return frames_per_sec_.load(); }
+  uint64_t acks_per_sec() { return acks_per_sec_.load(); }
+  uint64_t items_per_sec() { return items_per_sec_.load(); }
+
+ private:
+  std::atomic<uint64_t> frames_;
+  std::atomic<uint64_t> acks_;
+  std::atomic<uint64_t> items_;
+  std::atomic<uint64_t> frames_per_sec_;
+  std::atomic<uint64_t> acks_per_sec_;
+  std::atomic<uint64_t> items_per_sec_;
+  // only touched by Refresh
+  uint64_t last_time_us_;
+  uint64_t last_frames_;
+  uint64_t last_acks_;
+  uint64_t last_items_;
+};
+
 class SyncWindow {
  public:
-  SyncWindow() {
-  }
+  SyncWindow();
   void Push(const SyncWinItem& item);
   bool Update(const SyncWinItem& start_item, const SyncWinItem& end_item, BinlogOffset* acked_offset);
   int Remainings();
+  void Reset();
   std::string ToStringStatus() const {
-    if (win_.empty()) {
-      return "      Size: " + std::to_string(win_.size()) + "\r\n";
+    if (size_ == 0) {
+      return "      Size: " + std::to_string(size_) + "\r\n";
     } else {
       std::string res;
-      res += "      Size: " + std::to_string(win_.size()) + "\r\n";
-      res += ("      Begin_item: " + win_.begin()->ToString() + "\r\n");
-      res += ("      End_item: " + win_.rbegin()->ToString() + "\r\n");
+      res += "      Size: " + std::to_string(size_) + "\r\n";
+      res += ("      Begin_item: " + At(0).ToString() + "\r\n");
+      res += ("      End_item: " + At(size_ - 1).ToString() + "\r\n");
       return res;
     }
   }
  private:
-  // TODO(whoiami) ring buffer maybe
-  std::deque<SyncWinItem> win_;
+  static const size_t kInitCapacity = 1024;
+  // the i-th item from the oldest one
+  SyncWinItem& At(size_t i) {
+    return win_[(head_ + i) & (win_.size() - 1)];
+  }
+  const SyncWinItem& At(size_t i) const {
+    return win_[(head_ + i) & (win_.size() - 1)];
+  }
+  // offsets in the window are ascending, returns size_ if not found
+  size_t Find(const SyncWinItem& item) const;
+  void Grow();
+  // ring buffer, capacity is power of 2
+  std::vector<SyncWinItem> win_;
+  size_t head_;
+  size_t size_;
+};
+
+/*
+ * Binlog to be sent to one slave node, lock free with a single producer,
+ * who holds slave_mu of the node, and a single consumer, the auxiliary thread
+ */
+class SlaveWriteQueue {
+ public:
+  SlaveWriteQueue(const std::string& ip, int port,
+                  InnerMessage::CompressionType compression);
+  ~SlaveWriteQueue();
+
+  const std::string& Ip() const {
+    return ip_;
+  }
+  int Port() const {
+    return port_;
+  }
+  InnerMessage::CompressionType compression() const {
+    return compression_;
+  }
+
+  // Producer side, tasks are moved into the queue
+  void Produce(std::vector<WriteTask>* tasks);
+  // Consumer side, take at most count tasks not over max_bytes in total
+  void Consume(size_t count, size_t max_bytes, std::vector<WriteTask>* tasks);
+
+ private:
+  struct Node {
+    std::vector<WriteTask> tasks;
+    std::atomic<Node*> next;
+    Node() : next(nullptr) {}
+  };
+
+  std::string ip_;
+  int port_;
+  InnerMessage::CompressionType compression_;
+  // consumer owned, the node whose tasks were already taken
+  Node* head_;
+  std::deque<WriteTask> pending_;
+  // producer owned
+  Node* tail_;
+
+  // No copying allowed
+  SlaveWriteQueue(const SlaveWriteQueue&);
+  void operator=(const SlaveWriteQueue&);
 };
 
 // role master use
@@ -85,12 +205,21 @@ class SlaveNode : public RmNode {
   SyncWindow sync_win;
   BinlogOffset sent_offset;
   BinlogOffset acked_offset;
+  // codec of binlog sent to it, negotiated at TrySync
+  InnerMessage::CompressionType compression;
 
   std::string ToStringStatus();
 
+  // binlog of the partition, its cache is read in kReadFromCache
+  std::shared_ptr<Binlog> logger;
+  // own reader in kReadFromFile, nullptr if following the shared reader
   std::shared_ptr<PikaBinlogReader> binlog_reader;
+  // renewed on every binlog sync activation
+  std::shared_ptr<SlaveWriteQueue> write_queue;
   Status InitBinlogFileReader(const std::shared_ptr<Binlog>& binlog, const BinlogOffset& offset);
   void ReleaseBinlogFileReader();
+  // Unregister and forget write_queue, slave_mu should be held
+  void ReleaseWriteQueue();
 
   slash::Mutex slave_mu;
 };
@@ -111,8 +240,11 @@ class SyncPartition {
 class SyncMasterPartition : public SyncPartition {
  public:
   SyncMasterPartition(const std::string& table_name, uint32_t partition_id);
+  ~SyncMasterPartition();
   Status AddSlaveNode(const std::string& ip, int port, int session_id);
   Status RemoveSlaveNode(const std::string& ip, int port);
+  // Forget queue in the slaves holding it, it was unregistered
+  void DetachWriteQueue(const std::shared_ptr<SlaveWriteQueue>& queue);
 
   Status ActivateSlaveBinlogSync(const std::string& ip, int port, const std::shared_ptr<Binlog> binlog, const BinlogOffset& offset);
   Status ActivateSlaveDbSync(const std::string& ip, int port);
@@ -121,6 +253,7 @@ class SyncMasterPartition : public SyncPartition {
   Status UpdateSlaveBinlogAckInfo(const std::string& ip, int port, const BinlogOffset& start, const BinlogOffset& end);
   Status GetSlaveSyncBinlogInfo(const std::string& ip, int port, BinlogOffset* sent_offset, BinlogOffset* acked_offset);
   Status GetSlaveState(const std::string& ip, int port, SlaveState* const slave_state);
+  Status SetSlaveCompression(const std::string& ip, int port, InnerMessage::CompressionType compression);
 
   Status SetLastSendTime(const std::string& ip, int port, uint64_t time);
   Status GetLastSendTime(const std::string& ip, int port, uint64_t* time);
@@ -150,13 +283,18 @@ class SyncMasterPartition : public SyncPartition {
                          uint64_t partition_id, int session_id);
 
  private:
-  bool CheckReadBinlogFromCache();
+  bool CheckReadBinlogFromCache(const std::shared_ptr<Binlog>& binlog, const BinlogOffset& offset);
   // inovker need to hold partition_mu_
   void CleanMasterNode();
   void CleanSlaveNode();
   // invoker need to hold slave_mu_
   Status ReadCachedBinlogToWq(const std::shared_ptr<SlaveNode>& slave_ptr);
   Status ReadBinlogFileToWq(const std::shared_ptr<SlaveNode>& slave_ptr);
+  Status ReadBinlogFromReader(const std::shared_ptr<PikaBinlogReader>& reader, int cnt,
+                              std::vector<BinlogCacheItem>* items, bool* read_to_end);
+  // inovker need to hold partition_mu_
+  bool HasSharedReaderFollower(const std::shared_ptr<SlaveNode>& slave_ptr);
+  Status SeekSharedReader(const std::shared_ptr<Binlog>& binlog, const BinlogOffset& offset);
   // inovker need to hold partition_mu_
   Status GetSlaveNode(const std::string& ip, int port, std::shared_ptr<SlaveNode>* slave_node);
 
@@ -166,7 +304,11 @@ class SyncMasterPartition : public SyncPartition {
   slash::Mutex session_mu_;
   int32_t session_id_;
 
-  // BinlogCacheWindow win_;
+  // Slaves reading binlog file around the same offset follow one shared
+  // reader, the items it decoded are kept in shared_window_, protected
+  // by partition_mu_
+  std::shared_ptr<PikaBinlogReader> shared_reader_;
+  BinlogCache shared_window_;
 };
 
 class SyncSlavePartition : public SyncPartition {
@@ -207,12 +349,19 @@ class SyncSlavePartition : public SyncPartition {
   std::string LocalIp() {
     return local_ip_;
   }
+  void SetBatchAck(bool batch_ack) {
+    batch_ack_ = batch_ack;
+  }
+  bool BatchAck() {
+    return batch_ack_;
+  }
 
  private:
   slash::Mutex partition_mu_;
   RmNode m_info_;
   ReplState repl_state_;
   std::string local_ip_;
+  std::atomic<bool> batch_ack_;
 };
 
 class BinlogReaderManager {
@@ -256,6 +405,16 @@ class PikaReplicaManager {
   Status SendPartitionBinlogSyncAckRequest(const std::string& table, uint32_t partition_id,
                                            const BinlogOffset& ack_start, const BinlogOffset& ack_end,
                                            bool is_first_send = false);
+  /*
+   * Coalesce the ack of items binlog, it is sent with the pending acks of
+   * other partitions once binlog-ack-batch-items are pending or the oldest
+   * has waited binlog-ack-interval-us, a keepalive ack is sent at once
+   */
+  void AddBinlogSyncAck(const std::string& table, uint32_t partition_id,
+                        const BinlogOffset& ack_start, const BinlogOffset& ack_end,
+                        uint64_t items);
+  // Send the pending acks if due, return us until they are due, 0 if none
+  uint64_t CheckBinlogSyncAcks(uint64_t now);
   Status CloseReplClientConn(const std::string& ip, int32_t port);
 
   // For Pika Repl Server Thread
@@ -310,8 +469,24 @@ class PikaReplicaManager {
   Status UpdateSyncBinlogStatus(const RmNode& slave, const BinlogOffset& offset_start, const BinlogOffset& offset_end);
   Status GetSyncBinlogStatus(const RmNode& slave, BinlogOffset* sent_boffset, BinlogOffset* acked_boffset);
   Status GetSyncMasterPartitionSlaveState(const RmNode& slave, SlaveState* const slave_state);
+  Status SetSyncMasterPartitionSlaveCompression(const RmNode& slave, InnerMessage::CompressionType compression);
 
   Status WakeUpBinlogSync();
+  // Partition wrote binlog, its slaves will be fed by auxiliary thread
+  void SignalBinlogProduced(const PartitionInfo& p_info);
+  Status WakeUpProducedBinlogSync();
+
+  ReplLagStatistic& repl_lag_statistic() {
+    return repl_lag_statistic_;
+  }
+
+  BinlogAckStatistic& binlog_ack_statistic() {
+    return binlog_ack_statistic_;
+  }
+
+  BinlogCompressionStatistic& binlog_compression_statistic() {
+    return binlog_compression_statistic_;
+  }
 
   // Session Id
   int32_t GenPartitionSessionId(const std::string& table_name, uint32_t partition_id);
@@ -323,7 +498,11 @@ class PikaReplicaManager {
                                      uint32_t partition_id, int session_id);
 
   // write_queue related
-  void ProduceWriteQueue(const std::string& ip, int port, const std::vector<WriteTask>& tasks);
+  std::shared_ptr<SlaveWriteQueue> RegisterWriteQueue(const std::string& ip, int port,
+                                                      InnerMessage::CompressionType compression);
+  void UnregisterWriteQueue(const std::shared_ptr<SlaveWriteQueue>& queue);
+  // Make the slaves sending through queue stop producing to it
+  void DetachWriteQueue(const std::shared_ptr<SlaveWriteQueue>& queue);
   int ConsumeWriteQueue();
   void DropItemInWriteQueue(const std::string& ip, int port);
 
@@ -333,9 +512,8 @@ class PikaReplicaManager {
   void ScheduleWriteBinlogTask(const std::string& table_partition,
                                const std::shared_ptr<InnerMessage::InnerResponse> res,
                                std::shared_ptr<pink::PbConn> conn, void* res_private_data);
-  void ScheduleWriteDBTask(const std::string& dispatch_key,
-                           PikaCmdArgsType* argv, BinlogItem* binlog_item,
-                           const std::string& table_name, uint32_t partition_id);
+  void ScheduleWriteDBTask(const std::shared_ptr<Partition>& partition,
+                           std::vector<std::shared_ptr<Cmd>>* cmds);
 
   void ReplServerRemoveClientConn(int fd);
   void ReplServerUpdateClientConnMap(const std::string& ip_port, int fd);
@@ -349,9 +527,24 @@ class PikaReplicaManager {
   std::unordered_map<PartitionInfo, std::shared_ptr<SyncMasterPartition>, hash_partition_info> sync_master_partitions_;
   std::unordered_map<PartitionInfo, std::shared_ptr<SyncSlavePartition>, hash_partition_info> sync_slave_partitions_;
 
-  slash::Mutex  write_queue_mu_;
-  // every host owns a queue
-  std::unordered_map<std::string, std::queue<WriteTask>> write_queues_;  // ip+port, queue<WriteTask>
+  slash::Mutex produced_mu_;
+  std::unordered_set<PartitionInfo, hash_partition_info> produced_partitions_;
+
+  ReplLagStatistic repl_lag_statistic_;
+
+  void SendBinlogSyncAcks(const std::vector<BinlogSyncAck>& acks);
+  slash::Mutex pending_acks_mu_;
+  std::unordered_map<PartitionInfo, BinlogSyncAck, hash_partition_info> pending_acks_;
+  uint64_t pending_ack_items_;
+  // when the oldest pending ack was added, in us, 0 if none
+  uint64_t pending_ack_since_;
+  BinlogAckStatistic binlog_ack_statistic_;
+  BinlogCompressionStatistic binlog_compression_statistic_;
+
+  // only taken when a queue is added or removed, and to list them for consuming
+  pthread_rwlock_t write_queues_rw_;
+  // every slave node owns a queue
+  std::vector<std::shared_ptr<SlaveWriteQueue>> write_queues_;
 
   PikaReplClient* pika_repl_client_;
   PikaReplServer* pika_repl_server_;
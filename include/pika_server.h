@@ -27,33 +27,100 @@
 #include "include/pika_dispatch_thread.h"
 #include "include/pika_repl_client.h"
 #include "include/pika_repl_server.h"
+#include "include/pika_slot_migrator.h"
 #include "include/pika_auxiliary_thread.h"
 
 using slash::Status;
 using slash::Slice;
 
+// Counters of one command
+struct CmdStat {
+  std::atomic<uint64_t> calls;
+  // cumulative execution time
+  std::atomic<uint64_t> usec;
+  CmdStat() : calls(0), usec(0) {}
+};
+
+/*
+ * Statistics only written by its own thread, neither the counters nor
+ * the cache lines are shared with other threads, readers sum them up
+ */
+class ThreadStatistic {
+ public:
+  explicit ThreadStatistic(size_t cmd_num);
+  ~ThreadStatistic();
+
+  void AddQuery() {
+    querynum_.fetch_add(1, std::memory_order_relaxed);
+  }
+  void AddCmdCall(int cmd_id) {
+    cmd_stats_[cmd_id].calls.fetch_add(1, std::memory_order_relaxed);
+  }
+  void AddCmdLatency(int cmd_id, uint64_t usec) {
+    cmd_stats_[cmd_id].usec.fetch_add(usec, std::memory_order_relaxed);
+  }
+  // calls counts batches, usec is from arriving to being replied
+  void AddExecBatch(ExecMode mode, uint64_t usec) {
+    exec_mode_stats_[mode].calls.fetch_add(1, std::memory_order_relaxed);
+    exec_mode_stats_[mode].usec.fetch_add(usec, std::memory_order_relaxed);
+  }
+  CmdStat& exec_mode_stat(ExecMode mode) {
+    return exec_mode_stats_[mode];
+  }
+  uint64_t querynum() {
+    return querynum_.load(std::memory_order_relaxed);
+  }
+  CmdStat& cmd_stat(int cmd_id) {
+    return cmd_stats_[cmd_id];
+  }
+  void Reset();
+
+ private:
+  char head_pad_[kCacheLineSize];
+  std::atomic<uint64_t> querynum_;
+  CmdStat exec_mode_stats_[kExecModeNum];
+  size_t cmd_num_;
+  // cache line aligned array indexed by command id
+  CmdStat* cmd_stats_;
+  char tail_pad_[kCacheLineSize];
+
+  // No copying allowed
+  ThreadStatistic(const ThreadStatistic&);
+  void operator=(const ThreadStatistic&);
+};
+
+// Statistic of one command summed up from all threads
+struct CmdStatInfo {
+  uint64_t calls;
+  uint64_t usec;
+  CmdStatInfo() : calls(0), usec(0) {}
+};
+
 struct StatisticData {
   StatisticData()
       : accumulative_connections(0),
-        thread_querynum(0),
         last_thread_querynum(0),
         last_sec_thread_querynum(0),
         last_time_us(0) {
     CmdTable* cmds = new CmdTable();
     cmds->reserve(300);
     InitCmdTable(cmds);
-    CmdTable::const_iterator it = cmds->begin();
-    for (; it != cmds->end(); ++it) {
-      std::string tmp = it->first;
-      exec_count_table[slash::StringToUpper(tmp)].store(0);
-    }
+    // Same ids as PikaCmdTableManager
+    cmd_index.Build(*cmds);
     DestoryCmdTable(cmds);
     delete cmds;
   }
+  ~StatisticData() {
+    for (auto stat : thread_stats) {
+      delete stat;
+    }
+  }
 
   std::atomic<uint64_t> accumulative_connections;
-  std::unordered_map<std::string, std::atomic<uint64_t>> exec_count_table;
-  std::atomic<uint64_t> thread_querynum;
+  CmdNameIndex cmd_index;
+  // every thread which has run commands owns one, never removed
+  slash::Mutex thread_stats_mu;
+  std::vector<ThreadStatistic*> thread_stats;
   std::atomic<uint64_t> last_thread_querynum;
   std::atomic<uint64_t> last_sec_thread_querynum;
   std::atomic<uint64_t> last_time_us;
@@ -72,16 +139,11 @@ static std::set<std::string> MultiKvCommands {kCmdNameDel,
              kCmdNameGeoRadius,   kCmdNameGeoRadiusByMember};
 */
 
+// Commands over all keys, multi key commands are served when their keys
+// are in one partition
 static std::set<std::string> ShardingModeNotSupportCommands {
-             kCmdNameMsetnx,      kCmdNameScan,              kCmdNameKeys,
-             kCmdNameScanx,       kCmdNamePKScanRange,       kCmdNamePKRScanRange,
-             kCmdNameRPopLPush,   kCmdNameZUnionstore,       kCmdNameZInterstore,
-             kCmdNameSUnion,      kCmdNameSUnionstore,       kCmdNameSInter,
-             kCmdNameSInterstore, kCmdNameSDiff,             kCmdNameSDiffstore,
-             kCmdNameSMove,       kCmdNameBitOp,             kCmdNamePfAdd,
-             kCmdNamePfCount,     kCmdNamePfMerge,           kCmdNameGeoAdd,
-             kCmdNameGeoPos,      kCmdNameGeoDist,           kCmdNameGeoHash,
-             kCmdNameGeoRadius,   kCmdNameGeoRadiusByMember, kCmdNamePKPatternMatchDel};
+             kCmdNameScan,        kCmdNameKeys,              kCmdNameScanx,
+             kCmdNamePKScanRange, kCmdNamePKRScanRange,      kCmdNamePKPatternMatchDel};
 
 
 extern PikaConf *g_pika_conf;
@@ -98,6 +160,7 @@ enum TaskType {
   kStartKeyScan,
   kStopKeyScan,
   kBgSave,
+  kSyncBinlog,
 };
 
 class PikaServer {
@@ -142,6 +205,13 @@ class PikaServer {
   bool IsTableBinlogIoError(const std::string& table_name);
   Status DoSameThingSpecificTable(const TaskType& type, const std::set<std::string>& tables = {});
 
+  /*
+   * Slot change use, only one addslots/delslots/splitslot at a time
+   */
+  bool TryLockSlotState();
+  void LockSlotState();
+  void UnlockSlotState();
+
   /*
    * Partition use
    */
@@ -193,9 +263,17 @@ class PikaServer {
   void SetLoopPartitionStateMachine(bool need_loop);
 
   /*
-   * ThreadPool Process Task
+   * ThreadPool Process Task, tasks of one shard are queued in order,
+   * kExecPriorPool and kExecSlowPool tasks go to their own pool if any
    */
-  void Schedule(pink::TaskFunc func, void* arg);
+  void Schedule(pink::TaskFunc func, void* arg, size_t shard = 0,
+                ExecMode mode = kExecPool);
+  size_t ThreadPoolShards();
+  size_t ThreadPoolQueueSize(size_t shard);
+  // Whether the pool of kExecPriorPool or kExecSlowPool is configured
+  bool HasThreadPool(ExecMode mode);
+  // Shards are handed out to new connections round robin
+  size_t NextThreadPoolShard();
 
   /*
    * BGSave used
@@ -234,6 +312,11 @@ class PikaServer {
    */
   void KeyScanTaskSchedule(pink::TaskFunc func, void* arg);
 
+  /*
+   * Slots migrate used
+   */
+  PikaSlotsMigrator* slots_migrator();
+
   /*
    * Client used
    */
@@ -266,8 +349,15 @@ class PikaServer {
   uint64_t accumulative_connections();
   void incr_accumulative_connections();
   void ResetLastSecQuerynum();
-  void UpdateQueryNumAndExecCountTable(const std::string& command);
+  void UpdateQueryNumAndExecCountTable(int cmd_id);
+  void UpdateCmdLatency(int cmd_id, uint64_t usec);
   std::unordered_map<std::string, uint64_t> ServerExecCountTable();
+  // keyed by command name in lower case
+  std::map<std::string, CmdStatInfo> ServerCmdStats();
+  // indexed by command id
+  std::vector<CmdStatInfo> ServerCmdStatsById();
+  void UpdateExecModeLatency(ExecMode mode, uint64_t usec);
+  CmdStatInfo ServerExecModeStat(ExecMode mode);
 
   /*
    * Slave to Master communication used
@@ -298,6 +388,7 @@ class PikaServer {
   friend class InfoCmd;
   friend class PkClusterAddSlotsCmd;
   friend class PkClusterDelSlotsCmd;
+  friend class PkClusterSplitSlotCmd;
   friend class PikaReplClientConn;
   friend class PkClusterInfoCmd;
 
@@ -310,6 +401,9 @@ class PikaServer {
   void AutoPurge();
   void AutoDeleteExpiredDump();
   void AutoKeepAliveRSync();
+  // Commands flagged slow that were cheap in the last period
+  // leave the slow lane, HGETALL of small hashes e.g.
+  void AutoClassifySlowCmds();
 
   std::string host_;
   int port_;
@@ -324,6 +418,8 @@ class PikaServer {
    * Table used
    */
   std::atomic<SlotState> slot_state_;
+  slash::Mutex slot_state_mu_;
+  slash::CondVar slot_state_cv_;   // signaled when slot_state_ becomes INFREE
   pthread_rwlock_t tables_rw_;
   std::map<std::string, std::shared_ptr<Table>> tables_;
 
@@ -332,12 +428,18 @@ class PikaServer {
    */
   bool have_scheduled_crontask_;
   struct timeval last_check_compact_time_;
+  // command stats by id at the last AutoClassifySlowCmds
+  std::vector<CmdStatInfo> last_cmd_stats_;
 
   /*
    * Communicate with the client used
    */
   int worker_num_;
-  pink::ThreadPool* pika_thread_pool_;
+  std::vector<pink::ThreadPool*> pika_thread_pools_;
+  // NULL if not configured
+  pink::ThreadPool* pika_prior_thread_pool_;
+  pink::ThreadPool* pika_slow_thread_pool_;
+  std::atomic<size_t> next_thread_pool_shard_;
   PikaDispatchThread* pika_dispatch_thread_;
 
 
@@ -362,6 +464,12 @@ class PikaServer {
    */
   pink::BGThread purge_thread_;
 
+  /*
+   * Binlog sync used, for binlog-sync-policy everysec
+   */
+  pink::BGThread binlog_sync_thread_;
+  static void DoBinlogSync(void* arg);
+
   /*
    * DBSync used
    */
@@ -373,6 +481,11 @@ class PikaServer {
    */
   pink::BGThread key_scan_thread_;
 
+  /*
+   * Slots migrate used
+   */
+  PikaSlotsMigrator* pika_slots_migrator_;
+
   /*
    * Monitor used
    */
@@ -404,6 +517,8 @@ class PikaServer {
    * Statistic used
    */
   StatisticData statistic_data_;
+  // the statistic of the calling thread, registered at the first call
+  ThreadStatistic* CurrentThreadStatistic();
 
   PikaServer(PikaServer &ps);
   void operator =(const PikaServer &ps);
@@ -132,6 +132,9 @@ class SUnionCmd : public Cmd {
   SUnionCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    return keys_;
+  }
   virtual Cmd* Clone() override {
     return new SUnionCmd(*this);
   }
@@ -145,6 +148,12 @@ class SUnionstoreCmd : public Cmd {
   SUnionstoreCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(dest_key_);
+    res.insert(res.end(), keys_.begin(), keys_.end());
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new SUnionstoreCmd(*this);
   }
@@ -159,6 +168,9 @@ class SInterCmd : public Cmd {
   SInterCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    return keys_;
+  }
   virtual Cmd* Clone() override {
     return new SInterCmd(*this);
   }
@@ -172,6 +184,12 @@ class SInterstoreCmd : public Cmd {
   SInterstoreCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(dest_key_);
+    res.insert(res.end(), keys_.begin(), keys_.end());
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new SInterstoreCmd(*this);
   }
@@ -204,6 +222,9 @@ class SDiffCmd : public Cmd {
   SDiffCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    return keys_;
+  }
   virtual Cmd* Clone() override {
     return new SDiffCmd(*this);
   }
@@ -217,6 +238,12 @@ class SDiffstoreCmd : public Cmd {
   SDiffstoreCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(dest_key_);
+    res.insert(res.end(), keys_.begin(), keys_.end());
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new SDiffstoreCmd(*this);
   }
@@ -231,6 +258,12 @@ class SMoveCmd : public Cmd {
   SMoveCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name,  arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(src_key_);
+    res.push_back(dest_key_);
+    return res;
+  }
   virtual Cmd* Clone() override {
     return new SMoveCmd(*this);
   }
@@ -7,6 +7,7 @@
 #define PIKA_SLOT_H_
 
 #include "include/pika_command.h"
+#include "include/pika_slot_migrator.h"
 
 class SlotsInfoCmd : public Cmd {
  public:
@@ -41,26 +42,26 @@ class SlotsMgrtSlotAsyncCmd : public Cmd {
     return new SlotsMgrtSlotAsyncCmd(*this);
   }
  private:
+  SlotsMigrateArgs args_;
   virtual void DoInitial() override;
+  virtual void Clear() {
+    args_ = SlotsMigrateArgs();
+  }
 };
 
 class SlotsMgrtTagSlotAsyncCmd : public Cmd {
  public:
   SlotsMgrtTagSlotAsyncCmd(const std::string& name, int arity, uint16_t flag)
-    : Cmd(name, arity, flag), dest_port_(0), slot_num_(-1) {}
+    : Cmd(name, arity, flag) {}
   virtual void Do(std::shared_ptr<Partition> partition = nullptr);
   virtual Cmd* Clone() override {
     return new SlotsMgrtTagSlotAsyncCmd(*this);
   }
  private:
+  SlotsMigrateArgs args_;
   virtual void DoInitial() override;
-  std::string dest_ip_;
-  int64_t dest_port_;
-  int64_t slot_num_;
   virtual void Clear() {
-    dest_ip_.clear();
-    dest_port_ = 0;
-    slot_num_ = -1;
+    args_ = SlotsMigrateArgs();
   }
 };
 
@@ -149,7 +150,11 @@ class SlotsMgrtSlotCmd : public Cmd {
     return new SlotsMgrtSlotCmd(*this);
   }
  private:
+  SlotsMigrateArgs args_;
   virtual void DoInitial() override;
+  virtual void Clear() {
+    args_ = SlotsMigrateArgs();
+  }
 };
 
 class SlotsMgrtTagSlotCmd : public Cmd {
@@ -161,7 +166,11 @@ class SlotsMgrtTagSlotCmd : public Cmd {
     return new SlotsMgrtTagSlotCmd(*this);
   }
  private:
+  SlotsMigrateArgs args_;
   virtual void DoInitial() override;
+  virtual void Clear() {
+    args_ = SlotsMigrateArgs();
+  }
 };
 
 class SlotsMgrtOneCmd : public Cmd {
@@ -173,7 +182,13 @@ class SlotsMgrtOneCmd : public Cmd {
     return new SlotsMgrtOneCmd(*this);
   }
  private:
+  SlotsMigrateArgs args_;
+  std::string key_;
   virtual void DoInitial() override;
+  virtual void Clear() {
+    args_ = SlotsMigrateArgs();
+    key_.clear();
+  }
 };
 
 class SlotsMgrtTagOneCmd : public Cmd {
@@ -185,7 +200,13 @@ class SlotsMgrtTagOneCmd : public Cmd {
     return new SlotsMgrtTagOneCmd(*this);
   }
  private:
+  SlotsMigrateArgs args_;
+  std::string key_;
   virtual void DoInitial() override;
+  virtual void Clear() {
+    args_ = SlotsMigrateArgs();
+    key_.clear();
+  }
 };
 
 #endif  // PIKA_SLOT_H_
@@ -0,0 +1,112 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#ifndef PIKA_SLOT_MIGRATOR_H_
+#define PIKA_SLOT_MIGRATOR_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_set>
+
+#include "pink/include/bg_thread.h"
+#include "pink/include/redis_cli.h"
+#include "slash/include/slash_mutex.h"
+#include "slash/include/slash_status.h"
+
+#include "include/pika_partition.h"
+
+using slash::Status;
+
+// Where and how a slot is migrated, as SLOTSMGRTTAGSLOT-ASYNC gives
+struct SlotsMigrateArgs {
+  std::string dest_ip;
+  int64_t dest_port;
+  int64_t timeout_ms;
+  // commands and bytes sent before waiting for their replies
+  int64_t max_bulks;
+  int64_t max_bytes;
+  std::string table;
+  int64_t slot;
+  // keys migrated per batch
+  int64_t batch_keys;
+  // keys sharing a {tag} are sent in the same batch
+  bool with_tag;
+  SlotsMigrateArgs()
+      : dest_port(0), timeout_ms(0), max_bulks(0), max_bytes(0),
+        slot(-1), batch_keys(0), with_tag(false) {}
+};
+
+// Reported by SLOTSMGRT-ASYNC-STATUS
+struct SlotsMigrateStatus {
+  std::string dest_ip;
+  int64_t dest_port;
+  int64_t slot;
+  bool migrating;
+  int64_t moved;
+  int64_t remained;
+};
+
+class Table;
+
+// key and the keys of partition sharing its {tag}, which have to stay
+// together, wherever the tag is in them. Takes a scan of the partition
+std::vector<std::string> KeysOfTag(const std::shared_ptr<Table>& table,
+                                   const std::shared_ptr<Partition>& partition,
+                                   const std::string& key);
+
+/*
+ * Moves the keys of a slot to another server key by key, keys are sent
+ * as plain write commands in batches, and deleted here once the target
+ * replied them all, one async migration runs at a time
+ */
+class PikaSlotsMigrator {
+ public:
+  PikaSlotsMigrator();
+  ~PikaSlotsMigrator();
+
+  /*
+   * Start migrating a slot in the background, or report the migration
+   * of the same slot and dest in progress, which takes the new limits,
+   * a migration of another slot or dest is refused until done
+   */
+  Status MigrateAsync(const SlotsMigrateArgs& args, int64_t* moved, int64_t* remained);
+  // Migrate the keys right away, moved counts those found here
+  Status MigrateKeys(const SlotsMigrateArgs& args,
+                     const std::vector<std::string>& keys, int64_t* moved);
+  // Stop after the batch in flight, keys not sent yet stay here
+  void Cancel();
+  SlotsMigrateStatus GetStatus();
+  // Whether key is being sent, its clients should retry later
+  bool IsMigrating(const std::string& key);
+
+ private:
+  static void DoMigrateSlot(void* arg);
+  void MigrateSlot();
+
+  Status Connect(const SlotsMigrateArgs& args, pink::PinkCli* cli);
+  // Send the keys, wait for all replies, then delete them here
+  Status MigrateBatch(pink::PinkCli* cli, const SlotsMigrateArgs& args,
+                      const std::shared_ptr<Partition>& partition,
+                      const std::vector<std::string>& keys, int64_t* moved);
+
+  pink::BGThread migrate_thread_;
+
+  slash::Mutex mu_;
+  SlotsMigrateArgs args_;
+  bool migrating_;
+  int64_t moved_;
+  int64_t remained_;
+  // why the last migration stopped, returned once to the next request
+  Status last_status_;
+  std::unordered_set<std::string> migrating_keys_;
+  std::atomic<bool> cancel_;
+
+  // No copying allowed
+  PikaSlotsMigrator(const PikaSlotsMigrator&);
+  void operator=(const PikaSlotsMigrator&);
+};
+
+#endif  // PIKA_SLOT_MIGRATOR_H_
@@ -6,6 +6,8 @@
 #ifndef PIKA_TABLE_H_
 #define PIKA_TABLE_H_
 
+#include <atomic>
+
 #include "blackwidow/blackwidow.h"
 
 #include "include/pika_command.h"
@@ -16,7 +18,9 @@ class Table : public std::enable_shared_from_this<Table>{
   Table(const std::string& table_name,
         uint32_t partition_num,
         const std::string& db_path,
-        const std::string& log_path);
+        const std::string& log_path,
+        KeyHashType key_hash = kKeyHashCrc32,
+        bool hash_tag = false);
   virtual ~Table();
 
   friend class Cmd;
@@ -44,6 +48,9 @@ class Table : public std::enable_shared_from_this<Table>{
   void ScanDatabase(const blackwidow::DataType& type);
   KeyScanInfo GetKeyScanInfo();
   Status GetPartitionsKeyScanInfo(std::map<uint32_t, KeyScanInfo>* infos);
+  // Count the keys of partitions changed since their last count again,
+  // in background, the others keep their count
+  void RefreshKeyNum();
 
   // Compact use;
   void Compact(const blackwidow::DataType& type);
@@ -53,9 +60,30 @@ class Table : public std::enable_shared_from_this<Table>{
   std::shared_ptr<Partition> GetPartitionById(uint32_t partition_id);
   std::shared_ptr<Partition> GetPartitionByKey(const std::string& key);
 
+  // Split use, hash mods are set before partitions are added
+  void SetHashMods(const std::map<uint32_t, uint32_t>& hash_mods);
+  // Id of the partition key routes to
+  uint32_t PartitionIdOfKey(const std::string& key);
+  // Whether keys route by their {tag}
+  bool hash_tag() const;
+  /*
+   * Split a partition into itself and child_id by one more bit of the
+   * key hash, the child starts as a checkpoint of the partition, whose
+   * writes wait meanwhile, keys of the other half are left behind in
+   * both until CleanSplitPartition. On a master split_cmd is written to
+   * the binlog of the partition right at the split, so its slaves split
+   * at the same point, and both halves are recorded to be cleaned, a
+   * slave applying it passes null
+   */
+  Status SplitPartition(uint32_t partition_id, Cmd* split_cmd, uint32_t* child_id);
+  // Delete in background the keys no longer routed to the partition
+  void CleanSplitPartition(uint32_t partition_id);
+
  private:
   std::string table_name_;
   uint32_t partition_num_;
+  KeyHashType key_hash_;
+  bool hash_tag_;
   std::string db_path_;
   std::string log_path_;
 
@@ -65,6 +93,15 @@ class Table : public std::enable_shared_from_this<Table>{
   pthread_rwlock_t partitions_rw_;
   std::map<uint32_t, std::shared_ptr<Partition>> partitions_;
 
+  /*
+   * Split use, protected by partitions_rw_
+   */
+  // partition id -> hash mod of the split partitions
+  std::map<uint32_t, uint32_t> hash_mods_;
+  uint32_t max_hash_mod_;
+  uint32_t RoutePartitionId(const std::string& key);
+  static void DoCleanSplitPartition(void* arg);
+
   /*
    * KeyScan use
    */
@@ -72,6 +109,8 @@ class Table : public std::enable_shared_from_this<Table>{
   void InitKeyScan();
   slash::Mutex key_scan_protector_;
   KeyScanInfo key_scan_info_;
+  static void DoRefreshKeyNum(void* arg);
+  std::atomic<bool> key_num_refreshing_;
 
   /*
    * No allowed copy and copy assign
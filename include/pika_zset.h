@@ -240,6 +240,12 @@ class ZsetUIstoreParentCmd : public Cmd {
  public:
   ZsetUIstoreParentCmd(const std::string& name, int arity, uint16_t flag)
       : Cmd(name, arity, flag), aggregate_(blackwidow::SUM) {}
+  virtual std::vector<std::string> current_key() const {
+    std::vector<std::string> res;
+    res.push_back(dest_key_);
+    res.insert(res.end(), keys_.begin(), keys_.end());
+    return res;
+  }
  protected:
   std::string dest_key_;
   int64_t num_keys_;
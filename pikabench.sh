@@ -0,0 +1,32 @@
+#!/bin/bash
+# Compare the throughput of a single shared thread pool queue with sharded
+# queues, usage: ./pikabench.sh [shards] [clients] [requests]
+SHARDS=${1:-4}
+CLIENTS=${2:-64}
+REQUESTS=${3:-1000000}
+PORT=19221
+BENCH_DIR=./bench
+
+run_bench() {
+  rm -rf $BENCH_DIR
+  mkdir -p $BENCH_DIR
+  sed -e "s/^port : .*/port : $PORT/" \
+      -e "s#^log-path : .*#log-path : $BENCH_DIR/log/#" \
+      -e "s#^db-path : .*#db-path : $BENCH_DIR/db/#" \
+      -e "s#^dump-path : .*#dump-path : $BENCH_DIR/dump/#" \
+      -e "s#^db-sync-path : .*#db-sync-path : $BENCH_DIR/dbsync/#" \
+      -e "s#^pidfile : .*#pidfile : $BENCH_DIR/pika.pid#" \
+      -e "s/^thread-pool-shards : .*/thread-pool-shards : $1/" \
+      output/conf/pika.conf > $BENCH_DIR/pika.conf
+  output/bin/pika -c $BENCH_DIR/pika.conf &
+  PID=$!
+  sleep 3
+  echo "thread-pool-shards : $1"
+  redis-benchmark -p $PORT -c $CLIENTS -n $REQUESTS -r 1000000 -t set,get -q
+  kill $PID
+  wait $PID
+}
+
+run_bench 1
+run_bench $SHARDS
+rm -rf $BENCH_DIR
@@ -441,28 +441,29 @@ void FlushallCmd::Do(std::shared_ptr<Partition> partition) {
 }
 
 // flushall convert flushdb writes to every partition binlog
-std::string FlushallCmd::ToBinlog(
+void FlushallCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
   std::string content;
-  content.reserve(RAW_ARGS_LEN);
   RedisAppendLen(content, 1, "*");
 
   // to flushdb cmd
   std::string flushdb_cmd("flushdb");
   RedisAppendLen(content, flushdb_cmd.size(), "$");
   RedisAppendContent(content, flushdb_cmd);
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
+  PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                      exec_time,
+                                      std::stoi(server_id),
+                                      logic_id,
+                                      filenum,
+                                      offset,
+                                      content,
+                                      {},
+                                      binlog);
 }
 
 void FlushdbCmd::DoInitial() {
@@ -598,6 +599,7 @@ const std::string InfoCmd::kServerSection = "server";
 const std::string InfoCmd::kClientsSection = "clients";
 const std::string InfoCmd::kStatsSection = "stats";
 const std::string InfoCmd::kExecCountSection= "command_exec_count";
+const std::string InfoCmd::kCommandStatsSection = "commandstats";
 const std::string InfoCmd::kCPUSection = "cpu";
 const std::string InfoCmd::kReplicationSection = "replication";
 const std::string InfoCmd::kKeyspaceSection = "keyspace";
@@ -625,6 +627,8 @@ void InfoCmd::DoInitial() {
     info_section_ = kInfoStats;
   } else if (!strcasecmp(argv_[1].data(), kExecCountSection.data())) {
     info_section_ = kInfoExecCount;
+  } else if (!strcasecmp(argv_[1].data(), kCommandStatsSection.data())) {
+    info_section_ = kInfoCommandStats;
   } else if (!strcasecmp(argv_[1].data(), kCPUSection.data())) {
     info_section_ = kInfoCPU;
   } else if (!strcasecmp(argv_[1].data(), kReplicationSection.data())) {
@@ -706,6 +710,8 @@ void InfoCmd::Do(std::shared_ptr<Partition> partition) {
       info.append("\r\n");
       InfoExecCount(info);
       info.append("\r\n");
+      InfoCommandStats(info);
+      info.append("\r\n");
       InfoCPU(info);
       info.append("\r\n");
       InfoReplication(info);
@@ -724,6 +730,9 @@ void InfoCmd::Do(std::shared_ptr<Partition> partition) {
     case kInfoExecCount:
       InfoExecCount(info);
       break;
+    case kInfoCommandStats:
+      InfoCommandStats(info);
+      break;
     case kInfoCPU:
       InfoCPU(info);
       break;
@@ -796,11 +805,43 @@ void InfoCmd::InfoStats(std::string& info) {
   tmp_stream << "total_connections_received:" << g_pika_server->accumulative_connections() << "\r\n";
   tmp_stream << "instantaneous_ops_per_sec:" << g_pika_server->ServerCurrentQps() << "\r\n";
   tmp_stream << "total_commands_processed:" << g_pika_server->ServerQueryNum() << "\r\n";
+  const char* exec_mode_names[kExecModeNum] = {"inline", "pool", "prior_pool", "slow_pool"};
+  for (int mode = 0; mode < kExecModeNum; ++mode) {
+    CmdStatInfo stat = g_pika_server->ServerExecModeStat(static_cast<ExecMode>(mode));
+    tmp_stream << exec_mode_names[mode] << "_exec_batches:" << stat.calls << "\r\n";
+    tmp_stream << exec_mode_names[mode] << "_exec_usec_per_batch:" << (stat.calls ? stat.usec / stat.calls : 0) << "\r\n";
+  }
   tmp_stream << "is_bgsaving:" << (g_pika_server->IsBgSaving() ? "Yes" : "No") << "\r\n";
   tmp_stream << "is_scaning_keyspace:" << (g_pika_server->IsKeyScaning() ? "Yes" : "No") << "\r\n";
   tmp_stream << "is_compact:" << (g_pika_server->IsCompacting() ? "Yes" : "No") << "\r\n";
   tmp_stream << "compact_cron:" << g_pika_conf->compact_cron() << "\r\n";
   tmp_stream << "compact_interval:" << g_pika_conf->compact_interval() << "\r\n";
+  tmp_stream << "binlog_sync_policy:" << g_pika_conf->binlog_sync_policy_str() << "\r\n";
+
+  // record lock contention, partitions never waited are left out
+  uint64_t total_waits = 0, total_wait_us = 0;
+  std::stringstream lock_stream;
+  {
+  slash::RWLock table_rwl(&g_pika_server->tables_rw_, false);
+  for (const auto& table_item : g_pika_server->tables_) {
+    slash::RWLock partition_rwl(&table_item.second->partitions_rw_, false);
+    for (const auto& partition_item : table_item.second->partitions_) {
+      KeyLockTable* key_locks = partition_item.second->KeyLocks();
+      uint64_t waits = key_locks->waits();
+      if (waits == 0) {
+        continue;
+      }
+      uint64_t wait_us = key_locks->wait_us();
+      total_waits += waits;
+      total_wait_us += wait_us;
+      lock_stream << "key_lock_wait_" << partition_item.second->GetPartitionName()
+        << ":waits=" << waits << ",usec=" << wait_us << ",usec_per_wait=" << wait_us / waits << "\r\n";
+    }
+  }
+  }
+  tmp_stream << "key_lock_waits:" << total_waits << "\r\n";
+  tmp_stream << "key_lock_wait_usec:" << total_wait_us << "\r\n";
+  tmp_stream << lock_stream.str();
 
   info.append(tmp_stream.str());
 }
@@ -819,6 +860,23 @@ void InfoCmd::InfoExecCount(std::string& info) {
   info.append(tmp_stream.str());
 }
 
+void InfoCmd::InfoCommandStats(std::string& info) {
+  std::stringstream tmp_stream;
+  tmp_stream << "# Commandstats\r\n";
+
+  std::map<std::string, CmdStatInfo> cmd_stats = g_pika_server->ServerCmdStats();
+  for (const auto& item : cmd_stats) {
+    if (item.second.calls == 0) {
+      continue;
+    }
+    tmp_stream << "cmdstat_" << item.first << ":calls=" << item.second.calls
+      << ",usec=" << item.second.usec << ",usec_per_call="
+      << setiosflags(std::ios::fixed) << std::setprecision(2)
+      << static_cast<double>(item.second.usec) / item.second.calls << "\r\n";
+  }
+  info.append(tmp_stream.str());
+}
+
 void InfoCmd::InfoCPU(std::string& info) {
   struct rusage self_ru, c_ru;
   getrusage(RUSAGE_SELF, &self_ru);
@@ -844,6 +902,36 @@ void InfoCmd::InfoCPU(std::string& info) {
   info.append(tmp_stream.str());
 }
 
+// Lag from binlog produced to acked by slaves, since start or resetstat
+static void AppendReplLagInfo(std::stringstream& tmp_stream) {
+  ReplLagStatistic& lag = g_pika_rm->repl_lag_statistic();
+  tmp_stream << "repl_lag_acked_binlogs:" << lag.Count() << "\r\n";
+  tmp_stream << "repl_lag_p50_us:" << lag.Percentile(50) << "\r\n";
+  tmp_stream << "repl_lag_p99_us:" << lag.Percentile(99) << "\r\n";
+  tmp_stream << "repl_lag_p999_us:" << lag.Percentile(99.9) << "\r\n";
+}
+
+static void AppendBinlogAckInfo(std::stringstream& tmp_stream) {
+  BinlogAckStatistic& ack = g_pika_rm->binlog_ack_statistic();
+  tmp_stream << "binlog_ack_frames_sent:" << ack.frames() << "\r\n";
+  tmp_stream << "binlog_acks_sent:" << ack.acks() << "\r\n";
+  tmp_stream << "binlog_acked_items:" << ack.items() << "\r\n";
+  tmp_stream << "binlog_ack_frames_per_sec:" << ack.frames_per_sec() << "\r\n";
+  tmp_stream << "binlog_acks_per_sec:" << ack.acks_per_sec() << "\r\n";
+  tmp_stream << "binlog_acked_items_per_sec:" << ack.items_per_sec() << "\r\n";
+}
+
+static void AppendBinlogCompressionInfo(std::stringstream& tmp_stream) {
+  BinlogCompressionStatistic& compression = g_pika_rm->binlog_compression_statistic();
+  tmp_stream << "binlog_compression:" << g_pika_conf->replication_compression() << "\r\n";
+  tmp_stream << "binlog_compressed_messages:" << compression.messages() << "\r\n";
+  tmp_stream << "binlog_compression_raw_bytes:" << compression.raw_bytes() << "\r\n";
+  tmp_stream << "binlog_compression_compressed_bytes:" << compression.compressed_bytes() << "\r\n";
+  tmp_stream << "binlog_compression_ratio:" << compression.ratio() << "\r\n";
+  tmp_stream << "binlog_compress_cpu_us:" << compression.compress_us() << "\r\n";
+  tmp_stream << "binlog_uncompress_cpu_us:" << compression.uncompress_us() << "\r\n";
+}
+
 void InfoCmd::InfoShardingReplication(std::string& info) {
   int role = 0;
   std::string slave_list_string;
@@ -886,6 +974,9 @@ void InfoCmd::InfoShardingReplication(std::string& info) {
     case PIKA_ROLE_MASTER :
       tmp_stream << "connected_slaves:" << slave_num << "\r\n" << slave_list_string;
   }
+  AppendReplLagInfo(tmp_stream);
+  AppendBinlogAckInfo(tmp_stream);
+  AppendBinlogCompressionInfo(tmp_stream);
   info.append(tmp_stream.str());
 }
 
@@ -972,6 +1063,9 @@ void InfoCmd::InfoReplication(std::string& info) {
     case PIKA_ROLE_MASTER :
       tmp_stream << "connected_slaves:" << g_pika_server->GetSlaveListString(slaves_list_str) << "\r\n" << slaves_list_str;
   }
+  AppendReplLagInfo(tmp_stream);
+  AppendBinlogAckInfo(tmp_stream);
+  AppendBinlogCompressionInfo(tmp_stream);
 
 
   Status s;
@@ -1201,12 +1295,42 @@ void ConfigCmd::ConfigGet(std::string &ret) {
     EncodeInt32(&config_body, g_pika_conf->thread_pool_size());
   }
 
+  if (slash::stringmatch(pattern.data(), "thread-pool-shards", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "thread-pool-shards");
+    EncodeInt32(&config_body, g_pika_conf->thread_pool_shards());
+  }
+
+  if (slash::stringmatch(pattern.data(), "prior-thread-pool-size", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "prior-thread-pool-size");
+    EncodeInt32(&config_body, g_pika_conf->prior_thread_pool_size());
+  }
+
+  if (slash::stringmatch(pattern.data(), "slow-thread-pool-size", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "slow-thread-pool-size");
+    EncodeInt32(&config_body, g_pika_conf->slow_thread_pool_size());
+  }
+
+  if (slash::stringmatch(pattern.data(), "thread-pool-route-by-partition", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "thread-pool-route-by-partition");
+    EncodeString(&config_body, g_pika_conf->thread_pool_route_by_partition() ? "yes" : "no");
+  }
+
   if (slash::stringmatch(pattern.data(), "sync-thread-num", 1)) {
     elements += 2;
     EncodeString(&config_body, "sync-thread-num");
     EncodeInt32(&config_body, g_pika_conf->sync_thread_num());
   }
 
+  if (slash::stringmatch(pattern.data(), "sync-apply-thread-num", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "sync-apply-thread-num");
+    EncodeInt32(&config_body, g_pika_conf->sync_apply_thread_num());
+  }
+
   if (slash::stringmatch(pattern.data(), "log-path", 1)) {
     elements += 2;
     EncodeString(&config_body, "log-path");
@@ -1443,6 +1567,42 @@ void ConfigCmd::ConfigGet(std::string &ret) {
     EncodeInt32(&config_body, g_pika_conf->binlog_file_size());
   }
 
+  if (slash::stringmatch(pattern.data(), "binlog-group-commit", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "binlog-group-commit");
+    EncodeString(&config_body, g_pika_conf->binlog_group_commit() ? "yes" : "no");
+  }
+
+  if (slash::stringmatch(pattern.data(), "binlog-sync-policy", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "binlog-sync-policy");
+    EncodeString(&config_body, g_pika_conf->binlog_sync_policy_str());
+  }
+
+  if (slash::stringmatch(pattern.data(), "binlog-cache-size", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "binlog-cache-size");
+    EncodeInt64(&config_body, g_pika_conf->binlog_cache_size());
+  }
+
+  if (slash::stringmatch(pattern.data(), "binlog-ack-batch-items", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "binlog-ack-batch-items");
+    EncodeInt32(&config_body, g_pika_conf->binlog_ack_batch_items());
+  }
+
+  if (slash::stringmatch(pattern.data(), "binlog-ack-interval-us", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "binlog-ack-interval-us");
+    EncodeInt32(&config_body, g_pika_conf->binlog_ack_interval_us());
+  }
+
+  if (slash::stringmatch(pattern.data(), "replication-compression", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "replication-compression");
+    EncodeString(&config_body, g_pika_conf->replication_compression());
+  }
+
   if (slash::stringmatch(pattern.data(), "max-cache-statistic-keys", 1)) {
     elements += 2;
     EncodeString(&config_body, "max-cache-statistic-keys");
@@ -1467,6 +1627,12 @@ void ConfigCmd::ConfigGet(std::string &ret) {
     EncodeInt64(&config_body, g_pika_conf->max_client_response_size());
   }
 
+  if (slash::stringmatch(pattern.data(), "inline-exec-queue-threshold", 1)) {
+    elements += 2;
+    EncodeString(&config_body, "inline-exec-queue-threshold");
+    EncodeInt32(&config_body, g_pika_conf->inline_exec_queue_threshold());
+  }
+
   if (slash::stringmatch(pattern.data(), "compression", 1)) {
     elements += 2;
     EncodeString(&config_body, "compression");
@@ -1536,7 +1702,7 @@ void ConfigCmd::ConfigGet(std::string &ret) {
 void ConfigCmd::ConfigSet(std::string& ret) {
   std::string set_item = config_args_v_[1];
   if (set_item == "*") {
-    ret = "*23\r\n";
+    ret = "*31\r\n";
     EncodeString(&ret, "timeout");
     EncodeString(&ret, "requirepass");
     EncodeString(&ret, "masterauth");
@@ -1552,9 +1718,17 @@ void ConfigCmd::ConfigSet(std::string& ret) {
     EncodeString(&ret, "slowlog-log-slower-than");
     EncodeString(&ret, "slowlog-max-len");
     EncodeString(&ret, "write-binlog");
+    EncodeString(&ret, "binlog-group-commit");
+    EncodeString(&ret, "thread-pool-route-by-partition");
+    EncodeString(&ret, "binlog-sync-policy");
+    EncodeString(&ret, "binlog-cache-size");
+    EncodeString(&ret, "binlog-ack-batch-items");
+    EncodeString(&ret, "binlog-ack-interval-us");
+    EncodeString(&ret, "replication-compression");
     EncodeString(&ret, "max-cache-statistic-keys");
     EncodeString(&ret, "small-compaction-threshold");
     EncodeString(&ret, "max-client-response-size");
+    EncodeString(&ret, "inline-exec-queue-threshold");
     EncodeString(&ret, "db-sync-speed");
     EncodeString(&ret, "compact-cron");
     EncodeString(&ret, "compact-interval");
@@ -1679,6 +1853,13 @@ void ConfigCmd::ConfigSet(std::string& ret) {
     }
     g_pika_conf->SetMaxClientResponseSize(ival);
     ret = "+OK\r\n";
+  } else if (set_item == "inline-exec-queue-threshold") {
+    if (!slash::string2l(value.data(), value.size(), &ival) || ival < 0) {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'inline-exec-queue-threshold'\r\n";
+      return;
+    }
+    g_pika_conf->SetInlineExecQueueThreshold(ival);
+    ret = "+OK\r\n";
   } else if (set_item == "write-binlog") {
     int role = g_pika_server->role();
     if (role == PIKA_ROLE_SLAVE) {
@@ -1691,6 +1872,69 @@ void ConfigCmd::ConfigSet(std::string& ret) {
       g_pika_conf->SetWriteBinlog(value);
       ret = "+OK\r\n";
     }
+  } else if (set_item == "thread-pool-route-by-partition") {
+    bool route_by_partition;
+    if (value == "yes") {
+      route_by_partition = true;
+    } else if (value == "no") {
+      route_by_partition = false;
+    } else {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'thread-pool-route-by-partition'\r\n";
+      return;
+    }
+    g_pika_conf->SetThreadPoolRouteByPartition(route_by_partition);
+    ret = "+OK\r\n";
+  } else if (set_item == "binlog-group-commit") {
+    bool group_commit;
+    if (value == "yes") {
+      group_commit = true;
+    } else if (value == "no") {
+      group_commit = false;
+    } else {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'binlog-group-commit'\r\n";
+      return;
+    }
+    g_pika_conf->SetBinlogGroupCommit(group_commit);
+    ret = "+OK\r\n";
+  } else if (set_item == "binlog-cache-size") {
+    if (!slash::string2l(value.data(), value.size(), &ival) || ival < 0) {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'binlog-cache-size'\r\n";
+      return;
+    }
+    g_pika_conf->SetBinlogCacheSize(ival);
+    ret = "+OK\r\n";
+  } else if (set_item == "binlog-ack-batch-items") {
+    if (!slash::string2l(value.data(), value.size(), &ival) || ival < 0) {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'binlog-ack-batch-items'\r\n";
+      return;
+    }
+    g_pika_conf->SetBinlogAckBatchItems(ival);
+    ret = "+OK\r\n";
+  } else if (set_item == "binlog-ack-interval-us") {
+    if (!slash::string2l(value.data(), value.size(), &ival) || ival < 0) {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'binlog-ack-interval-us'\r\n";
+      return;
+    }
+    g_pika_conf->SetBinlogAckIntervalUs(ival);
+    ret = "+OK\r\n";
+  } else if (set_item == "replication-compression") {
+    InnerMessage::CompressionType compression;
+    if (!BinlogCompressionFromString(value, &compression)) {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'replication-compression' (none, lz4 or zstd)\r\n";
+      return;
+    }
+    if (!BinlogCompressionSupported(compression)) {
+      ret = "-ERR Compression \'" + value + "\' is not compiled in\r\n";
+      return;
+    }
+    g_pika_conf->SetReplicationCompression(BinlogCompressionToString(compression));
+    ret = "+OK\r\n";
+  } else if (set_item == "binlog-sync-policy") {
+    if (!g_pika_conf->SetBinlogSyncPolicy(value)) {
+      ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'binlog-sync-policy' (no, everysec or always)\r\n";
+      return;
+    }
+    ret = "+OK\r\n";
   } else if (set_item == "db-sync-speed") {
     if (!slash::string2l(value.data(), value.size(), &ival)) {
       ret = "-ERR Invalid argument \'" + value + "\' for CONFIG SET 'db-sync-speed(MB)'\r\n";
@@ -2016,13 +2260,14 @@ void PaddingCmd::Do(std::shared_ptr<Partition> partition) {
   res_.SetRes(CmdRes::kOk);
 }
 
-std::string PaddingCmd::ToBinlog(
+void PaddingCmd::ToBinlog(
         uint32_t exec_time,
         const std::string& server_id,
         uint64_t logic_id,
         uint32_t filenum,
-        uint64_t offset) {
-  return PikaBinlogTransverter::ConstructPaddingBinlog(
+        uint64_t offset,
+        std::string* binlog) {
+  *binlog = PikaBinlogTransverter::ConstructPaddingBinlog(
           BinlogType::TypeFirst, argv_[1].size() + BINLOG_ITEM_HEADER_SIZE
           + PADDING_BINLOG_PROTOCOL_SIZE + SPACE_STROE_PARAMETER_LENGTH);
 }
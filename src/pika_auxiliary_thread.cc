@@ -17,35 +17,69 @@ PikaAuxiliaryThread::~PikaAuxiliaryThread() {
   LOG(INFO) << "PikaAuxiliary thread " << thread_id() << " exit!!!";
 }
 
+void PikaAuxiliaryThread::Signal() {
+  slash::MutexLock l(&mu_);
+  signaled_ = true;
+  cv_.Signal();
+}
+
+void PikaAuxiliaryThread::WaitSignal(uint32_t timeout) {
+  slash::MutexLock l(&mu_);
+  if (!signaled_) {
+    cv_.TimedWait(timeout);
+  }
+  signaled_ = false;
+}
+
 void* PikaAuxiliaryThread::ThreadMain() {
+  uint64_t last_check_time = 0;
   while (!should_stop()) {
-    if (g_pika_conf->classic_mode()) {
-      if (g_pika_server->ShouldMetaSync()) {
-        g_pika_rm->SendMetaSyncRequest();
-      } else if (g_pika_server->MetaSyncDone()) {
+    // State machine and full scans every 100 ms, binlog produced
+    // and acked in between is handled as soon as signaled
+    uint64_t now = slash::NowMicros();
+    bool periodic = now - last_check_time >= 100 * 1000;
+    Status s;
+    if (periodic) {
+      last_check_time = now;
+      if (g_pika_conf->classic_mode()) {
+        if (g_pika_server->ShouldMetaSync()) {
+          g_pika_rm->SendMetaSyncRequest();
+        } else if (g_pika_server->MetaSyncDone()) {
+          g_pika_rm->RunSyncSlavePartitionStateMachine();
+        }
+      } else {
         g_pika_rm->RunSyncSlavePartitionStateMachine();
       }
-    } else {
-      g_pika_rm->RunSyncSlavePartitionStateMachine();
-    }
 
-    Status s = g_pika_rm->CheckSyncTimeout(slash::NowMicros());
-    if (!s.ok()) {
-      LOG(WARNING) << s.ToString();
+      s = g_pika_rm->CheckSyncTimeout(now);
+      if (!s.ok()) {
+        LOG(WARNING) << s.ToString();
+      }
+      g_pika_rm->binlog_ack_statistic().Refresh(now);
     }
 
-    // TODO(whoiami) timeout
-    s = g_pika_server->TriggerSendBinlogSync();
+    // Coalesced binlog acks to master
+    uint64_t ack_wait_us = g_pika_rm->CheckBinlogSyncAcks(now);
+
+    s = g_pika_rm->WakeUpProducedBinlogSync();
     if (!s.ok()) {
       LOG(WARNING) << s.ToString();
     }
+    if (periodic) {
+      s = g_pika_server->TriggerSendBinlogSync();
+      if (!s.ok()) {
+        LOG(WARNING) << s.ToString();
+      }
+    }
+
     // send to peer
     int res = g_pika_server->SendToPeer();
     if (!res) {
-      // sleep 100 ms
-      mu_.Lock();
-      cv_.TimedWait(100);
-      mu_.Unlock();
+      uint32_t timeout = 100;
+      if (ack_wait_us != 0 && ack_wait_us < timeout * 1000) {
+        timeout = (ack_wait_us + 999) / 1000;
+      }
+      WaitSignal(timeout);
     } else {
       //LOG_EVERY_N(INFO, 1000) << "Consume binlog number " << res;
     }
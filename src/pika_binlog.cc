@@ -5,11 +5,17 @@
 
 #include "include/pika_binlog.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <glog/logging.h>
 
+#include "include/pika_conf.h"
 #include "include/pika_binlog_transverter.h"
 
+extern PikaConf* g_pika_conf;
+
 using slash::RWLock;
 
 std::string NewFileName(const std::string name, const uint32_t current) {
@@ -47,6 +53,14 @@ Status Version::StableSave() {
   return Status::OK();
 }
 
+Status Version::Sync() {
+  // The manifest is mmaped, base address is page aligned
+  if (msync(save_->GetData(), kEncodedSize, MS_SYNC) != 0) {
+    return Status::IOError("msync manifest failed", strerror(errno));
+  }
+  return Status::OK();
+}
+
 Status Version::Init() {
   Status s;
   if (save_->GetData() != NULL) {
@@ -68,10 +82,12 @@ Binlog::Binlog(const std::string& binlog_path, const int file_size) :
     queue_(NULL),
     versionfile_(NULL),
     pro_num_(0),
+    unsynced_(false),
     pool_(NULL),
     exit_all_consume_(false),
     binlog_path_(binlog_path),
-    file_size_(file_size) {
+    file_size_(file_size),
+    cache_(std::make_shared<BinlogCache>()) {
 
   // To intergrate with old version, we don't set mmap file size to 100M;
   //slash::SetMmapBoundSize(file_size);
@@ -129,6 +145,7 @@ Binlog::Binlog(const std::string& binlog_path, const int file_size) :
   }
 
   InitLogFile();
+  cache_->Reset(BinlogOffset(pro_num_, version_->pro_offset_));
 }
 
 Binlog::~Binlog() {
@@ -158,45 +175,288 @@ Status Binlog::GetProducerStatus(uint32_t* filenum, uint64_t* pro_offset, uint64
 }
 
 // Note: mutex lock should be held
-Status Binlog::Put(const std::string &item) {
-  return Put(item.c_str(), item.size());
+Status Binlog::Put(const Slice &item) {
+  return Put(item.data(), item.size());
 }
 
 // Note: mutex lock should be held
 Status Binlog::Put(const char* item, int len) {
+  Status s = AppendItem(Slice(item, len));
+  if (s.ok()) {
+    s = FlushAndSave();
+  }
+  return s;
+}
+
+// Note: mutex lock should be held
+Status Binlog::BatchPut(const std::vector<Slice>& items) {
   Status s;
+  for (const auto& item : items) {
+    s = AppendItem(item);
+    if (!s.ok()) {
+      break;
+    }
+  }
+  Status fs = FlushAndSave();
+  return s.ok() ? fs : s;
+}
 
-  /* Check to roll log file */
-  uint64_t filesize = queue_->Filesize();
-  if (filesize > file_size_) {
-    delete queue_;
-    queue_ = NULL;
+/*
+ * Group commit
+ */
+struct Binlog::Writer {
+  explicit Writer(slash::Mutex* mu)
+    : item(NULL),
+      done(false),
+      filenum(0),
+      offset(0),
+      cv(mu) {}
+
+  std::string* item;
+  Status status;
+  bool done;
+  uint32_t filenum;
+  uint64_t offset;
+  slash::CondVar cv;
+};
+
+Status Binlog::GroupPut(std::string* item, uint32_t* filenum, uint64_t* offset) {
+  Writer w(&writers_mu_);
+  w.item = item;
+
+  writers_mu_.Lock();
+  writers_.push_back(&w);
+  while (!w.done && &w != writers_.front()) {
+    w.cv.Wait();
+  }
 
-    pro_num_++;
-    std::string profile = NewFileName(filename, pro_num_);
-    slash::NewWritableFile(profile, &queue_);
+  if (!w.done) {
+    // We are the leader, take the pending writers as a group
+    size_t group_size = 0;
+    std::vector<Writer*> group;
+    for (const auto& writer : writers_) {
+      if (!group.empty()
+        && group_size + writer->item->size() > kBinlogGroupMaxSize) {
+        break;
+      }
+      group_size += writer->item->size();
+      group.push_back(writer);
+    }
 
+    // Let other writers enqueue while we are doing io
+    writers_mu_.Unlock();
     {
-      slash::RWLock(&(version_->rwlock_), true);
-      version_->pro_offset_ = 0;
-      version_->pro_num_ = pro_num_;
-      version_->StableSave();
+      slash::MutexLock l(&mutex_);
+      WriteGroup(group);
+    }
+    writers_mu_.Lock();
+
+    for (size_t idx = 0; idx < group.size(); ++idx) {
+      Writer* ready = writers_.front();
+      writers_.pop_front();
+      ready->done = true;
+      if (ready != &w) {
+        ready->cv.Signal();
+      }
+    }
+    // Notify the new head of queue
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+  }
+  writers_mu_.Unlock();
+
+  if (filenum != NULL) {
+    *filenum = w.filenum;
+  }
+  if (offset != NULL) {
+    *offset = w.offset;
+  }
+  return w.status;
+}
+
+// Note: mutex lock should be held
+void Binlog::WriteGroup(const std::vector<Writer*>& group) {
+  Status s;
+  size_t written = 0;
+  for (const auto& writer : group) {
+    std::string* item = writer->item;
+    // Roll first, so the item records its real position
+    if (queue_ == NULL) {
+      s = Status::IOError("binlog file not opened");
+      break;
+    }
+    if (queue_->Filesize() > file_size_) {
+      s = RollFile();
+      if (!s.ok()) {
+        break;
+      }
+    }
+
+    uint64_t logic_id = 0;
+    GetProducerStatus(&writer->filenum, &writer->offset, &logic_id);
+    PikaBinlogTransverter::BinlogItemPositionUpdate(logic_id,
+                                                    writer->filenum,
+                                                    writer->offset,
+                                                    item);
+    s = AppendItem(Slice(item->data(), item->size()));
+    if (!s.ok()) {
+      break;
+    }
+    written++;
+  }
+
+  // One flush and one manifest save for the whole group
+  Status fs = FlushAndSave();
+  if (s.ok()) {
+    s = fs;
+  }
+  for (size_t idx = 0; idx < group.size(); ++idx) {
+    group[idx]->status = (idx < written) ? fs : s;
+  }
+}
+
+// Note: mutex lock should be held
+Status Binlog::AppendItem(const Slice& item) {
+  Status s;
+  if (queue_ == NULL) {
+    return Status::IOError("binlog file not opened");
+  }
+
+  /* Check to roll log file */
+  if (queue_->Filesize() > file_size_) {
+    s = RollFile();
+    if (!s.ok()) {
+      return s;
     }
-    InitLogFile();
   }
 
   int pro_offset;
-  s = Produce(Slice(item, len), &pro_offset);
+  s = Produce(item, &pro_offset);
   if (s.ok()) {
-    slash::RWLock(&(version_->rwlock_), true);
-    version_->pro_offset_ = pro_offset;
-    version_->logic_id_++;
+    {
+      slash::RWLock l(&(version_->rwlock_), true);
+      version_->pro_offset_ = pro_offset;
+      version_->logic_id_++;
+    }
+    // Cached by FlushAndSave once it is written out
+    uncached_.push_back(BinlogCacheItem(BinlogOffset(pro_num_, pro_offset),
+                                        item, slash::NowMicros()));
+  }
+  return s;
+}
+
+// Note: mutex lock should be held
+Status Binlog::RollFile() {
+  // Open the new file first, on failure the old one is kept as it is
+  std::string profile = NewFileName(filename, pro_num_ + 1);
+  slash::WritableFile* queue = NULL;
+  Status s = slash::NewWritableFile(profile, &queue);
+  if (!s.ok()) {
+    return s;
+  }
+
+  // Rest of the old file will not be synced by anyone else
+  if (unsynced_ && g_pika_conf->binlog_sync_policy() != kBinlogSyncNo) {
+    queue_->Sync();
+  }
+  delete queue_;
+  queue_ = queue;
+  pro_num_++;
+
+  {
+    slash::RWLock l(&(version_->rwlock_), true);
+    version_->pro_offset_ = 0;
+    version_->pro_num_ = pro_num_;
     version_->StableSave();
   }
+  InitLogFile();
+  return s;
+}
 
+// Note: mutex lock should be held
+Status Binlog::FlushAndSave() {
+  Status s;
+  if (queue_ == NULL) {
+    s = Status::IOError("binlog file not opened");
+  } else {
+    s = queue_->Flush();
+    {
+      slash::RWLock l(&(version_->rwlock_), true);
+      version_->StableSave();
+    }
+    unsynced_ = true;
+
+    if (s.ok() && g_pika_conf->binlog_sync_policy() == kBinlogSyncAlways) {
+      s = SyncInternal();
+    }
+  }
+
+  // Slaves are only fed items that were written, after a failure
+  // the ones behind it read the file
+  if (s.ok()) {
+    for (const auto& cache_item : uncached_) {
+      cache_->Push(cache_item.item, cache_item.end_offset,
+                   g_pika_conf->binlog_cache_size(), cache_item.produce_time);
+    }
+  } else {
+    slash::RWLock l(&(version_->rwlock_), false);
+    cache_->Reset(BinlogOffset(version_->pro_num_, version_->pro_offset_));
+  }
+  uncached_.clear();
   return s;
 }
- 
+
+Status Binlog::Sync() {
+  std::string profile;
+  {
+    slash::MutexLock l(&mutex_);
+    if (!unsynced_ || queue_ == NULL) {
+      return Status::OK();
+    }
+    // Writes after this point set it again
+    unsynced_ = false;
+    profile = NewFileName(filename, pro_num_);
+  }
+
+  // Writers go on meanwhile, the file is synced through its own fd since
+  // queue_ may be rolled, RollFile leaves the old file to us
+  Status s;
+  int fd = open(profile.c_str(), O_RDONLY);
+  if (fd < 0) {
+    s = Status::IOError("open binlog " + profile + " failed", strerror(errno));
+  } else {
+    if (fdatasync(fd) != 0) {
+      s = Status::IOError("fdatasync binlog " + profile + " failed", strerror(errno));
+    }
+    close(fd);
+  }
+  if (s.ok()) {
+    s = version_->Sync();
+  }
+  if (!s.ok()) {
+    slash::MutexLock l(&mutex_);
+    unsynced_ = true;
+  }
+  return s;
+}
+
+// Note: mutex lock should be held
+Status Binlog::SyncInternal() {
+  if (!unsynced_ || queue_ == NULL) {
+    return Status::OK();
+  }
+  Status s = queue_->Sync();
+  if (s.ok()) {
+    slash::RWLock l(&(version_->rwlock_), false);
+    s = version_->Sync();
+  }
+  if (s.ok()) {
+    unsynced_ = false;
+  }
+  return s;
+}
+
 Status Binlog::EmitPhysicalRecord(RecordType t, const char *ptr, size_t n, int *temp_pro_offset) {
     Status s;
     assert(n <= 0xffffff);
@@ -220,9 +480,6 @@ Status Binlog::EmitPhysicalRecord(RecordType t, const char *ptr, size_t n, int *
     s = queue_->Append(Slice(buf, kHeaderSize));
     if (s.ok()) {
         s = queue_->Append(Slice(ptr, n));
-        if (s.ok()) {
-            s = queue_->Flush();
-        }
     }
     block_offset_ += static_cast<int>(kHeaderSize + n);
 
@@ -340,7 +597,12 @@ Status Binlog::SetProducerStatus(uint32_t pro_num, uint64_t pro_offset) {
     slash::DeleteFile(profile);
   }
 
-  slash::NewWritableFile(profile, &queue_);
+  queue_ = NULL;
+  uncached_.clear();
+  Status s = slash::NewWritableFile(profile, &queue_);
+  if (!s.ok()) {
+    return s;
+  }
   Binlog::AppendPadding(queue_, &pro_offset);
 
   pro_num_ = pro_num;
@@ -353,5 +615,6 @@ Status Binlog::SetProducerStatus(uint32_t pro_num, uint64_t pro_offset) {
   }
 
   InitLogFile();
+  cache_->Reset(BinlogOffset(pro_num, pro_offset));
   return Status::OK();
 }
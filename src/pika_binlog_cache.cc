@@ -0,0 +1,93 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#include "include/pika_binlog_cache.h"
+
+#include <algorithm>
+
+#include "slash/include/env.h"
+
+static bool OffsetLess(const BinlogOffset& a, const BinlogOffset& b) {
+  return a.filenum < b.filenum
+    || (a.filenum == b.filenum && a.offset < b.offset);
+}
+
+BinlogCache::BinlogCache()
+    : bytes_(0) {
+  pthread_rwlock_init(&rwlock_, NULL);
+}
+
+BinlogCache::~BinlogCache() {
+  pthread_rwlock_destroy(&rwlock_);
+}
+
+void BinlogCache::Reset(const BinlogOffset& offset) {
+  slash::RWLock l(&rwlock_, true);
+  items_.clear();
+  bytes_ = 0;
+  begin_offset_ = offset;
+}
+
+void BinlogCache::Push(const Slice& item, const BinlogOffset& end_offset,
+                       uint64_t capacity, uint64_t produce_time) {
+  if (produce_time == 0) {
+    produce_time = slash::NowMicros();
+  }
+  slash::RWLock l(&rwlock_, true);
+  if (item.size() > capacity) {
+    // Never cached, slaves behind it have to read the file
+    items_.clear();
+    bytes_ = 0;
+    begin_offset_ = end_offset;
+    return;
+  }
+  while (!items_.empty() && bytes_ + item.size() > capacity) {
+    bytes_ -= items_.front().item.size();
+    begin_offset_ = items_.front().end_offset;
+    items_.pop_front();
+  }
+  items_.push_back(BinlogCacheItem(end_offset, item, produce_time));
+  bytes_ += item.size();
+}
+
+bool BinlogCache::Locate(const BinlogOffset& offset, size_t* index) {
+  if (offset == begin_offset_) {
+    *index = 0;
+    return true;
+  }
+  auto iter = std::lower_bound(items_.begin(), items_.end(), offset,
+      [](const BinlogCacheItem& item, const BinlogOffset& target) {
+        return OffsetLess(item.end_offset, target);
+      });
+  if (iter == items_.end() || !(iter->end_offset == offset)) {
+    return false;
+  }
+  *index = iter - items_.begin() + 1;
+  return true;
+}
+
+bool BinlogCache::Contains(const BinlogOffset& offset) {
+  slash::RWLock l(&rwlock_, false);
+  size_t index;
+  return Locate(offset, &index);
+}
+
+Status BinlogCache::Read(const BinlogOffset& offset, int count,
+                         std::vector<BinlogCacheItem>* items) {
+  slash::RWLock l(&rwlock_, false);
+  size_t index;
+  if (!Locate(offset, &index)) {
+    return Status::NotFound(offset.ToString() + " not in binlog cache");
+  }
+  for (; index < items_.size() && count > 0; ++index, --count) {
+    items->push_back(items_[index]);
+  }
+  return Status::OK();
+}
+
+uint64_t BinlogCache::Size() {
+  slash::RWLock l(&rwlock_, false);
+  return bytes_;
+}
@@ -0,0 +1,173 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#include "include/pika_binlog_compression.h"
+
+#include <time.h>
+#include <strings.h>
+
+#ifdef LZ4
+#include <lz4.h>
+#endif
+#ifdef ZSTD
+#include <zstd.h>
+#endif
+
+bool BinlogCompressionFromString(const std::string& name,
+                                 InnerMessage::CompressionType* type) {
+  if (!strcasecmp(name.data(), "none")) {
+    *type = InnerMessage::kNoCompression;
+  } else if (!strcasecmp(name.data(), "lz4")) {
+    *type = InnerMessage::kLZ4Compression;
+  } else if (!strcasecmp(name.data(), "zstd")) {
+    *type = InnerMessage::kZstdCompression;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string BinlogCompressionToString(InnerMessage::CompressionType type) {
+  switch (type) {
+    case InnerMessage::kLZ4Compression:
+      return "lz4";
+    case InnerMessage::kZstdCompression:
+      return "zstd";
+    default:
+      return "none";
+  }
+}
+
+bool BinlogCompressionSupported(InnerMessage::CompressionType type) {
+  switch (type) {
+    case InnerMessage::kNoCompression:
+      return true;
+#ifdef LZ4
+    case InnerMessage::kLZ4Compression:
+      return true;
+#endif
+#ifdef ZSTD
+    case InnerMessage::kZstdCompression:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+Status BinlogCompress(InnerMessage::CompressionType type,
+                      const std::string& input, std::string* output) {
+  switch (type) {
+#ifdef LZ4
+    case InnerMessage::kLZ4Compression:
+    {
+      output->resize(LZ4_compressBound(static_cast<int>(input.size())));
+      int len = LZ4_compress_default(input.data(), &(*output)[0],
+                                     static_cast<int>(input.size()),
+                                     static_cast<int>(output->size()));
+      if (len <= 0) {
+        return Status::Corruption("lz4 compress failed");
+      }
+      output->resize(len);
+      return Status::OK();
+    }
+#endif
+#ifdef ZSTD
+    case InnerMessage::kZstdCompression:
+    {
+      output->resize(ZSTD_compressBound(input.size()));
+      // Level 1, binlog is compressed on the fly
+      size_t len = ZSTD_compress(&(*output)[0], output->size(),
+                                 input.data(), input.size(), 1);
+      if (ZSTD_isError(len)) {
+        return Status::Corruption(std::string("zstd compress failed, ")
+                                  + ZSTD_getErrorName(len));
+      }
+      output->resize(len);
+      return Status::OK();
+    }
+#endif
+    default:
+      return Status::NotSupported("compression "
+                                  + BinlogCompressionToString(type) + " not supported");
+  }
+}
+
+Status BinlogUncompress(InnerMessage::CompressionType type,
+                        const std::string& input, size_t raw_size,
+                        std::string* output) {
+  output->resize(raw_size);
+  switch (type) {
+#ifdef LZ4
+    case InnerMessage::kLZ4Compression:
+    {
+      int len = LZ4_decompress_safe(input.data(), &(*output)[0],
+                                    static_cast<int>(input.size()),
+                                    static_cast<int>(raw_size));
+      if (len < 0 || static_cast<size_t>(len) != raw_size) {
+        return Status::Corruption("lz4 uncompress failed");
+      }
+      return Status::OK();
+    }
+#endif
+#ifdef ZSTD
+    case InnerMessage::kZstdCompression:
+    {
+      size_t len = ZSTD_decompress(&(*output)[0], raw_size,
+                                   input.data(), input.size());
+      if (ZSTD_isError(len) || len != raw_size) {
+        return Status::Corruption("zstd uncompress failed");
+      }
+      return Status::OK();
+    }
+#endif
+    default:
+      return Status::NotSupported("compression "
+                                  + BinlogCompressionToString(type) + " not supported");
+  }
+}
+
+/* BinlogCompressionStatistic */
+
+BinlogCompressionStatistic::BinlogCompressionStatistic() {
+  Reset();
+}
+
+void BinlogCompressionStatistic::AddCompress(uint64_t raw_bytes,
+                                             uint64_t compressed_bytes,
+                                             uint64_t cpu_us) {
+  messages_.fetch_add(1, std::memory_order_relaxed);
+  raw_bytes_.fetch_add(raw_bytes, std::memory_order_relaxed);
+  compressed_bytes_.fetch_add(compressed_bytes, std::memory_order_relaxed);
+  compress_us_.fetch_add(cpu_us, std::memory_order_relaxed);
+}
+
+void BinlogCompressionStatistic::AddUncompress(uint64_t cpu_us) {
+  uncompress_us_.fetch_add(cpu_us, std::memory_order_relaxed);
+}
+
+void BinlogCompressionStatistic::Reset() {
+  messages_.store(0);
+  raw_bytes_.store(0);
+  compressed_bytes_.store(0);
+  compress_us_.store(0);
+  uncompress_us_.store(0);
+}
+
+double BinlogCompressionStatistic::ratio() {
+  uint64_t compressed = compressed_bytes_.load();
+  if (compressed == 0) {
+    return 0;
+  }
+  return static_cast<double>(raw_bytes_.load()) / compressed;
+}
+
+uint64_t ThreadCpuMicros() {
+  struct timespec ts;
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
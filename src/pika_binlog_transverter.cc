@@ -87,18 +87,44 @@ std::string PikaBinlogTransverter::BinlogEncode(BinlogType type,
                                                 const std::string& content,
                                                 const std::vector<std::string>& extends) {
   std::string binlog;
-  slash::PutFixed16(&binlog, type);
-  slash::PutFixed32(&binlog, exec_time);
-  slash::PutFixed32(&binlog, server_id);
-  slash::PutFixed64(&binlog, logic_id);
-  slash::PutFixed32(&binlog, filenum);
-  slash::PutFixed64(&binlog, offset);
-  uint32_t content_length = content.size();
-  slash::PutFixed32(&binlog, content_length);
-  binlog.append(content);
+  BinlogEncode(type, exec_time, server_id, logic_id,
+               filenum, offset, content, extends, &binlog);
   return binlog;
 }
 
+void PikaBinlogTransverter::BinlogEncode(BinlogType type,
+                                         uint32_t exec_time,
+                                         uint32_t server_id,
+                                         uint64_t logic_id,
+                                         uint32_t filenum,
+                                         uint64_t offset,
+                                         const std::string& content,
+                                         const std::vector<std::string>& extends,
+                                         std::string* binlog) {
+  binlog->clear();
+  binlog->reserve(BINLOG_ITEM_HEADER_SIZE + content.size());
+  BinlogHeaderEncode(type, exec_time, server_id, logic_id,
+                     filenum, offset, content.size(), binlog);
+  binlog->append(content);
+}
+
+void PikaBinlogTransverter::BinlogHeaderEncode(BinlogType type,
+                                               uint32_t exec_time,
+                                               uint32_t server_id,
+                                               uint64_t logic_id,
+                                               uint32_t filenum,
+                                               uint64_t offset,
+                                               uint32_t content_length,
+                                               std::string* binlog) {
+  slash::PutFixed16(binlog, type);
+  slash::PutFixed32(binlog, exec_time);
+  slash::PutFixed32(binlog, server_id);
+  slash::PutFixed64(binlog, logic_id);
+  slash::PutFixed32(binlog, filenum);
+  slash::PutFixed64(binlog, offset);
+  slash::PutFixed32(binlog, content_length);
+}
+
 bool PikaBinlogTransverter::BinlogDecode(BinlogType type,
                                          const std::string& binlog,
                                          BinlogItem* binlog_item) {
@@ -184,17 +210,36 @@ std::string PikaBinlogTransverter::ConstructPaddingBinlog(BinlogType type,
 bool PikaBinlogTransverter::BinlogItemWithoutContentDecode(BinlogType type,
                                          const std::string& binlog,
                                          BinlogItem* binlog_item) {
-  uint16_t binlog_type = 0;
-  std::string binlog_str = binlog;
-  slash::GetFixed16(&binlog_str, &binlog_type);
+  if (binlog.size() < BINLOG_ENCODE_LEN) {
+    LOG(ERROR) << "Binlog Item size error, actualy size: " << binlog.size();
+    return false;
+  }
+  // Decode the header in place, the content may be large
+  const char* p = binlog.data();
+  uint16_t binlog_type = slash::DecodeFixed16(p);
   if (binlog_type != type) {
     LOG(ERROR) << "Binlog Item type error, expect type:" << type << " actualy type: " << binlog_type;
     return false;
   }
-  slash::GetFixed32(&binlog_str, &binlog_item->exec_time_);
-  slash::GetFixed32(&binlog_str, &binlog_item->server_id_);
-  slash::GetFixed64(&binlog_str, &binlog_item->logic_id_);
-  slash::GetFixed32(&binlog_str, &binlog_item->filenum_);
-  slash::GetFixed64(&binlog_str, &binlog_item->offset_);
+  binlog_item->exec_time_ = slash::DecodeFixed32(p + 2);
+  binlog_item->server_id_ = slash::DecodeFixed32(p + 6);
+  binlog_item->logic_id_ = slash::DecodeFixed64(p + 10);
+  binlog_item->filenum_ = slash::DecodeFixed32(p + 18);
+  binlog_item->offset_ = slash::DecodeFixed64(p + 22);
+  return true;
+}
+
+bool PikaBinlogTransverter::BinlogItemPositionUpdate(uint64_t logic_id,
+                                                     uint32_t filenum,
+                                                     uint64_t offset,
+                                                     std::string* binlog) {
+  if (binlog->size() < BINLOG_ENCODE_LEN) {
+    return false;
+  }
+  // Skip <Type>, <Create Time> and <Server Id>
+  char* dst = &(*binlog)[10];
+  slash::EncodeFixed64(dst, logic_id);
+  slash::EncodeFixed32(dst + 8, filenum);
+  slash::EncodeFixed64(dst + 12, offset);
   return true;
 }
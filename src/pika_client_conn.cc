@@ -7,6 +7,11 @@
 
 #include <vector>
 #include <algorithm>
+#include <functional>
+#include <errno.h>
+#include <strings.h>
+#include <poll.h>
+#include <sys/uio.h>
 
 #include <glog/logging.h>
 
@@ -26,17 +31,28 @@ PikaClientConn::PikaClientConn(int fd, std::string ip_port,
       : RedisConn(fd, ip_port, thread, pink_epoll, handle_type, max_conn_rbuf_size),
         server_thread_(reinterpret_cast<pink::ServerThread*>(thread)),
         current_table_(g_pika_conf->default_table()),
-        is_pubsub_(false) {
+        is_pubsub_(false),
+        shard_(g_pika_server->NextThreadPoolShard()),
+        reply_pos_(0),
+        reply_offset_(0),
+        streamed_(false),
+        stream_broken_(false),
+        stream_deadline_us_(0) {
   auth_stat_.Init();
 }
 
-std::string PikaClientConn::DoCmd(const PikaCmdArgsType& argv,
-                                  const std::string& opt) {
+std::string PikaClientConn::DoCmd(const PikaCmdArgsType& argv, int cmd_id) {
   // Get command info
-  std::shared_ptr<Cmd> c_ptr = g_pika_cmd_table_manager->GetCmd(opt);
+  std::shared_ptr<Cmd> c_ptr = g_pika_cmd_table_manager->GetCmd(cmd_id);
   if (!c_ptr) {
-      return "-Err unknown or unsupported command \'" + opt + "\'\r\n";
+    std::string unknown = argv[0];
+    if (argv.size() >= 2 && !strcasecmp(unknown.data(), kClusterPrefix.data())) {
+      unknown += argv[1];
+    }
+    slash::StringToLower(unknown);
+    return "-Err unknown or unsupported command \'" + unknown + "\'\r\n";
   }
+  const std::string& opt = g_pika_cmd_table_manager->GetCmdName(cmd_id);
   c_ptr->SetConn(std::dynamic_pointer_cast<PikaClientConn>(shared_from_this()));
 
   // Check authed
@@ -45,10 +61,7 @@ std::string PikaClientConn::DoCmd(const PikaCmdArgsType& argv,
     return "-ERR NOAUTH Authentication required.\r\n";
   }
 
-  uint64_t start_us = 0;
-  if (g_pika_conf->slowlog_slower_than() >= 0) {
-    start_us = slash::NowMicros();
-  }
+  uint64_t start_us = slash::NowMicros();
 
   bool is_monitoring = g_pika_server->HasMonitorClients();
   if (is_monitoring) {
@@ -58,10 +71,10 @@ std::string PikaClientConn::DoCmd(const PikaCmdArgsType& argv,
   // Initial
   c_ptr->Initial(argv, current_table_);
   if (!c_ptr->res().ok()) {
-    return c_ptr->res().message();
+    return c_ptr->res().TakeMessage();
   }
 
-  g_pika_server->UpdateQueryNumAndExecCountTable(opt);
+  g_pika_server->UpdateQueryNumAndExecCountTable(cmd_id);
  
   // PubSub connection
   // (P)SubscribeCmd will set is_pubsub_
@@ -88,7 +101,7 @@ std::string PikaClientConn::DoCmd(const PikaCmdArgsType& argv,
     if (g_pika_server->IsTableBinlogIoError(current_table_)) {
       return "-ERR Writing binlog failed, maybe no space left on device\r\n";
     }
-    std::vector<std::string> cur_key = c_ptr->current_key();
+    const std::vector<std::string>& cur_key = c_ptr->keys();
     if (cur_key.empty()) {
       return "-ERR Internal ERROR\r\n";
     }
@@ -99,12 +112,13 @@ std::string PikaClientConn::DoCmd(const PikaCmdArgsType& argv,
 
   // Process Command
   c_ptr->Execute();
+  g_pika_server->UpdateCmdLatency(cmd_id, slash::NowMicros() - start_us);
 
   if (g_pika_conf->slowlog_slower_than() >= 0) {
     ProcessSlowlog(argv, start_us);
   }
 
-  return c_ptr->res().message();
+  return c_ptr->res().TakeMessage();
 }
 
 void PikaClientConn::ProcessSlowlog(const PikaCmdArgsType& argv, uint64_t start_us) {
@@ -149,44 +163,187 @@ void PikaClientConn::ProcessMonitor(const PikaCmdArgsType& argv) {
 }
 
 void PikaClientConn::AsynProcessRedisCmds(const std::vector<pink::RedisCmdArgsType>& argvs, std::string* response) {
+  size_t shard = shard_;
+  if (g_pika_conf->thread_pool_route_by_partition()
+    && g_pika_server->ThreadPoolShards() > 1
+    && !argvs.empty() && argvs[0].size() >= 2) {
+    // The next batch is not read before this one is replied,
+    // so commands of the connection are still executed in order
+    shard = PartitionShard(argvs[0]);
+  }
+  ExecMode mode = BatchExecMode(argvs, shard);
+  if (mode == kExecInline) {
+    uint64_t start_us = slash::NowMicros();
+    BatchExecRedisCmd(argvs, response);
+    g_pika_server->UpdateExecModeLatency(kExecInline, slash::NowMicros() - start_us);
+    return;
+  }
   BgTaskArg* arg = new BgTaskArg();
   arg->redis_cmds = argvs;
   arg->response = response;
   arg->pcc = std::dynamic_pointer_cast<PikaClientConn>(shared_from_this());
-  g_pika_server->Schedule(&DoBackgroundTask, arg);
+  arg->schedule_us = slash::NowMicros();
+  arg->mode = mode;
+  g_pika_server->Schedule(&DoBackgroundTask, arg, shard, mode);
+}
+
+ExecMode PikaClientConn::BatchExecMode(const std::vector<pink::RedisCmdArgsType>& argvs, size_t shard) {
+  bool all_fast = !argvs.empty();
+  bool all_prior = !argvs.empty();
+  bool any_slow = false;
+  for (const auto& argv : argvs) {
+    int cmd_id = g_pika_cmd_table_manager->GetCmdId(argv);
+    all_fast = all_fast && g_pika_cmd_table_manager->IsFastCmd(cmd_id);
+    all_prior = all_prior && g_pika_cmd_table_manager->IsPriorCmd(cmd_id);
+    any_slow = any_slow || g_pika_cmd_table_manager->IsSlowCmd(cmd_id);
+  }
+  // One slow command holds up the whole batch, so it goes to the slow lane
+  if (any_slow) {
+    return g_pika_server->HasThreadPool(kExecSlowPool) ? kExecSlowPool : kExecPool;
+  }
+  if (all_prior) {
+    return g_pika_server->HasThreadPool(kExecPriorPool) ? kExecPriorPool : kExecPool;
+  }
+  int threshold = g_pika_conf->inline_exec_queue_threshold();
+  if (all_fast && threshold > 0 && argvs.size() <= kInlineExecMaxCmds
+    // Only while the pool keeps up, a busy network thread stalls all its connections
+    && g_pika_server->ThreadPoolQueueSize(shard) < static_cast<size_t>(threshold)) {
+    return kExecInline;
+  }
+  return kExecPool;
+}
+
+size_t PikaClientConn::PartitionShard(const pink::RedisCmdArgsType& argv) {
+  size_t shard = std::hash<std::string>()(current_table_);
+  if (!g_pika_conf->classic_mode()) {
+    std::shared_ptr<Table> table = g_pika_server->GetTable(current_table_);
+    if (table) {
+      shard += table->PartitionIdOfKey(argv[1]);
+    }
+  }
+  return shard % g_pika_server->ThreadPoolShards();
 }
 
 void PikaClientConn::BatchExecRedisCmd(const std::vector<pink::RedisCmdArgsType>& argvs, std::string* response) {
   bool success = true;
+  streamed_ = false;
+  stream_broken_ = false;
+  stream_deadline_us_ = 0;
   for (const auto& argv : argvs) {
-    if (DealMessage(argv, response) != 0) {
+    if (argv.empty()) {
       success = false;
       break;
     }
+    std::string reply = DoCmd(argv, g_pika_cmd_table_manager->GetCmdId(argv));
+    if (!reply.empty()) {
+      replies_.push_back(std::move(reply));
+    }
   }
-  if (!response->empty()) {
+  // A streamed reply may leave nothing queued, the connection
+  // is still handed back to the network thread to read again
+  if (!replies_.empty() || !response->empty() || streamed_) {
     set_is_reply(true);
-    NotifyEpoll(success);
+    NotifyEpoll(success && !stream_broken_);
   }
 }
 
-int PikaClientConn::DealMessage(const PikaCmdArgsType& argv, std::string* response) {
+pink::WriteStatus PikaClientConn::SendReply() {
+  while (reply_pos_ < replies_.size()) {
+    struct iovec iov[kReplyIovecNum];
+    int iovcnt = 0;
+    for (size_t i = reply_pos_; i < replies_.size() && iovcnt < kReplyIovecNum; ++i) {
+      size_t offset = (i == reply_pos_) ? reply_offset_ : 0;
+      iov[iovcnt].iov_base = const_cast<char*>(replies_[i].data()) + offset;
+      iov[iovcnt].iov_len = replies_[i].size() - offset;
+      ++iovcnt;
+    }
+    ssize_t nwritten = writev(fd(), iov, iovcnt);
+    if (nwritten < 0) {
+      if (errno == EAGAIN || errno == EINTR) {
+        return pink::kWriteHalf;
+      }
+      return pink::kWriteError;
+    }
+    size_t left = static_cast<size_t>(nwritten);
+    while (left > 0) {
+      size_t remain = replies_[reply_pos_].size() - reply_offset_;
+      if (left < remain) {
+        reply_offset_ += left;
+        break;
+      }
+      left -= remain;
+      reply_offset_ = 0;
+      ++reply_pos_;
+    }
+  }
+  replies_.clear();
+  reply_pos_ = 0;
+  reply_offset_ = 0;
+  return RedisConn::SendReply();
+}
 
-  if (argv.empty()) return -2;
-  std::string opt = argv[0];
-  if (opt == kClusterPrefix) {
-    if (argv.size() >=2 ) {
-      opt += argv[1];
+bool PikaClientConn::StreamReply(const std::string& data) {
+  streamed_ = true;
+  if (stream_deadline_us_ == 0) {
+    stream_deadline_us_ = slash::NowMicros() + kReplyStreamTimeoutMs * 1000ULL;
+  }
+  for (; reply_pos_ < replies_.size(); ++reply_pos_) {
+    const std::string& reply = replies_[reply_pos_];
+    if (!WriteAll(reply.data() + reply_offset_, reply.size() - reply_offset_)) {
+      stream_broken_ = true;
+      return false;
+    }
+    reply_offset_ = 0;
+  }
+  replies_.clear();
+  reply_pos_ = 0;
+  if (!WriteAll(data.data(), data.size())) {
+    stream_broken_ = true;
+    return false;
+  }
+  return true;
+}
+
+bool PikaClientConn::WriteAll(const char* data, size_t len) {
+  while (len > 0) {
+    ssize_t nwritten = write(fd(), data, len);
+    if (nwritten > 0) {
+      data += nwritten;
+      len -= nwritten;
+      continue;
     }
+    if (nwritten < 0 && errno == EINTR) {
+      continue;
+    }
+    if (nwritten < 0 && errno == EAGAIN) {
+      struct pollfd pfd;
+      pfd.fd = fd();
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      uint64_t now = slash::NowMicros();
+      int timeout_ms = now < stream_deadline_us_
+        ? static_cast<int>((stream_deadline_us_ - now + 999) / 1000) : 0;
+      if (timeout_ms > 0 && poll(&pfd, 1, timeout_ms) > 0) {
+        continue;
+      }
+      LOG(WARNING) << "ip_port: " << ip_port() << " not reading the reply streamed, give up";
+    }
+    return false;
   }
-  slash::StringToLower(opt);
+  return true;
+}
+
+int PikaClientConn::DealMessage(const PikaCmdArgsType& argv, std::string* response) {
+
+  if (argv.empty()) return -2;
+  int cmd_id = g_pika_cmd_table_manager->GetCmdId(argv);
 
   if (response->empty()) {
     // Avoid memory copy
-    *response = std::move(DoCmd(argv, opt));
+    *response = std::move(DoCmd(argv, cmd_id));
   } else {
     // Maybe pipeline
-    response->append(DoCmd(argv, opt));
+    response->append(DoCmd(argv, cmd_id));
   }
   return 0;
 }
@@ -194,6 +351,7 @@ int PikaClientConn::DealMessage(const PikaCmdArgsType& argv, std::string* respon
 void PikaClientConn::DoBackgroundTask(void* arg) {
   BgTaskArg* bg_arg = reinterpret_cast<BgTaskArg*>(arg);
   bg_arg->pcc->BatchExecRedisCmd(bg_arg->redis_cmds, bg_arg->response);
+  g_pika_server->UpdateExecModeLatency(bg_arg->mode, slash::NowMicros() - bg_arg->schedule_us);
   delete bg_arg;
 }
 
@@ -214,7 +372,8 @@ bool PikaClientConn::AuthStat::IsAuthed(const std::shared_ptr<Cmd> cmd_ptr) {
   if (opt == kCmdNameAuth) {
     return true;
   }
-  const std::vector<std::string>& blacklist = g_pika_conf->vuser_blacklist();
+  const PikaConfSnapshot* conf = g_pika_conf->snapshot();
+  const std::vector<std::string>& blacklist = conf->user_blacklist;
   switch (stat_) {
     case kNoAuthed:
       return false;
@@ -247,6 +406,79 @@ bool PikaClientConn::AuthStat::ChecknUpdate(const std::string& message) {
 }
 
 // compare addr in ClientInfo
+ReplyStream::ReplyStream(Cmd* cmd, std::shared_ptr<Partition> partition)
+    : conn_(std::dynamic_pointer_cast<PikaClientConn>(cmd->GetConn())),
+      partition_(cmd->is_suspend() ? nullptr : partition),
+      res_(&cmd->res()),
+      streamed_(false),
+      broken_(false) {
+}
+
+void ReplyStream::AppendArrayLen(int64_t len) {
+  if (!conn_) {
+    res_->AppendArrayLen(len);
+    return;
+  }
+  RedisAppendLen(buf_, len, "*");
+}
+
+void ReplyStream::AppendString(const std::string& value) {
+  if (!conn_) {
+    res_->AppendString(value);
+    return;
+  }
+  RedisAppendLen(buf_, value.size(), "$");
+  RedisAppendContent(buf_, value);
+  if (buf_.size() >= kReplyStreamChunkSize) {
+    Flush();
+  }
+}
+
+void ReplyStream::AppendNil() {
+  if (!conn_) {
+    res_->AppendStringLen(-1);
+    return;
+  }
+  RedisAppendLen(buf_, -1, "$");
+}
+
+void ReplyStream::Finish() {
+  if (!conn_) {
+    return;
+  }
+  if (!streamed_) {
+    // Small enough, replied as usual
+    res_->AppendStringRaw(buf_);
+  } else {
+    Flush();
+  }
+  buf_.clear();
+}
+
+size_t ReplyStream::BulkSize(size_t len) {
+  // "$" digits "\r\n" content "\r\n"
+  size_t digits = 1;
+  for (size_t n = len; n >= 10; n /= 10) {
+    digits++;
+  }
+  return 1 + digits + 2 + len + 2;
+}
+
+void ReplyStream::Flush() {
+  if (!broken_ && !buf_.empty()) {
+    // Writers of the db need not wait for a slow client
+    if (partition_) {
+      partition_->DbRWUnLock();
+    }
+    broken_ = !conn_->StreamReply(buf_);
+    if (partition_) {
+      partition_->DbRWLockReader();
+    }
+  }
+  streamed_ = true;
+  buf_.clear();
+}
+
 bool AddrCompare(const ClientInfo& lhs, const ClientInfo& rhs) {
   return rhs.ip_port < lhs.ip_port;
 }
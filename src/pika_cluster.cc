@@ -215,9 +215,7 @@ void PkClusterAddSlotsCmd::Do(std::shared_ptr<Partition> partition) {
     return;
   }
 
-  SlotState expected = INFREE;
-  if (!std::atomic_compare_exchange_strong(&g_pika_server->slot_state_,
-              &expected, INBUSY)) {
+  if (!g_pika_server->TryLockSlotState()) {
     res_.SetRes(CmdRes::kErrOther,
             "Slot in syncing or a change operation is under way, retry later");
     return;
@@ -251,7 +249,7 @@ void PkClusterAddSlotsCmd::Do(std::shared_ptr<Partition> partition) {
     }
   }
 
-  g_pika_server->slot_state_.store(INFREE);
+  g_pika_server->UnlockSlotState();
 
   if (!pre_success) {
     res_.SetRes(CmdRes::kErrOther, s.ToString());
@@ -305,9 +303,7 @@ void PkClusterDelSlotsCmd::Do(std::shared_ptr<Partition> partition) {
     return;
   }
 
-  SlotState expected = INFREE;
-  if (!std::atomic_compare_exchange_strong(&g_pika_server->slot_state_,
-              &expected, INBUSY)) {
+  if (!g_pika_server->TryLockSlotState()) {
     res_.SetRes(CmdRes::kErrOther,
             "Slot in syncing or a change operation is under way, retry later");
     return;
@@ -341,7 +337,7 @@ void PkClusterDelSlotsCmd::Do(std::shared_ptr<Partition> partition) {
     }
   }
 
-  g_pika_server->slot_state_.store(INFREE);
+  g_pika_server->UnlockSlotState();
 
   if (!pre_success) {
     res_.SetRes(CmdRes::kErrOther, s.ToString());
@@ -493,3 +489,95 @@ void PkClusterSlotsSlaveofCmd::Do(std::shared_ptr<Partition> partition) {
   }
 }
 
+
+/*
+ * pkcluster splitslot 3
+ */
+void PkClusterSplitSlotCmd::DoInitial() {
+  if (!CheckArg(argv_.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNamePkClusterSplitSlot);
+    return;
+  }
+  if (g_pika_conf->classic_mode()) {
+    res_.SetRes(CmdRes::kErrOther, "PkClusterSplitSlot only support on sharding mode");
+    return;
+  }
+  unsigned long slot = 0;
+  if (!slash::string2ul(argv_[2].data(), argv_[2].size(), &slot)
+    || slot > UINT32_MAX) {
+    res_.SetRes(CmdRes::kInvalidParameter, kCmdNamePkClusterSplitSlot);
+    return;
+  }
+  slot_ = static_cast<uint32_t>(slot);
+}
+
+void PkClusterSplitSlotCmd::Do(std::shared_ptr<Partition> partition) {
+  bool from_binlog = partition != nullptr;
+  std::string table_name = from_binlog ? partition->GetTableName() : g_pika_conf->default_table();
+  std::shared_ptr<Table> table_ptr = g_pika_server->GetTable(table_name);
+  if (!table_ptr) {
+    res_.SetRes(CmdRes::kErrOther, "Internal error: table not found!");
+    return;
+  }
+  int role = 0;
+  Status s = g_pika_rm->CheckPartitionRole(table_name, slot_, &role);
+  if (!s.ok()) {
+    res_.SetRes(CmdRes::kErrOther, s.ToString());
+    return;
+  }
+  if ((role & PIKA_ROLE_SLAVE) && !from_binlog) {
+    res_.SetRes(CmdRes::kErrOther, "Split the slot on its master, slaves follow");
+    return;
+  }
+
+  if (from_binlog) {
+    // Binlog after the split must not be applied before it
+    g_pika_server->LockSlotState();
+  } else if (!g_pika_server->TryLockSlotState()) {
+    res_.SetRes(CmdRes::kErrOther,
+            "Slot in syncing or a change operation is under way, retry later");
+    return;
+  }
+
+  uint32_t child_id = 0;
+  s = table_ptr->SplitPartition(slot_, from_binlog ? nullptr : this, &child_id);
+  if (!s.ok()) {
+    LOG(WARNING) << "Splitslot split table partition failed: " << s.ToString();
+  } else {
+    s = g_pika_rm->AddSyncPartition({PartitionInfo(table_name, child_id)});
+    if (!s.ok()) {
+      LOG(WARNING) << "Splitslot add to sync partition failed: " << s.ToString();
+    }
+  }
+
+  g_pika_server->UnlockSlotState();
+
+  if (!s.ok()) {
+    if (from_binlog) {
+      LOG(ERROR) << "Slot " << slot_ << " split by master but not here, " << s.ToString();
+    }
+    res_.SetRes(CmdRes::kErrOther, s.ToString());
+    return;
+  }
+  if (from_binlog) {
+    // Both children start from the same data with an empty binlog,
+    // so the child here follows the child of the master from there
+    std::shared_ptr<SyncSlavePartition> slave_partition =
+      g_pika_rm->GetSyncSlavePartitionByName(PartitionInfo(table_name, slot_));
+    if (slave_partition) {
+      s = g_pika_rm->ActivateSyncSlavePartition(
+          RmNode(slave_partition->MasterIp(), slave_partition->MasterPort(), table_name, child_id),
+          ReplState::kTryConnect);
+      if (!s.ok()) {
+        LOG(WARNING) << "Splitslot slave of child partition " << child_id
+          << " failed: " << s.ToString();
+      }
+    }
+  } else {
+    // Deletes of the cleanup follow the split in the binlog, slaves
+    // apply them once they split too
+    table_ptr->CleanSplitPartition(slot_);
+    table_ptr->CleanSplitPartition(child_id);
+  }
+  res_.AppendInteger(child_id);
+}
@@ -5,84 +5,161 @@
 
 #include "include/pika_cmd_table_manager.h"
 
-#include <unistd.h>
-#include <sys/syscall.h>
+#include <atomic>
 
 #include "include/pika_conf.h"
-#include "slash/include/slash_mutex.h"
 
+extern PikaConf* g_pika_conf;
 
-#define gettid() syscall(__NR_gettid)
+void PikaCmdPool::Releaser::operator()(Cmd* cmd) const {
+  if (cmd->RetainedBytes() > kCmdPoolRetainedBytes) {
+    slot->cmd.reset();
+  }
+  // Pairs with the acquire load in Acquire, which may run on another thread
+  slot->in_use.store(false, std::memory_order_release);
+}
 
-extern PikaConf* g_pika_conf;
+std::shared_ptr<Cmd> PikaCmdPool::Acquire(Cmd* prototype) {
+  Instances& instances = cmds_[prototype];
+  size_t size = instances.slots.size();
+  for (size_t i = 0; i < size; ++i) {
+    const std::shared_ptr<Slot>& slot = instances.slots[(instances.next + i) % size];
+    if (!slot->in_use.load(std::memory_order_acquire)) {
+      instances.next = (instances.next + i + 1) % size;
+      slot->in_use.store(true, std::memory_order_relaxed);
+      if (slot->cmd) {
+        slot->cmd->Reset();
+      } else {
+        slot->cmd.reset(prototype->Clone());
+      }
+      return std::shared_ptr<Cmd>(slot->cmd.get(), Releaser{slot});
+    }
+  }
+  if (size >= kCmdPoolSizePerCmd) {
+    return std::shared_ptr<Cmd>(prototype->Clone());
+  }
+  std::shared_ptr<Slot> slot = std::make_shared<Slot>();
+  slot->cmd.reset(prototype->Clone());
+  slot->in_use.store(true, std::memory_order_relaxed);
+  instances.slots.push_back(slot);
+  return std::shared_ptr<Cmd>(slot->cmd.get(), Releaser{slot});
+}
 
 PikaCmdTableManager::PikaCmdTableManager() {
-  pthread_rwlock_init(&map_protector_, NULL);
   cmds_ = new CmdTable();
   cmds_->reserve(300);
   InitCmdTable(cmds_);
+  cmd_index_.Build(*cmds_);
+  slow_by_cost_.reset(new std::atomic<bool>[cmd_index_.size()]);
+  for (size_t id = 0; id < cmd_index_.size(); ++id) {
+    cmds_by_id_.push_back(GetCmdFromTable(cmd_index_.name(id), *cmds_));
+    slow_by_cost_[id].store(true);
+  }
+  slaveof_id_ = cmd_index_.Find(kCmdNameSlaveof);
+  pkcluster_slots_slaveof_id_ = cmd_index_.Find(kCmdNamePkClusterSlotsSlaveof);
 }
 
 PikaCmdTableManager::~PikaCmdTableManager() {
-  pthread_rwlock_destroy(&map_protector_);
-  for (const auto&item : thread_distribution_map_) {
-    delete item.second;
-  }
   DestoryCmdTable(cmds_);
   delete cmds_;
 }
 
 std::shared_ptr<Cmd> PikaCmdTableManager::GetCmd(const std::string& opt) {
-  std::string internal_opt = opt;
+  return GetCmd(cmd_index_.Find(opt));
+}
+
+std::shared_ptr<Cmd> PikaCmdTableManager::GetCmd(int cmd_id) {
+  if (cmd_id < 0) {
+    return nullptr;
+  }
   if (!g_pika_conf->classic_mode()) {
-    TryChangeToAlias(&internal_opt);
+    cmd_id = TryChangeToAlias(cmd_id);
   }
-  return NewCommand(internal_opt);
+  return NewCommand(cmd_id);
 }
 
-std::shared_ptr<Cmd> PikaCmdTableManager::NewCommand(const std::string& opt) {
-  Cmd* cmd = GetCmdFromTable(opt, *cmds_);
-  if (cmd) {
-    return std::shared_ptr<Cmd>(cmd->Clone());
-  }
-  return nullptr;
+bool PikaCmdTableManager::IsFastCmd(int cmd_id) {
+  return cmd_id >= 0 && cmds_by_id_[cmd_id]->is_fast();
+}
+
+bool PikaCmdTableManager::IsPriorCmd(int cmd_id) {
+  return cmd_id >= 0 && cmds_by_id_[cmd_id]->is_prior();
 }
 
-void PikaCmdTableManager::TryChangeToAlias(std::string *internal_opt) {
-  if (!strcasecmp(internal_opt->c_str(), kCmdNameSlaveof.c_str())) {
-    *internal_opt = kCmdNamePkClusterSlotsSlaveof;
+bool PikaCmdTableManager::IsSlowCmd(int cmd_id) {
+  return cmd_id >= 0 && cmds_by_id_[cmd_id]->is_slow()
+    && slow_by_cost_[cmd_id].load(std::memory_order_relaxed);
+}
+
+void PikaCmdTableManager::SetSlowByCost(int cmd_id, bool slow) {
+  if (cmd_id >= 0 && cmds_by_id_[cmd_id]->is_slow()) {
+    slow_by_cost_[cmd_id].store(slow, std::memory_order_relaxed);
   }
 }
 
-bool PikaCmdTableManager::CheckCurrentThreadDistributionMapExist(const pid_t& tid) {
-  slash::RWLock l(&map_protector_, false);
-  if (thread_distribution_map_.find(tid) == thread_distribution_map_.end()) {
-    return false;
+int PikaCmdTableManager::GetCmdId(const PikaCmdArgsType& argv) {
+  if (argv.empty()) {
+    return -1;
   }
-  return true;
+  const std::string& opt = argv[0];
+  if (argv.size() >= 2
+    && opt.size() == kClusterPrefix.size()
+    && !strncasecmp(opt.data(), kClusterPrefix.data(), opt.size())) {
+    return cmd_index_.Find(opt + argv[1]);
+  }
+  return cmd_index_.Find(opt);
 }
 
-void PikaCmdTableManager::InsertCurrentThreadDistributionMap() {
-  pid_t tid = gettid();
-  PikaDataDistribution* distribution = nullptr;
-  if (g_pika_conf->classic_mode()) {
-    distribution = new HashModulo();
-  } else {
-    distribution = new Crc32();
+int PikaCmdTableManager::GetCmdId(const std::string& name) {
+  return cmd_index_.Find(name);
+}
+
+const std::string& PikaCmdTableManager::GetCmdName(int cmd_id) {
+  return cmd_index_.name(cmd_id);
+}
+
+std::shared_ptr<Cmd> PikaCmdTableManager::NewCommand(int cmd_id) {
+  // Every worker thread reuses its own instances
+  static thread_local PikaCmdPool pool;
+  return pool.Acquire(cmds_by_id_[cmd_id]);
+}
+
+int PikaCmdTableManager::TryChangeToAlias(int cmd_id) {
+  if (cmd_id == slaveof_id_) {
+    return pkcluster_slots_slaveof_id_;
   }
-  distribution->Init();
-  slash::RWLock l(&map_protector_, true);
-  thread_distribution_map_.insert(std::make_pair(tid, distribution));
+  return cmd_id;
 }
 
-uint32_t PikaCmdTableManager::DistributeKey(const std::string& key, uint32_t partition_num) {
-  pid_t tid = gettid();
-  PikaDataDistribution* data_dist = nullptr;
-  if (!CheckCurrentThreadDistributionMapExist(tid)) {
-    InsertCurrentThreadDistributionMap();
+namespace {
+
+// Distributions of one thread, routing takes no lock
+struct ThreadDistributions {
+  HashModulo hash_modulo;
+  Crc32 crc32;
+  Crc32c crc32c;
+  ThreadDistributions() {
+    hash_modulo.Init();
+    crc32.Init();
+    crc32c.Init();
   }
+};
+
+}  // namespace
 
-  slash::RWLock l(&map_protector_, false);
-  data_dist = thread_distribution_map_[tid];
-  return data_dist->Distribute(key, partition_num);
+uint32_t PikaCmdTableManager::DistributeKey(const std::string& key,
+                                            uint32_t partition_num,
+                                            KeyHashType key_hash,
+                                            bool hash_tag) {
+  static thread_local ThreadDistributions distributions;
+  if (g_pika_conf->classic_mode()) {
+    return distributions.hash_modulo.Distribute(key, partition_num);
+  }
+  size_t tag_pos = 0, tag_len = 0;
+  if (hash_tag && HashTagOf(key, &tag_pos, &tag_len)) {
+    return DistributeKey(key.substr(tag_pos, tag_len), partition_num, key_hash, false);
+  } else if (key_hash == kKeyHashCrc32c) {
+    return distributions.crc32c.Distribute(key, partition_num);
+  }
+  return distributions.crc32.Distribute(key, partition_num);
 }
@@ -5,6 +5,9 @@
 
 #include "include/pika_command.h"
 
+#include <algorithm>
+#include <strings.h>
+
 #include "include/pika_kv.h"
 #include "include/pika_bit.h"
 #include "include/pika_set.h"
@@ -24,11 +27,11 @@ extern PikaServer* g_pika_server;
 void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   //Admin
   ////Slaveof
-  Cmd* slaveofptr = new SlaveofCmd(kCmdNameSlaveof, -3, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* slaveofptr = new SlaveofCmd(kCmdNameSlaveof, -3, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSlaveof, slaveofptr));
   Cmd* dbslaveofptr = new DbSlaveofCmd(kCmdNameDbSlaveof, -2, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameDbSlaveof, dbslaveofptr));
-  Cmd* authptr = new AuthCmd(kCmdNameAuth, 2, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* authptr = new AuthCmd(kCmdNameAuth, 2, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameAuth, authptr));
   Cmd* bgsaveptr = new BgsaveCmd(kCmdNameBgsave, -1, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsSuspend);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameBgsave, bgsaveptr));
@@ -36,39 +39,39 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameCompact, compactptr));
   Cmd* purgelogsto = new PurgelogstoCmd(kCmdNamePurgelogsto, -2, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePurgelogsto, purgelogsto));
-  Cmd* pingptr = new PingCmd(kCmdNamePing, 1, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* pingptr = new PingCmd(kCmdNamePing, 1, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePing, pingptr));
-  Cmd* selectptr = new SelectCmd(kCmdNameSelect, 2, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* selectptr = new SelectCmd(kCmdNameSelect, 2, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSelect, selectptr));
-  Cmd* flushallptr = new FlushallCmd(kCmdNameFlushall, 1, kCmdFlagsWrite | kCmdFlagsSuspend | kCmdFlagsAdmin);
+  Cmd* flushallptr = new FlushallCmd(kCmdNameFlushall, 1, kCmdFlagsWrite | kCmdFlagsSuspend | kCmdFlagsAdmin | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameFlushall, flushallptr));
-  Cmd* flushdbptr = new FlushdbCmd(kCmdNameFlushdb, -1, kCmdFlagsWrite | kCmdFlagsSuspend | kCmdFlagsAdmin);
+  Cmd* flushdbptr = new FlushdbCmd(kCmdNameFlushdb, -1, kCmdFlagsWrite | kCmdFlagsSuspend | kCmdFlagsAdmin | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameFlushdb, flushdbptr));
-  Cmd* clientptr = new ClientCmd(kCmdNameClient, -2, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* clientptr = new ClientCmd(kCmdNameClient, -2, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameClient, clientptr));
   Cmd* shutdownptr = new ShutdownCmd(kCmdNameShutdown, 1, kCmdFlagsRead | kCmdFlagsLocal | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameShutdown, shutdownptr));
-  Cmd* infoptr = new InfoCmd(kCmdNameInfo, -1, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* infoptr = new InfoCmd(kCmdNameInfo, -1, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameInfo, infoptr));
-  Cmd* configptr = new ConfigCmd(kCmdNameConfig, -2, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* configptr = new ConfigCmd(kCmdNameConfig, -2, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameConfig, configptr));
   Cmd* monitorptr = new MonitorCmd(kCmdNameMonitor, -1, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameMonitor, monitorptr));
   Cmd* dbsizeptr = new DbsizeCmd(kCmdNameDbsize, 1, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameDbsize, dbsizeptr));
-  Cmd* timeptr = new TimeCmd(kCmdNameTime, 1, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* timeptr = new TimeCmd(kCmdNameTime, 1, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameTime, timeptr));
   Cmd* delbackupptr = new DelbackupCmd(kCmdNameDelbackup, 1, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameDelbackup, delbackupptr));
-  Cmd* echoptr = new EchoCmd(kCmdNameEcho, 2, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* echoptr = new EchoCmd(kCmdNameEcho, 2, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameEcho, echoptr));
   Cmd* scandbptr = new ScandbCmd(kCmdNameScandb, -1, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameScandb, scandbptr));
-  Cmd* slowlogptr = new SlowlogCmd(kCmdNameSlowlog, -2, kCmdFlagsRead | kCmdFlagsAdmin);
+  Cmd* slowlogptr = new SlowlogCmd(kCmdNameSlowlog, -2, kCmdFlagsRead | kCmdFlagsAdmin | kCmdFlagsPrior);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSlowlog, slowlogptr));
   Cmd* paddingptr = new PaddingCmd(kCmdNamePadding, 2, kCmdFlagsWrite | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePadding, paddingptr));
-  Cmd* pkpatternmatchdelptr = new PKPatternMatchDelCmd(kCmdNamePKPatternMatchDel, 3, kCmdFlagsWrite | kCmdFlagsAdmin);
+  Cmd* pkpatternmatchdelptr = new PKPatternMatchDelCmd(kCmdNamePKPatternMatchDel, 3, kCmdFlagsWrite | kCmdFlagsAdmin | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePKPatternMatchDel, pkpatternmatchdelptr));
 
   // Slots related
@@ -108,6 +111,8 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePkClusterDelSlots, pkclusterdelslotsptr));
   Cmd* pkclusterslotsslaveofptr = new PkClusterSlotsSlaveofCmd(kCmdNamePkClusterSlotsSlaveof, -5, kCmdFlagsRead | kCmdFlagsAdmin);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePkClusterSlotsSlaveof, pkclusterslotsslaveofptr));
+  Cmd* pkclustersplitslotptr = new PkClusterSplitSlotCmd(kCmdNamePkClusterSplitSlot, 3, kCmdFlagsRead | kCmdFlagsSuspend | kCmdFlagsAdmin);
+  cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePkClusterSplitSlot, pkclustersplitslotptr));
 
 #ifdef TCMALLOC_EXTENSION
   Cmd* tcmallocptr = new TcmallocCmd(kCmdNameTcmalloc, -2, kCmdFlagsRead | kCmdFlagsAdmin);
@@ -119,7 +124,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* setptr = new SetCmd(kCmdNameSet, -3, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsKv);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSet, setptr));
   ////GetCmd
-  Cmd* getptr = new GetCmd(kCmdNameGet, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv);
+  Cmd* getptr = new GetCmd(kCmdNameGet, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameGet, getptr));
   ////DelCmd
   Cmd* delptr = new DelCmd(kCmdNameDel, -2, kCmdFlagsWrite | kCmdFlagsMultiPartition | kCmdFlagsKv);
@@ -149,7 +154,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* mgetptr = new MgetCmd(kCmdNameMget, -2, kCmdFlagsRead | kCmdFlagsMultiPartition | kCmdFlagsKv);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameMget, mgetptr));
   ////KeysCmd
-  Cmd* keysptr = new KeysCmd(kCmdNameKeys, -2, kCmdFlagsRead | kCmdFlagsMultiPartition | kCmdFlagsKv);
+  Cmd* keysptr = new KeysCmd(kCmdNameKeys, -2, kCmdFlagsRead | kCmdFlagsMultiPartition | kCmdFlagsKv | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameKeys, keysptr));
   ////SetnxCmd
   Cmd* setnxptr = new SetnxCmd(kCmdNameSetnx, 3, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsKv);
@@ -176,7 +181,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* setrangeptr = new SetrangeCmd(kCmdNameSetrange, 4, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsKv);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSetrange, setrangeptr));
   ////StrlenCmd
-  Cmd* strlenptr = new StrlenCmd(kCmdNameStrlen, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv);
+  Cmd* strlenptr = new StrlenCmd(kCmdNameStrlen, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameStrlen, strlenptr));
   ////ExistsCmd
   Cmd* existsptr = new ExistsCmd(kCmdNameExists, -2, kCmdFlagsRead | kCmdFlagsMultiPartition | kCmdFlagsKv);
@@ -194,16 +199,16 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* pexpireatptr = new PexpireatCmd(kCmdNamePexpireat, 3, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsKv);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePexpireat, pexpireatptr));
   ////TtlCmd
-  Cmd* ttlptr = new TtlCmd(kCmdNameTtl, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv);
+  Cmd* ttlptr = new TtlCmd(kCmdNameTtl, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameTtl, ttlptr));
   ////PttlCmd
-  Cmd* pttlptr = new PttlCmd(kCmdNamePttl, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv);
+  Cmd* pttlptr = new PttlCmd(kCmdNamePttl, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePttl, pttlptr));
   ////PersistCmd
   Cmd* persistptr = new PersistCmd(kCmdNamePersist, 2, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsKv);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNamePersist, persistptr));
   ////TypeCmd
-  Cmd* typeptr = new TypeCmd(kCmdNameType, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv);
+  Cmd* typeptr = new TypeCmd(kCmdNameType, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsKv | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameType, typeptr));
   ////ScanCmd
   Cmd* scanptr = new ScanCmd(kCmdNameScan, -2, kCmdFlagsRead | kCmdFlagsMultiPartition | kCmdFlagsKv);
@@ -229,13 +234,13 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* hsetptr = new HSetCmd(kCmdNameHSet, 4, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsHash);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHSet, hsetptr));
   ////HGetCmd
-  Cmd* hgetptr = new HGetCmd(kCmdNameHGet, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hgetptr = new HGetCmd(kCmdNameHGet, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHGet, hgetptr));
   ////HGetallCmd
-  Cmd* hgetallptr = new HGetallCmd(kCmdNameHGetall, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hgetallptr = new HGetallCmd(kCmdNameHGetall, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHGetall, hgetallptr));
   ////HExistsCmd
-  Cmd* hexistsptr = new HExistsCmd(kCmdNameHExists, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hexistsptr = new HExistsCmd(kCmdNameHExists, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHExists, hexistsptr));
   ////HIncrbyCmd
   Cmd* hincrbyptr = new HIncrbyCmd(kCmdNameHIncrby, 4, kCmdFlagsWrite |kCmdFlagsSinglePartition | kCmdFlagsHash);
@@ -244,10 +249,10 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* hincrbyfloatptr = new HIncrbyfloatCmd(kCmdNameHIncrbyfloat, 4, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsHash);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHIncrbyfloat, hincrbyfloatptr));
   ////HKeysCmd
-  Cmd* hkeysptr = new HKeysCmd(kCmdNameHKeys, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hkeysptr = new HKeysCmd(kCmdNameHKeys, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHKeys, hkeysptr));
   ////HLenCmd
-  Cmd* hlenptr = new HLenCmd(kCmdNameHLen, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hlenptr = new HLenCmd(kCmdNameHLen, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHLen, hlenptr));
   ////HMgetCmd
   Cmd* hmgetptr = new HMgetCmd(kCmdNameHMget, -3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
@@ -259,10 +264,10 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* hsetnxptr = new HSetnxCmd(kCmdNameHSetnx, 4, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsHash);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHSetnx, hsetnxptr));
   ////HStrlenCmd
-  Cmd* hstrlenptr = new HStrlenCmd(kCmdNameHStrlen, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hstrlenptr = new HStrlenCmd(kCmdNameHStrlen, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHStrlen, hstrlenptr));
   ////HValsCmd
-  Cmd* hvalsptr = new HValsCmd(kCmdNameHVals, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
+  Cmd* hvalsptr = new HValsCmd(kCmdNameHVals, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameHVals, hvalsptr));
   ////HScanCmd
   Cmd* hscanptr = new HScanCmd(kCmdNameHScan, -3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsHash);
@@ -282,7 +287,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameLIndex, lindexptr));
   Cmd* linsertptr = new LInsertCmd(kCmdNameLInsert, 5, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsList);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameLInsert, linsertptr));
-  Cmd* llenptr = new LLenCmd(kCmdNameLLen, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsList);
+  Cmd* llenptr = new LLenCmd(kCmdNameLLen, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsList | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameLLen, llenptr));
   Cmd* lpopptr = new LPopCmd(kCmdNameLPop, 2, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsList);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameLPop, lpopptr));
@@ -312,7 +317,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* zaddptr = new ZAddCmd(kCmdNameZAdd, -4, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsZset);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameZAdd, zaddptr));
   ////ZCardCmd
-  Cmd* zcardptr = new ZCardCmd(kCmdNameZCard, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset);
+  Cmd* zcardptr = new ZCardCmd(kCmdNameZCard, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameZCard, zcardptr));
   ////ZScanCmd
   Cmd* zscanptr = new ZScanCmd(kCmdNameZScan, -3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset);
@@ -351,7 +356,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* zrevrankptr = new ZRevrankCmd(kCmdNameZRevrank, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameZRevrank, zrevrankptr));
   ////ZScoreCmd
-  Cmd* zscoreptr = new ZScoreCmd(kCmdNameZScore, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset);
+  Cmd* zscoreptr = new ZScoreCmd(kCmdNameZScore, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameZScore, zscoreptr));
   ////ZRangebylexCmd
   Cmd* zrangebylexptr = new ZRangebylexCmd(kCmdNameZRangebylex, -4, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsZset);
@@ -386,10 +391,10 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* spopptr = new SPopCmd(kCmdNameSPop, 2, kCmdFlagsWrite | kCmdFlagsSinglePartition | kCmdFlagsSet);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSPop, spopptr));
   ////SCardCmd
-  Cmd* scardptr = new SCardCmd(kCmdNameSCard, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet);
+  Cmd* scardptr = new SCardCmd(kCmdNameSCard, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSCard, scardptr));
   ////SMembersCmd
-  Cmd* smembersptr = new SMembersCmd(kCmdNameSMembers, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet);
+  Cmd* smembersptr = new SMembersCmd(kCmdNameSMembers, 2, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet | kCmdFlagsSlow);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSMembers, smembersptr));
   ////SScanCmd
   Cmd* sscanptr = new SScanCmd(kCmdNameSScan, -3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet);
@@ -410,7 +415,7 @@ void InitCmdTable(std::unordered_map<std::string, Cmd*> *cmd_table) {
   Cmd* sinterstoreptr = new SInterstoreCmd(kCmdNameSInterstore, -3, kCmdFlagsWrite | kCmdFlagsMultiPartition | kCmdFlagsSet);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSInterstore, sinterstoreptr));
   ////SIsmemberCmd
-  Cmd* sismemberptr = new SIsmemberCmd(kCmdNameSIsmember, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet);
+  Cmd* sismemberptr = new SIsmemberCmd(kCmdNameSIsmember, 3, kCmdFlagsRead | kCmdFlagsSinglePartition | kCmdFlagsSet | kCmdFlagsFast);
   cmd_table->insert(std::pair<std::string, Cmd*>(kCmdNameSIsmember, sismemberptr));
   ////SDiffCmd
   Cmd* sdiffptr = new SDiffCmd(kCmdNameSDiff, -2, kCmdFlagsRead | kCmdFlagsMultiPartition | kCmdFlagsSet);
@@ -502,6 +507,70 @@ Cmd* GetCmdFromTable(const std::string& opt, const CmdTable& cmd_table) {
   return NULL;
 }
 
+CmdNameIndex::CmdNameIndex()
+    : seed_(0), mask_(0) {
+}
+
+uint32_t CmdNameIndex::Hash(const char* name, size_t len, uint32_t seed) {
+  // FNV-1a, bytes are folded to lower case as far as letters matter
+  uint32_t h = 2166136261u ^ seed;
+  for (size_t i = 0; i < len; ++i) {
+    h ^= static_cast<unsigned char>(name[i]) | 0x20;
+    h *= 16777619u;
+  }
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  return h;
+}
+
+void CmdNameIndex::Build(const CmdTable& cmd_table) {
+  names_.clear();
+  for (const auto& item : cmd_table) {
+    names_.push_back(item.first);
+  }
+  std::sort(names_.begin(), names_.end());
+
+  // At least four slots per name, look for a seed without collision,
+  // and double the slots if none is found
+  uint32_t slot_num = 1;
+  while (slot_num < names_.size() * 4) {
+    slot_num <<= 1;
+  }
+  while (true) {
+    mask_ = slot_num - 1;
+    for (seed_ = 0; seed_ < 100000; ++seed_) {
+      slots_.assign(slot_num, -1);
+      bool collided = false;
+      for (size_t id = 0; id < names_.size(); ++id) {
+        int& slot = slots_[Hash(names_[id].data(), names_[id].size(), seed_) & mask_];
+        if (slot != -1) {
+          collided = true;
+          break;
+        }
+        slot = static_cast<int>(id);
+      }
+      if (!collided) {
+        return;
+      }
+    }
+    slot_num <<= 1;
+  }
+}
+
+int CmdNameIndex::Find(const char* name, size_t len) const {
+  if (slots_.empty()) {
+    return -1;
+  }
+  int id = slots_[Hash(name, len, seed_) & mask_];
+  if (id == -1
+    || names_[id].size() != len
+    || strncasecmp(names_[id].data(), name, len)) {
+    return -1;
+  }
+  return id;
+}
+
 void DestoryCmdTable(CmdTable* cmd_table) {
   CmdTable::const_iterator it = cmd_table->begin();
   for (; it != cmd_table->end(); ++it) {
@@ -532,17 +601,42 @@ void Cmd::Initial(const PikaCmdArgsType& argv,
     TryAliasChange(&argv_);
   }
   table_name_ = table_name;
+  keys_cached_ = false;
   res_.clear(); // Clear res content
   Clear();      // Clear cmd, Derived class can has own implement
   DoInitial();
 };
 
+void Cmd::Reset() {
+  keys_cached_ = false;
+  keys_locked_ = false;
+  res_.clear();
+  conn_.reset();
+  Clear();
+}
+
+size_t Cmd::RetainedBytes() const {
+  size_t bytes = res_.capacity() + argv_.capacity() * sizeof(std::string);
+  for (const auto& arg : argv_) {
+    bytes += arg.capacity();
+  }
+  return bytes;
+}
+
 std::vector<std::string> Cmd::current_key() const {
   std::vector<std::string> res;
   res.push_back("");
   return res;
 }
 
+const std::vector<std::string>& Cmd::keys() {
+  if (!keys_cached_) {
+    keys_ = current_key();
+    keys_cached_ = true;
+  }
+  return keys_;
+}
+
 void Cmd::Execute() {
   if (name_ == kCmdNameFlushdb) {
     ProcessFlushDBCmd();
@@ -600,7 +694,7 @@ void Cmd::ProcessSinglePartitionCmd() {
     // in classic mode a table has only one partition
     partition = g_pika_server->GetPartitionByDbName(table_name_);
   } else {
-    std::vector<std::string> cur_key = current_key();
+    const std::vector<std::string>& cur_key = keys();
     if (cur_key.empty()) {
       res_.SetRes(CmdRes::kErrOther, "Internal Error");
       return;
@@ -613,72 +707,125 @@ void Cmd::ProcessSinglePartitionCmd() {
     res_.SetRes(CmdRes::kErrOther, "Partition not found");
     return;
   }
-  ProcessCommand(partition);
+  ProcessCommand(partition, !g_pika_conf->classic_mode());
 }
 
-void Cmd::ProcessCommand(std::shared_ptr<Partition> partition) {
-  slash::lock::MultiRecordLock record_lock(partition->LockMgr());
-  if (is_write()) {
-    record_lock.Lock(current_key());
+void Cmd::ProcessCommand(std::shared_ptr<Partition> partition, bool routed) {
+  bool lock_keys = is_write() && !keys_locked_;
+  if (lock_keys) {
+    partition->KeyLocks()->Lock(keys(), &lock_stripes_);
   }
 
-  DoCommand(partition);
+  DoCommand(partition, routed);
 
   DoBinlog(partition);
 
-  if (is_write()) {
-    record_lock.Unlock(current_key());
+  if (lock_keys) {
+    partition->KeyLocks()->Unlock(lock_stripes_);
   }
 
 }
 
-void Cmd::DoCommand(std::shared_ptr<Partition> partition) {
+void Cmd::DoCommand(std::shared_ptr<Partition> partition, bool routed) {
   if (!is_suspend()) {
     partition->DbRWLockReader();
   }
 
-  Do(partition);
+  // A split holds the db lock, the keys may have moved to the child
+  // while waiting for it
+  bool owned = true;
+  if (routed) {
+    for (const auto& key : keys()) {
+      if (!partition->OwnsKey(key)) {
+        owned = false;
+        break;
+      }
+    }
+  }
+  if (!owned) {
+    res_.SetRes(CmdRes::kTryAgain, "partition split, retry");
+  } else {
+    Do(partition);
+  }
 
   if (!is_suspend()) {
     partition->DbRWUnLock();
   }
 
+  if (is_write()) {
+    partition->MarkKeysDirty();
+  }
 }
 
 void Cmd::DoBinlog(std::shared_ptr<Partition> partition) {
   if (res().ok()
     && is_write()
     && g_pika_conf->write_binlog()) {
+    Status s = WriteBinlog(partition);
+    if (!s.ok()) {
+      res().SetRes(CmdRes::kErrOther, s.ToString());
+    }
+  }
+}
 
+Status Cmd::WriteBinlog(std::shared_ptr<Partition> partition) {
+  Status s;
+  uint32_t exec_time = time(nullptr);
+  // Reused by every write command of this worker thread
+  static thread_local std::string binlog;
+  if (g_pika_conf->binlog_group_commit()) {
+    // logic_id, filenum and offset will be filled in by the group leader
+    ToBinlog(exec_time, g_pika_conf->server_id(), 0, 0, 0, &binlog);
+    s = partition->GroupWriteBinlog(&binlog);
+  } else {
     uint32_t filenum = 0;
     uint64_t offset = 0;
     uint64_t logic_id = 0;
 
     partition->logger()->Lock();
     partition->logger()->GetProducerStatus(&filenum, &offset, &logic_id);
-    uint32_t exec_time = time(nullptr);
-    std::string binlog = ToBinlog(exec_time,
-                                  g_pika_conf->server_id(),
-                                  logic_id,
-                                  filenum,
-                                  offset);
-
-    Status s = partition->WriteBinlog(binlog);
+    ToBinlog(exec_time,
+             g_pika_conf->server_id(),
+             logic_id,
+             filenum,
+             offset,
+             &binlog);
+
+    s = partition->WriteBinlog(binlog);
     partition->logger()->Unlock();
-
-    if (!s.ok()) {
-      res().SetRes(CmdRes::kErrOther, s.ToString());
-    }
   }
+  // Do not let one huge command pin its memory forever
+  if (binlog.capacity() > RAW_ARGS_LEN) {
+    std::string().swap(binlog);
+  }
+  return s;
 }
 
 void Cmd::ProcessMultiPartitionCmd() {
-  if (argv_.size() == static_cast<size_t>(arity_ < 0 ? -arity_ : arity_)) {
-    ProcessSinglePartitionCmd();
-  } else {
-    res_.SetRes(CmdRes::kErrOther, "This command usage only support in classic mode\r\n");
+  std::shared_ptr<Table> table = g_pika_server->GetTable(table_name_);
+  if (!table) {
+    res_.SetRes(CmdRes::kInvalidTable);
+    return;
+  }
+  const std::vector<std::string>& cur_key = keys();
+  if (cur_key.empty()) {
+    res_.SetRes(CmdRes::kErrOther, "Internal Error");
+    return;
+  }
+  // Keys sharing a {tag} are always together
+  uint32_t partition_id = table->PartitionIdOfKey(cur_key.front());
+  for (size_t idx = 1; idx < cur_key.size(); ++idx) {
+    if (table->PartitionIdOfKey(cur_key[idx]) != partition_id) {
+      res_.SetRes(CmdRes::kCrossSlot, "Keys in request don't hash to the same slot");
+      return;
+    }
+  }
+  std::shared_ptr<Partition> partition = table->GetPartitionById(partition_id);
+  if (!partition) {
+    res_.SetRes(CmdRes::kErrOther, "Partition not found");
     return;
   }
+  ProcessCommand(partition, true);
 }
 
 void Cmd::ProcessDoNotSpecifyPartitionCmd() {
@@ -696,6 +843,9 @@ bool Cmd::is_suspend() const {
   return ((flag_ & kCmdFlagsMaskSuspend) == kCmdFlagsSuspend);
 }
 // Must with admin auth
+bool Cmd::is_admin() const {
+  return ((flag_ & kCmdFlagsMaskType) == kCmdFlagsAdmin);
+}
 bool Cmd::is_admin_require() const {
   return ((flag_ & kCmdFlagsMaskAdminRequire) == kCmdFlagsAdminRequire);
 }
@@ -706,35 +856,65 @@ bool Cmd::is_multi_partition() const {
   return ((flag_ & kCmdFlagsMaskPartition) == kCmdFlagsMultiPartition);
 }
 
+bool Cmd::is_fast() const {
+  return ((flag_ & kCmdFlagsMaskFast) == kCmdFlagsFast);
+}
+
+bool Cmd::is_prior() const {
+  return ((flag_ & kCmdFlagsMaskPrior) == kCmdFlagsPrior);
+}
+
+bool Cmd::is_slow() const {
+  return ((flag_ & kCmdFlagsMaskSlow) == kCmdFlagsSlow);
+}
+
 std::string Cmd::name() const {
   return name_;
 }
 CmdRes& Cmd::res() {
   return res_;
 }
+const PikaCmdArgsType& Cmd::argv() const {
+  return argv_;
+}
 
-std::string Cmd::ToBinlog(uint32_t exec_time,
-                          const std::string& server_id,
-                          uint64_t logic_id,
-                          uint32_t filenum,
-                          uint64_t offset) {
-  std::string content;
-  content.reserve(RAW_ARGS_LEN);
-  RedisAppendLen(content, argv_.size(), "*");
+// Bytes RedisAppendLen takes, prefix + digits + "\r\n"
+static size_t RedisLenSize(uint64_t len) {
+  size_t digits = 1;
+  while (len >= 10) {
+    len /= 10;
+    digits++;
+  }
+  return 1 + digits + 2;
+}
 
+void Cmd::ToBinlog(uint32_t exec_time,
+                   const std::string& server_id,
+                   uint64_t logic_id,
+                   uint32_t filenum,
+                   uint64_t offset,
+                   std::string* binlog) {
+  // Size the item exactly, then encode header and content in one pass
+  size_t content_length = RedisLenSize(argv_.size());
   for (const auto& v : argv_) {
-    RedisAppendLen(content, v.size(), "$");
-    RedisAppendContent(content, v);
+    content_length += RedisLenSize(v.size()) + v.size() + 2;
+  }
+  binlog->clear();
+  binlog->reserve(BINLOG_ITEM_HEADER_SIZE + content_length);
+
+  PikaBinlogTransverter::BinlogHeaderEncode(BinlogType::TypeFirst,
+                                            exec_time,
+                                            std::stoi(server_id),
+                                            logic_id,
+                                            filenum,
+                                            offset,
+                                            content_length,
+                                            binlog);
+  RedisAppendLen(*binlog, argv_.size(), "*");
+  for (const auto& v : argv_) {
+    RedisAppendLen(*binlog, v.size(), "$");
+    RedisAppendContent(*binlog, v);
   }
-
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
 }
 
 bool Cmd::CheckArg(int num) const {
@@ -758,6 +938,10 @@ void Cmd::SetConn(const std::shared_ptr<pink::PinkConn> conn) {
   conn_ = conn;
 }
 
+void Cmd::SetKeysLocked(bool keys_locked) {
+  keys_locked_ = keys_locked;
+}
+
 std::shared_ptr<pink::PinkConn> Cmd::GetConn() {
   return conn_.lock();
 }
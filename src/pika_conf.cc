@@ -13,16 +13,51 @@
 #include "slash/include/env.h"
 
 #include "include/pika_define.h"
+#include "include/pika_binlog_compression.h"
+#include "include/pika_data_distribution.h"
 
 PikaConf::PikaConf(const std::string& path)
     : slash::BaseConf(path), conf_path_(path) {
   pthread_rwlock_init(&rwlock_, NULL);
   local_meta_ = new PikaMeta();
+  snapshot_.store(new PikaConfSnapshot(), std::memory_order_release);
 }
 
 PikaConf::~PikaConf() {
   pthread_rwlock_destroy(&rwlock_);
   delete local_meta_;
+  delete snapshot_.load();
+  for (const auto& retired : retired_snapshots_) {
+    delete retired.first;
+  }
+}
+
+void PikaConf::PublishSnapshot() {
+  PikaConfSnapshot* snapshot = new PikaConfSnapshot();
+  snapshot->write_binlog = write_binlog_;
+  snapshot->slave_read_only = slave_read_only_;
+  snapshot->max_client_response_size = max_client_response_size_;
+  snapshot->inline_exec_queue_threshold = inline_exec_queue_threshold_;
+  snapshot->server_id = server_id_;
+  snapshot->default_table = default_table_;
+  snapshot->requirepass = requirepass_;
+  snapshot->userpass = userpass_;
+  snapshot->user_blacklist = user_blacklist_;
+  const PikaConfSnapshot* replaced = snapshot_.exchange(snapshot, std::memory_order_acq_rel);
+  retired_snapshots_.push_back(std::make_pair(replaced, time(NULL)));
+}
+
+void PikaConf::FreeRetiredSnapshots() {
+  RWLock l(&rwlock_, true);
+  time_t now = time(NULL);
+  auto iter = retired_snapshots_.begin();
+  // Retired in time order
+  while (iter != retired_snapshots_.end()
+    && now - iter->second >= kConfSnapshotGraceSec) {
+    delete iter->first;
+    ++iter;
+  }
+  retired_snapshots_.erase(retired_snapshots_.begin(), iter);
 }
 
 Status PikaConf::InternalGetTargetTable(const std::string& table_name, uint32_t* const target) {
@@ -51,7 +86,8 @@ Status PikaConf::TablePartitionsSanityCheck(const std::string& table_name,
   }
   // Sanity Check
   for (const auto& id : partition_ids) {
-    if (id >= table_structs_[table_index].partition_num) {
+    if (id >= table_structs_[table_index].partition_num
+      && table_structs_[table_index].hash_mods.count(id) == 0) {
       return Status::Corruption("partition index out of range");
     } else if (is_add && table_structs_[table_index].partition_ids.count(id) != 0) {
       return Status::Corruption("partition : " + std::to_string(id) + " exist");
@@ -100,6 +136,56 @@ Status PikaConf::RemoveTablePartitions(const std::string& table_name,
   return s;
 }
 
+Status PikaConf::SplitTablePartition(const std::string& table_name,
+                                     uint32_t partition_id,
+                                     uint32_t child_id,
+                                     uint32_t hash_mod,
+                                     bool clean) {
+  RWLock l(&rwlock_, true);
+  uint32_t index = 0;
+  Status s = InternalGetTargetTable(table_name, &index);
+  if (!s.ok()) {
+    return s;
+  }
+  TableStruct& table_struct = table_structs_[index];
+  if (table_struct.partition_ids.count(partition_id) == 0) {
+    return Status::Corruption("partition : " + std::to_string(partition_id) + " not exist");
+  } else if (table_struct.partition_ids.count(child_id) != 0) {
+    return Status::Corruption("partition : " + std::to_string(child_id) + " exist");
+  }
+  TableStruct origin = table_struct;
+  table_struct.partition_ids.insert(child_id);
+  table_struct.hash_mods[partition_id] = hash_mod;
+  table_struct.hash_mods[child_id] = hash_mod;
+  if (clean) {
+    table_struct.split_cleaning.insert(partition_id);
+    table_struct.split_cleaning.insert(child_id);
+  }
+  s = local_meta_->StableSave(table_structs_);
+  if (!s.ok()) {
+    table_struct = origin;
+  }
+  return s;
+}
+
+Status PikaConf::FinishSplitClean(const std::string& table_name, uint32_t partition_id) {
+  RWLock l(&rwlock_, true);
+  uint32_t index = 0;
+  Status s = InternalGetTargetTable(table_name, &index);
+  if (!s.ok()) {
+    return s;
+  }
+  TableStruct& table_struct = table_structs_[index];
+  if (table_struct.split_cleaning.erase(partition_id) == 0) {
+    return Status::OK();
+  }
+  s = local_meta_->StableSave(table_structs_);
+  if (!s.ok()) {
+    table_struct.split_cleaning.insert(partition_id);
+  }
+  return s;
+}
+
 int PikaConf::Load()
 {
   int ret = LoadConf();
@@ -199,6 +285,33 @@ int PikaConf::Load()
   if (thread_pool_size_ > 24) {
     thread_pool_size_ = 24;
   }
+  thread_pool_shards_ = 1;
+  GetConfInt("thread-pool-shards", &thread_pool_shards_);
+  if (thread_pool_shards_ <= 0) {
+    thread_pool_shards_ = 1;
+  }
+  if (thread_pool_shards_ > thread_pool_size_) {
+    thread_pool_shards_ = thread_pool_size_;
+  }
+  prior_thread_pool_size_ = 0;
+  GetConfInt("prior-thread-pool-size", &prior_thread_pool_size_);
+  if (prior_thread_pool_size_ < 0) {
+    prior_thread_pool_size_ = 0;
+  }
+  if (prior_thread_pool_size_ > 24) {
+    prior_thread_pool_size_ = 24;
+  }
+  slow_thread_pool_size_ = 0;
+  GetConfInt("slow-thread-pool-size", &slow_thread_pool_size_);
+  if (slow_thread_pool_size_ < 0) {
+    slow_thread_pool_size_ = 0;
+  }
+  if (slow_thread_pool_size_ > 24) {
+    slow_thread_pool_size_ = 24;
+  }
+  std::string rbp;
+  GetConfStr("thread-pool-route-by-partition", &rbp);
+  thread_pool_route_by_partition_.store(rbp == "yes" ? true : false);
   GetConfInt("sync-thread-num", &sync_thread_num_);
   if (sync_thread_num_ <= 0) {
     sync_thread_num_ = 3;
@@ -206,6 +319,14 @@ int PikaConf::Load()
   if (sync_thread_num_ > 24) {
     sync_thread_num_ = 24;
   }
+  sync_apply_thread_num_ = 0;
+  GetConfInt("sync-apply-thread-num", &sync_apply_thread_num_);
+  if (sync_apply_thread_num_ <= 0) {
+    sync_apply_thread_num_ = sync_thread_num_;
+  }
+  if (sync_apply_thread_num_ > 24) {
+    sync_apply_thread_num_ = 24;
+  }
 
   std::string instance_mode;
   GetConfStr("instance-mode", &instance_mode);
@@ -230,7 +351,18 @@ int PikaConf::Load()
     }
     std::string pika_meta_path = db_path_ + kPikaMeta;
     if (!slash::FileExists(pika_meta_path)) {
-      local_meta_->StableSave({{"db0", static_cast<uint32_t>(default_slot_num_), {}}});
+      // Only a new table takes it, the meta file keeps it afterwards
+      std::string key_hash_str;
+      GetConfStr("sharding-key-hash", &key_hash_str);
+      KeyHashType key_hash = kKeyHashCrc32;
+      if (!key_hash_str.empty() && !KeyHashFromString(key_hash_str, &key_hash)) {
+        LOG(FATAL) << "config sharding-key-hash error,"
+            << " it should be crc32 or crc32c, the actual is: " << key_hash_str;
+      }
+      std::string hash_tag;
+      GetConfStr("sharding-hash-tag", &hash_tag);
+      local_meta_->StableSave({{"db0", static_cast<uint32_t>(default_slot_num_),
+                                {}, {}, key_hash, hash_tag == "yes"}});
     }
     Status s = local_meta_->ParseMeta(&table_structs_);
     if (!s.ok()) {
@@ -306,6 +438,13 @@ int PikaConf::Load()
     max_client_response_size_ = 1073741824; // 1Gb
   }
 
+  // inline_exec_queue_threshold
+  inline_exec_queue_threshold_ = 0;
+  GetConfInt("inline-exec-queue-threshold", &inline_exec_queue_threshold_);
+  if (inline_exec_queue_threshold_ < 0) {
+    inline_exec_queue_threshold_ = 0;
+  }
+
   // target_file_size_base
   GetConfInt("target-file-size-base", &target_file_size_base_);
   if (target_file_size_base_ <= 0) {
@@ -396,6 +535,48 @@ int PikaConf::Load()
     || static_cast<int64_t>(binlog_file_size_) > (1024LL * 1024 * 1024)) {
     binlog_file_size_ = 100 * 1024 * 1024;    // 100M
   }
+  std::string bgc;
+  GetConfStr("binlog-group-commit", &bgc);
+  binlog_group_commit_.store(bgc == "yes" ? true : false);
+  std::string bsp = "no";
+  GetConfStr("binlog-sync-policy", &bsp);
+  if (bsp == "always") {
+    binlog_sync_policy_.store(kBinlogSyncAlways);
+  } else if (bsp == "everysec") {
+    binlog_sync_policy_.store(kBinlogSyncEverysec);
+  } else {
+    binlog_sync_policy_.store(kBinlogSyncNo);
+  }
+  int64_t tmp_binlog_cache_size = 4 * 1024 * 1024;    // 4M
+  GetConfInt64("binlog-cache-size", &tmp_binlog_cache_size);
+  if (tmp_binlog_cache_size < 0) {
+    tmp_binlog_cache_size = 0;
+  }
+  binlog_cache_size_.store(tmp_binlog_cache_size);
+  int tmp_binlog_ack_batch_items = 512;
+  GetConfInt("binlog-ack-batch-items", &tmp_binlog_ack_batch_items);
+  if (tmp_binlog_ack_batch_items < 0) {
+    tmp_binlog_ack_batch_items = 0;
+  }
+  binlog_ack_batch_items_.store(tmp_binlog_ack_batch_items);
+  int tmp_binlog_ack_interval_us = 1000;
+  GetConfInt("binlog-ack-interval-us", &tmp_binlog_ack_interval_us);
+  if (tmp_binlog_ack_interval_us < 0) {
+    tmp_binlog_ack_interval_us = 0;
+  }
+  binlog_ack_interval_us_.store(tmp_binlog_ack_interval_us);
+  replication_compression_ = "none";
+  GetConfStr("replication-compression", &replication_compression_);
+  InnerMessage::CompressionType compression;
+  if (!BinlogCompressionFromString(replication_compression_, &compression)) {
+    LOG(WARNING) << "replication-compression " << replication_compression_
+      << " unknown, use none";
+    replication_compression_ = "none";
+  } else if (!BinlogCompressionSupported(compression)) {
+    LOG(WARNING) << "replication-compression " << replication_compression_
+      << " not compiled in, use none";
+    replication_compression_ = "none";
+  }
   GetConfStr("pidfile", &pidfile_);
 
   // db sync
@@ -437,9 +618,41 @@ int PikaConf::Load()
     max_conn_rbuf_size_.store(PIKA_MAX_CONN_RBUF);
   }
 
+  {
+  RWLock l(&rwlock_, true);
+  PublishSnapshot();
+  }
   return ret;
 }
 
+std::string PikaConf::binlog_sync_policy_str() {
+  switch (binlog_sync_policy_.load()) {
+    case kBinlogSyncAlways:
+      return "always";
+    case kBinlogSyncEverysec:
+      return "everysec";
+    default:
+      return "no";
+  }
+}
+
+bool PikaConf::SetBinlogSyncPolicy(const std::string& value) {
+  BinlogSyncPolicy policy;
+  if (value == "no") {
+    policy = kBinlogSyncNo;
+  } else if (value == "everysec") {
+    policy = kBinlogSyncEverysec;
+  } else if (value == "always") {
+    policy = kBinlogSyncAlways;
+  } else {
+    return false;
+  }
+  RWLock l(&rwlock_, true);
+  TryPushDiffCommands("binlog-sync-policy", value);
+  binlog_sync_policy_.store(policy);
+  return true;
+}
+
 void PikaConf::TryPushDiffCommands(const std::string& command, const std::string& value) {
   if (!CheckConfExist(command)) {
     diff_commands_[command] = value;
@@ -466,9 +679,17 @@ int PikaConf::ConfigRewrite() {
   SetConfInt("slowlog-log-slower-than", slowlog_log_slower_than_.load());
   SetConfInt("slowlog-max-len", slowlog_max_len_);
   SetConfStr("write-binlog", write_binlog_ ? "yes" : "no");
+  SetConfStr("binlog-group-commit", binlog_group_commit_.load() ? "yes" : "no");
+  SetConfStr("thread-pool-route-by-partition", thread_pool_route_by_partition_.load() ? "yes" : "no");
+  SetConfStr("binlog-sync-policy", binlog_sync_policy_str());
+  SetConfInt64("binlog-cache-size", binlog_cache_size_.load());
+  SetConfInt("binlog-ack-batch-items", binlog_ack_batch_items_.load());
+  SetConfInt("binlog-ack-interval-us", binlog_ack_interval_us_.load());
+  SetConfStr("replication-compression", replication_compression_);
   SetConfInt("max-cache-statistic-keys", max_cache_statistic_keys_);
   SetConfInt("small-compaction-threshold", small_compaction_threshold_);
   SetConfInt("max-client-response-size", max_client_response_size_);
+  SetConfInt("inline-exec-queue-threshold", inline_exec_queue_threshold_);
   SetConfInt("db-sync-speed", db_sync_speed_);
   SetConfStr("compact-cron", compact_cron_);
   SetConfStr("compact-interval", compact_interval_);
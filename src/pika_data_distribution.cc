@@ -5,6 +5,13 @@
 
 #include "include/pika_data_distribution.h"
 
+#include <string.h>
+#include <strings.h>
+
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
+
 void HashModulo::Init() {
 }
 
@@ -46,3 +53,79 @@ uint32_t Crc32::Crc32Update(uint32_t crc, const char* buf, int len) {
   }
   return ~crc;
 }
+
+void Crc32c::Init() {
+#ifndef __SSE4_2__
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int j = 0; j < 8; j++) {
+      crc = (crc & 1) ? (crc >> 1) ^ CASTAGNOLI_POLY : (crc >> 1);
+    }
+    crc32ctab[i] = crc;
+  }
+#endif
+}
+
+uint32_t Crc32c::Distribute(const std::string& str, uint32_t partition_num) {
+  if (partition_num <= 1) {
+    return 0;
+  }
+  uint32_t crc = Crc32cUpdate(0, str.data(), str.size());
+  return crc & (partition_num - 1);
+}
+
+uint32_t Crc32c::Crc32cUpdate(uint32_t crc, const char* buf, size_t len) {
+  crc = ~crc;
+#ifdef __SSE4_2__
+  uint64_t crc64 = crc;
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, buf, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    buf += sizeof(uint64_t);
+  }
+  crc = static_cast<uint32_t>(crc64);
+  for (; len > 0; len--) {
+    crc = _mm_crc32_u8(crc, static_cast<uint8_t>(*buf++));
+  }
+#else
+  for (; len > 0; len--) {
+    crc = crc32ctab[(crc ^ static_cast<uint8_t>(*buf++)) & 0xff] ^ (crc >> 8);
+  }
+#endif
+  return ~crc;
+}
+
+bool KeyHashFromString(const std::string& name, KeyHashType* type) {
+  if (!strcasecmp(name.data(), "crc32")) {
+    *type = kKeyHashCrc32;
+  } else if (!strcasecmp(name.data(), "crc32c")) {
+    *type = kKeyHashCrc32c;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+std::string KeyHashToString(KeyHashType type) {
+  switch (type) {
+    case kKeyHashCrc32c:
+      return "crc32c";
+    default:
+      return "crc32";
+  }
+}
+
+bool HashTagOf(const std::string& key, size_t* pos, size_t* len) {
+  size_t begin = key.find('{');
+  if (begin == std::string::npos) {
+    return false;
+  }
+  size_t end = key.find('}', begin + 1);
+  if (end == std::string::npos || end == begin + 1) {
+    return false;
+  }
+  *pos = begin + 1;
+  *len = end - begin - 1;
+  return true;
+}
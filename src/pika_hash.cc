@@ -8,6 +8,7 @@
 #include "slash/include/slash_string.h"
 
 #include "include/pika_conf.h"
+#include "include/pika_client_conn.h"
 
 extern PikaConf *g_pika_conf;
 
@@ -118,7 +119,12 @@ void HGetallCmd::Do(std::shared_ptr<Partition> partition) {
       total_fv += fvs.size();
       cursor = next_cursor;
     }
-  } while (cursor != 0);
+  } while (cursor != 0 && raw.size() < kReplyStreamChunkSize);
+
+  if (cursor != 0) {
+    StreamReply(partition, cursor, total_fv, raw.size());
+    return;
+  }
 
   if (s.ok() || s.IsNotFound()) {
     res_.AppendArrayLen(total_fv * 2);
@@ -129,6 +135,53 @@ void HGetallCmd::Do(std::shared_ptr<Partition> partition) {
   return;
 }
 
+void HGetallCmd::StreamReply(std::shared_ptr<Partition> partition,
+                             int64_t cursor, int64_t total_fv, size_t raw_size) {
+  size_t raw_limit = g_pika_conf->max_client_response_size();
+  int64_t next_cursor = 0;
+  rocksdb::Status s;
+  std::vector<blackwidow::FieldValue> fvs;
+  // Count the rest first, the array length goes before any field
+  do {
+    fvs.clear();
+    s = partition->db()->HScan(key_, cursor, "*", PIKA_SCAN_STEP_LENGTH, &fvs, &next_cursor);
+    if (!s.ok() && !s.IsNotFound()) {
+      res_.SetRes(CmdRes::kErrOther, s.ToString());
+      return;
+    }
+    for (const auto& fv : fvs) {
+      raw_size += ReplyStream::BulkSize(fv.field.size())
+        + ReplyStream::BulkSize(fv.value.size());
+    }
+    if (raw_size >= raw_limit) {
+      res_.SetRes(CmdRes::kErrOther, "Response exceeds the max-client-response-size limit");
+      return;
+    }
+    total_fv += fvs.size();
+    cursor = next_cursor;
+  } while (s.ok() && cursor != 0);
+
+  ReplyStream stream(this, partition);
+  stream.AppendArrayLen(total_fv * 2);
+  int64_t sent = 0;
+  cursor = 0;
+  do {
+    fvs.clear();
+    s = partition->db()->HScan(key_, cursor, "*", PIKA_SCAN_STEP_LENGTH, &fvs, &next_cursor);
+    for (size_t i = 0; s.ok() && i < fvs.size() && sent < total_fv; ++i, ++sent) {
+      stream.AppendString(fvs[i].field);
+      stream.AppendString(fvs[i].value);
+    }
+    cursor = next_cursor;
+  } while (s.ok() && cursor != 0 && sent < total_fv);
+  // Fields deleted since counted, the array length is already sent
+  for (; sent < total_fv; ++sent) {
+    stream.AppendNil();
+    stream.AppendNil();
+  }
+  stream.Finish();
+}
+
 
 void HExistsCmd::DoInitial() {
   if (!CheckArg(argv_.size())) {
@@ -0,0 +1,64 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#include "include/pika_key_lock.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "slash/include/env.h"
+
+KeyLockTable::KeyLockTable()
+    : waits_(0), wait_us_(0) {
+  for (uint32_t i = 0; i < kKeyLockStripeNum; ++i) {
+    pthread_mutex_init(&stripes_[i].mu, NULL);
+  }
+}
+
+KeyLockTable::~KeyLockTable() {
+  for (uint32_t i = 0; i < kKeyLockStripeNum; ++i) {
+    pthread_mutex_destroy(&stripes_[i].mu);
+  }
+}
+
+void KeyLockTable::Lock(const std::vector<std::string>& keys,
+                        std::vector<uint32_t>* stripes) {
+  stripes->clear();
+  std::hash<std::string> hasher;
+  for (const auto& key : keys) {
+    stripes->push_back(hasher(key) & (kKeyLockStripeNum - 1));
+  }
+  std::sort(stripes->begin(), stripes->end());
+  stripes->erase(std::unique(stripes->begin(), stripes->end()), stripes->end());
+
+  for (uint32_t stripe : *stripes) {
+    if (pthread_mutex_trylock(&stripes_[stripe].mu) == 0) {
+      continue;
+    }
+    uint64_t start_us = slash::NowMicros();
+    pthread_mutex_lock(&stripes_[stripe].mu);
+    waits_.fetch_add(1, std::memory_order_relaxed);
+    wait_us_.fetch_add(slash::NowMicros() - start_us, std::memory_order_relaxed);
+  }
+}
+
+void KeyLockTable::LockAll(std::vector<uint32_t>* stripes) {
+  stripes->clear();
+  for (uint32_t stripe = 0; stripe < kKeyLockStripeNum; ++stripe) {
+    stripes->push_back(stripe);
+    pthread_mutex_lock(&stripes_[stripe].mu);
+  }
+}
+
+void KeyLockTable::Unlock(const std::vector<uint32_t>& stripes) {
+  for (auto iter = stripes.rbegin(); iter != stripes.rend(); ++iter) {
+    pthread_mutex_unlock(&stripes_[*iter].mu);
+  }
+}
+
+void KeyLockTable::ResetStatistic() {
+  waits_.store(0);
+  wait_us_.store(0);
+}
@@ -8,6 +8,7 @@
 #include "slash/include/slash_string.h"
 
 #include "include/pika_conf.h"
+#include "include/pika_client_conn.h"
 #include "include/pika_binlog_transverter.h"
 
 extern PikaConf *g_pika_conf;
@@ -101,15 +102,15 @@ void SetCmd::Do(std::shared_ptr<Partition> partition) {
   }
 }
 
-std::string SetCmd::ToBinlog(
+void SetCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
   if (condition_ == SetCmd::kEXORPX) {
     std::string content;
-    content.reserve(RAW_ARGS_LEN);
     RedisAppendLen(content, 4, "*");
 
     // to pksetexat cmd
@@ -129,16 +130,17 @@ std::string SetCmd::ToBinlog(
     // value
     RedisAppendLen(content, value_.size(), "$");
     RedisAppendContent(content, value_);
-    return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                               exec_time,
-                                               std::stoi(server_id),
-                                               logic_id,
-                                               filenum,
-                                               offset,
-                                               content,
-                                               {});
+    PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                        exec_time,
+                                        std::stoi(server_id),
+                                        logic_id,
+                                        filenum,
+                                        offset,
+                                        content,
+                                        {},
+                                        binlog);
   } else {
-    return Cmd::ToBinlog(exec_time, server_id, logic_id, filenum, offset);
+    Cmd::ToBinlog(exec_time, server_id, logic_id, filenum, offset, binlog);
   }
 }
 
@@ -435,10 +437,45 @@ void KeysCmd::Do(std::shared_ptr<Partition> partition) {
       return;
     }
     total_key += keys.size();
+  } while (cursor != 0 && raw.size() < kReplyStreamChunkSize);
+
+  if (cursor == 0) {
+    res_.AppendArrayLen(total_key);
+    res_.AppendStringRaw(raw);
+    return;
+  }
+
+  // Too many to be held in memory, count the rest, then stream them all
+  size_t raw_size = raw.size();
+  std::string().swap(raw);
+  do {
+    keys.clear();
+    cursor = partition->db()->Scan(type_, cursor, pattern_, PIKA_SCAN_STEP_LENGTH, &keys);
+    for (const auto& key : keys) {
+      raw_size += ReplyStream::BulkSize(key.size());
+    }
+    if (raw_size >= raw_limit) {
+      res_.SetRes(CmdRes::kErrOther, "Response exceeds the max-client-response-size limit");
+      return;
+    }
+    total_key += keys.size();
   } while (cursor != 0);
 
-  res_.AppendArrayLen(total_key);
-  res_.AppendStringRaw(raw);
+  ReplyStream stream(this, partition);
+  stream.AppendArrayLen(total_key);
+  int64_t sent = 0;
+  do {
+    keys.clear();
+    cursor = partition->db()->Scan(type_, cursor, pattern_, PIKA_SCAN_STEP_LENGTH, &keys);
+    for (size_t i = 0; i < keys.size() && sent < total_key; ++i, ++sent) {
+      stream.AppendString(keys[i]);
+    }
+  } while (cursor != 0 && sent < total_key);
+  // Keys deleted since counted, the array length is already sent
+  for (; sent < total_key; ++sent) {
+    stream.AppendNil();
+  }
+  stream.Finish();
   return;
 }
 
@@ -463,15 +500,15 @@ void SetnxCmd::Do(std::shared_ptr<Partition> partition) {
   return;
 }
 
-std::string SetnxCmd::ToBinlog(
+void SetnxCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
   std::string content;
   if (success_) {
-    content.reserve(RAW_ARGS_LEN);
     RedisAppendLen(content, 3, "*");
 
     // to set cmd
@@ -485,16 +522,18 @@ std::string SetnxCmd::ToBinlog(
     RedisAppendLen(content, value_.size(), "$");
     RedisAppendContent(content, value_);
 
-    return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                               exec_time,
-                                               std::stoi(server_id),
-                                               logic_id,
-                                               filenum,
-                                               offset,
-                                               content,
-                                               {});
+    PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                        exec_time,
+                                        std::stoi(server_id),
+                                        logic_id,
+                                        filenum,
+                                        offset,
+                                        content,
+                                        {},
+                                        binlog);
+  } else {
+    binlog->clear();
   }
-  return content;
 }
 
 void SetexCmd::DoInitial() {
@@ -520,15 +559,15 @@ void SetexCmd::Do(std::shared_ptr<Partition> partition) {
   }
 }
 
-std::string SetexCmd::ToBinlog(
+void SetexCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
 
   std::string content;
-  content.reserve(RAW_ARGS_LEN);
   RedisAppendLen(content, 4, "*");
 
   // to pksetexat cmd
@@ -548,14 +587,15 @@ std::string SetexCmd::ToBinlog(
   // value
   RedisAppendLen(content, value_.size(), "$");
   RedisAppendContent(content, value_);
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
+  PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                      exec_time,
+                                      std::stoi(server_id),
+                                      logic_id,
+                                      filenum,
+                                      offset,
+                                      content,
+                                      {},
+                                      binlog);
 }
 
 void PsetexCmd::DoInitial() {
@@ -581,15 +621,15 @@ void PsetexCmd::Do(std::shared_ptr<Partition> partition) {
   }
 }
 
-std::string PsetexCmd::ToBinlog(
+void PsetexCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
 
   std::string content;
-  content.reserve(RAW_ARGS_LEN);
   RedisAppendLen(content, 4, "*");
 
   // to pksetexat cmd
@@ -609,14 +649,15 @@ std::string PsetexCmd::ToBinlog(
   // value
   RedisAppendLen(content, value_.size(), "$");
   RedisAppendContent(content, value_);
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
+  PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                      exec_time,
+                                      std::stoi(server_id),
+                                      logic_id,
+                                      filenum,
+                                      offset,
+                                      content,
+                                      {},
+                                      binlog);
 }
 
 void DelvxCmd::DoInitial() {
@@ -809,14 +850,14 @@ void ExpireCmd::Do(std::shared_ptr<Partition> partition) {
   return;
 }
 
-std::string ExpireCmd::ToBinlog(
+void ExpireCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
   std::string content;
-  content.reserve(RAW_ARGS_LEN);
   RedisAppendLen(content, 3, "*");
 
   // to expireat cmd
@@ -834,14 +875,15 @@ std::string ExpireCmd::ToBinlog(
   RedisAppendLen(content, at.size(), "$");
   RedisAppendContent(content, at);
 
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
+  PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                      exec_time,
+                                      std::stoi(server_id),
+                                      logic_id,
+                                      filenum,
+                                      offset,
+                                      content,
+                                      {},
+                                      binlog);
 }
 
 void PexpireCmd::DoInitial() {
@@ -868,14 +910,14 @@ void PexpireCmd::Do(std::shared_ptr<Partition> partition) {
   return;
 }
 
-std::string PexpireCmd::ToBinlog(
+void PexpireCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
   std::string content;
-  content.reserve(RAW_ARGS_LEN);
   RedisAppendLen(content, argv_.size(), "*");
 
   // to expireat cmd
@@ -893,14 +935,15 @@ std::string PexpireCmd::ToBinlog(
   RedisAppendLen(content, at.size(), "$");
   RedisAppendContent(content, at);
 
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
+  PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                      exec_time,
+                                      std::stoi(server_id),
+                                      logic_id,
+                                      filenum,
+                                      offset,
+                                      content,
+                                      {},
+                                      binlog);
 }
 
 void ExpireatCmd::DoInitial() {
@@ -939,14 +982,14 @@ void PexpireatCmd::DoInitial() {
   return;
 }
 
-std::string PexpireatCmd::ToBinlog(
+void PexpireatCmd::ToBinlog(
       uint32_t exec_time,
       const std::string& server_id,
       uint64_t logic_id,
       uint32_t filenum,
-      uint64_t offset) {
+      uint64_t offset,
+      std::string* binlog) {
   std::string content;
-  content.reserve(RAW_ARGS_LEN);
   RedisAppendLen(content, argv_.size(), "*");
 
   // to expireat cmd
@@ -964,14 +1007,15 @@ std::string PexpireatCmd::ToBinlog(
   RedisAppendLen(content, at.size(), "$");
   RedisAppendContent(content, at);
 
-  return PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
-                                             exec_time,
-                                             std::stoi(server_id),
-                                             logic_id,
-                                             filenum,
-                                             offset,
-                                             content,
-                                             {});
+  PikaBinlogTransverter::BinlogEncode(BinlogType::TypeFirst,
+                                      exec_time,
+                                      std::stoi(server_id),
+                                      logic_id,
+                                      filenum,
+                                      offset,
+                                      content,
+                                      {},
+                                      binlog);
 }
 
 void PexpireatCmd::Do(std::shared_ptr<Partition> partition) {
@@ -1178,7 +1222,8 @@ void ScanCmd::Do(std::shared_ptr<Partition> partition) {
       return;
     }
     total_key += keys.size();
-  } while (cursor_ret != 0 && left);
+    // COUNT is only a hint, a huge reply is cut and continued by the cursor
+  } while (cursor_ret != 0 && left && raw.size() < kReplyStreamChunkSize);
 
   res_.AppendArrayLen(2);
 
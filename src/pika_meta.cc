@@ -53,6 +53,17 @@ Status PikaMeta::StableSave(const std::vector<TableStruct>& table_structs) {
     for (const auto& id : ts.partition_ids) {
       table_info->add_partition_ids(id);
     }
+    for (const auto& item : ts.hash_mods) {
+      InnerMessage::PartitionHashMod* hash_mod = table_info->add_hash_mods();
+      hash_mod->set_partition_id(item.first);
+      hash_mod->set_hash_mod(item.second);
+    }
+    table_info->set_key_hash(ts.key_hash == kKeyHashCrc32c
+        ? InnerMessage::kCrc32c : InnerMessage::kCrc32);
+    table_info->set_hash_tag(ts.hash_tag);
+    for (const auto& id : ts.split_cleaning) {
+      table_info->add_split_cleaning(id);
+    }
   }
 
   std::string meta_str;
@@ -125,7 +136,17 @@ Status PikaMeta::ParseMeta(std::vector<TableStruct>* const table_structs) {
     for (int sidx = 0; sidx < ti.partition_ids_size(); ++sidx) {
       partition_ids.insert(ti.partition_ids(sidx));
     }
-    table_structs->emplace_back(ti.table_name(), ti.partition_num(), partition_ids);
+    std::map<uint32_t, uint32_t> hash_mods;
+    for (int sidx = 0; sidx < ti.hash_mods_size(); ++sidx) {
+      hash_mods[ti.hash_mods(sidx).partition_id()] = ti.hash_mods(sidx).hash_mod();
+    }
+    KeyHashType key_hash = ti.key_hash() == InnerMessage::kCrc32c
+      ? kKeyHashCrc32c : kKeyHashCrc32;
+    table_structs->emplace_back(ti.table_name(), ti.partition_num(),
+                                partition_ids, hash_mods, key_hash, ti.hash_tag());
+    for (int sidx = 0; sidx < ti.split_cleaning_size(); ++sidx) {
+      table_structs->back().split_cleaning.insert(ti.split_cleaning(sidx));
+    }
   }
   return Status::OK();
 }
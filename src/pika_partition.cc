@@ -10,9 +10,11 @@
 #include "include/pika_conf.h"
 #include "include/pika_server.h"
 #include "include/pika_rm.h"
+#include "include/pika_cmd_table_manager.h"
 
 #include "slash/include/mutex_impl.h"
 
+extern PikaCmdTableManager* g_pika_cmd_table_manager;
 extern PikaConf* g_pika_conf;
 extern PikaServer* g_pika_server;
 extern PikaReplicaManager* g_pika_rm;
@@ -56,10 +58,17 @@ std::string DbSyncPath(const std::string& sync_path,
 Partition::Partition(const std::string& table_name,
                      uint32_t partition_id,
                      const std::string& table_db_path,
-                     const std::string& table_log_path) :
+                     const std::string& table_log_path,
+                     KeyHashType key_hash,
+                     bool hash_tag) :
   table_name_(table_name),
   partition_id_(partition_id),
+  key_hash_(key_hash),
+  hash_tag_(hash_tag),
   binlog_io_error_(false),
+  binlog_produced_(false),
+  hash_mod_(0),
+  keys_dirty_(true),
   bgsave_engine_(NULL),
   purging_(false) {
 
@@ -84,7 +93,7 @@ Partition::Partition(const std::string& table_name,
   db_ = std::shared_ptr<blackwidow::BlackWidow>(new blackwidow::BlackWidow());
   rocksdb::Status s = db_->Open(g_pika_server->bw_options(), db_path_);
 
-  lock_mgr_ = new slash::lock::LockMgr(1000, 0, std::make_shared<slash::lock::MutexFactoryImpl>());
+  key_locks_ = new KeyLockTable();
 
   opened_ = s.ok() ? true : false;
   assert(db_);
@@ -99,7 +108,7 @@ Partition::~Partition() {
   Close();
   delete bgsave_engine_;
   pthread_rwlock_destroy(&db_rwlock_);
-  delete lock_mgr_;
+  delete key_locks_;
 }
 
 void Partition::Leave() {
@@ -169,7 +178,7 @@ std::shared_ptr<blackwidow::BlackWidow> Partition::db() const {
   return db_;
 }
 
-Status Partition::WriteBinlog(const std::string& binlog) {
+Status Partition::WriteBinlog(const Slice& binlog) {
   if (!opened_) {
     LOG(WARNING) << partition_name_ << " not opened, failed to exec command";
     return Status::Corruption("Partition Not Opened");
@@ -184,9 +193,50 @@ Status Partition::WriteBinlog(const std::string& binlog) {
     SetBinlogIoError(true);
     return Status::Corruption("Writing binlog failed, maybe no space left on device");
   }
+  NotifyBinlogProduced();
   return Status::OK();
 }
 
+Status Partition::GroupWriteBinlog(std::string* binlog) {
+  if (!opened_) {
+    LOG(WARNING) << partition_name_ << " not opened, failed to exec command";
+    return Status::Corruption("Partition Not Opened");
+  }
+  slash::Status s;
+  if (!binlog->empty()) {
+    s = logger_->GroupPut(binlog);
+  }
+
+  if (!s.ok()) {
+    LOG(WARNING) << partition_name_ << " Writing binlog failed, maybe no space left on device";
+    SetBinlogIoError(true);
+    return Status::Corruption("Writing binlog failed, maybe no space left on device");
+  }
+  NotifyBinlogProduced();
+  return Status::OK();
+}
+
+void Partition::NotifyBinlogProduced() {
+  if (!binlog_produced_.load() && !binlog_produced_.exchange(true)) {
+    g_pika_rm->SignalBinlogProduced(PartitionInfo(table_name_, partition_id_));
+  }
+}
+
+void Partition::ClearBinlogProduced() {
+  binlog_produced_.store(false);
+}
+
+Status Partition::SyncBinlog() {
+  if (!opened_) {
+    return Status::Corruption("Partition Not Opened");
+  }
+  Status s = logger_->Sync();
+  if (!s.ok()) {
+    LOG(WARNING) << partition_name_ << " Sync binlog failed: " << s.ToString();
+  }
+  return s;
+}
+
 void Partition::Compact(const blackwidow::DataType& type) {
   if (!opened_) return;
   db_->Compact(type);
@@ -204,8 +254,41 @@ void Partition::DbRWUnLock() {
   pthread_rwlock_unlock(&db_rwlock_);
 }
 
-slash::lock::LockMgr* Partition::LockMgr() {
-  return lock_mgr_;
+KeyLockTable* Partition::KeyLocks() {
+  return key_locks_;
+}
+
+uint32_t Partition::hash_mod() const {
+  return hash_mod_.load(std::memory_order_acquire);
+}
+
+void Partition::SetHashMod(uint32_t hash_mod) {
+  hash_mod_.store(hash_mod, std::memory_order_release);
+}
+
+bool Partition::OwnsKey(const std::string& key) const {
+  uint32_t hash_mod = hash_mod_.load(std::memory_order_acquire);
+  return hash_mod == 0
+    || g_pika_cmd_table_manager->DistributeKey(
+      key, hash_mod, key_hash_, hash_tag_) == partition_id_;
+}
+
+Status Partition::Checkpoint(const std::string& path) {
+  blackwidow::BackupEngine* engine = NULL;
+  rocksdb::Status s = blackwidow::BackupEngine::Open(db().get(), &engine);
+  if (s.ok()) {
+    s = engine->SetBackupContent();
+  }
+  if (s.ok()) {
+    slash::CreatePath(path, 0755);
+    s = engine->CreateNewBackup(path);
+  }
+  delete engine;
+  if (!s.ok()) {
+    slash::DeleteDirIfExist(path);
+    return Status::Corruption(partition_name_ + " checkpoint failed, " + s.ToString());
+  }
+  return Status::OK();
 }
 
 void Partition::SetBinlogIoError(bool error) {
@@ -363,6 +446,7 @@ bool Partition::ChangeDb(const std::string& new_path) {
   assert(db_);
   assert(s.ok());
   slash::DeleteDirIfExist(tmp_path);
+  MarkKeysDirty();
   LOG(INFO) << "Partition: " << partition_name_ << ", Change db success";
   return true;
 }
@@ -519,6 +603,13 @@ bool Partition::FlushDB() {
   assert(s.ok());
   LOG(INFO) << partition_name_ << " Open new db success";
   g_pika_server->PurgeDir(dbpath);
+  {
+    slash::MutexLock l(&key_info_protector_);
+    if (!key_scan_info_.key_scaning_) {
+      key_scan_info_.key_infos.assign(key_scan_info_.key_infos.size(), blackwidow::KeyInfo());
+      keys_dirty_.store(false);
+    }
+  }
   return true;
 }
 
@@ -547,6 +638,7 @@ bool Partition::FlushSubDB(const std::string& db_name) {
   assert(s.ok());
   LOG(INFO) << partition_name_ << " open new " + db_name + " db success";
   g_pika_server->PurgeDir(del_dbpath);
+  MarkKeysDirty();
   return true;
 }
 
@@ -656,21 +748,51 @@ KeyScanInfo Partition::GetKeyScanInfo() {
 }
 
 Status Partition::GetKeyNum(std::vector<blackwidow::KeyInfo>* key_info) {
-  slash::MutexLock l(&key_info_protector_);
-  if (key_scan_info_.key_scaning_) {
-    *key_info = key_scan_info_.key_infos;
-    return Status::OK();
-  }
-  InitKeyScan();
-  key_scan_info_.key_scaning_ = true;
-  key_scan_info_.duration = -2;   // duration -2 mean the task in waiting status,
-                                  // has not been scheduled for exec
+  {
+    slash::MutexLock l(&key_info_protector_);
+    if (key_scan_info_.key_scaning_) {
+      *key_info = key_scan_info_.key_infos;
+      return Status::OK();
+    }
+    InitKeyScan();
+    key_scan_info_.key_scaning_ = true;
+    key_scan_info_.duration = -2;   // duration -2 mean the task in waiting status,
+                                    // has not been scheduled for exec
+  }
+  // Writes from now on count as changes after this count
+  keys_dirty_.store(false);
+  // The former count stays readable while scanning
   rocksdb::Status s = db_->GetKeyNum(key_info);
+  slash::MutexLock l(&key_info_protector_);
+  key_scan_info_.key_scaning_ = false;
   if (!s.ok()) {
+    keys_dirty_.store(true);
     return Status::Corruption(s.ToString());
   }
   key_scan_info_.key_infos = *key_info;
   key_scan_info_.duration = time(NULL) - key_scan_info_.start_time;
-  key_scan_info_.key_scaning_ = false;
   return Status::OK();
 }
+
+void Partition::MarkKeysDirty() {
+  // Checked first, written partitions mostly are dirty already
+  if (!keys_dirty_.load(std::memory_order_relaxed)) {
+    keys_dirty_.store(true, std::memory_order_relaxed);
+  }
+}
+
+Status Partition::RefreshKeyNum() {
+  if (!keys_dirty_.load()) {
+    slash::MutexLock l(&key_info_protector_);
+    bool expires = false;
+    for (const auto& key_info : key_scan_info_.key_infos) {
+      expires = expires || key_info.expires > 0;
+    }
+    if (!expires
+      || time(NULL) - key_scan_info_.start_time < kKeyNumExpireRecountSec) {
+      return Status::OK();
+    }
+  }
+  std::vector<blackwidow::KeyInfo> key_info;
+  return GetKeyNum(&key_info);
+}
@@ -96,6 +96,7 @@ void PikaReplBgWorker::HandleBGWorkerWriteBinlog(void* arg) {
     if ((g_pika_conf->classic_mode() && !(g_pika_server->role() & PIKA_ROLE_SLAVE))
       || ((slave_partition->State() != ReplState::kConnected)
          && (slave_partition->State() != ReplState::kWaitDBSync))) {
+      worker->ApplyBatch(partition);
       delete index;
       delete task_arg;
       return;
@@ -109,6 +110,7 @@ void PikaReplBgWorker::HandleBGWorkerWriteBinlog(void* arg) {
           << binlog_res.partition().table_name()
           << "_" << binlog_res.partition().partition_id();
       slave_partition->SetReplState(ReplState::kTryConnect);
+      worker->ApplyBatch(partition);
       delete index;
       delete task_arg;
       return;
@@ -121,6 +123,7 @@ void PikaReplBgWorker::HandleBGWorkerWriteBinlog(void* arg) {
     if (!PikaBinlogTransverter::BinlogItemWithoutContentDecode(TypeFirst, binlog_res.binlog(), &worker->binlog_item_)) {
       LOG(WARNING) << "Binlog item decode failed";
       slave_partition->SetReplState(ReplState::kTryConnect);
+      worker->ApplyBatch(partition);
       delete index;
       delete task_arg;
       return;
@@ -132,16 +135,22 @@ void PikaReplBgWorker::HandleBGWorkerWriteBinlog(void* arg) {
       redis_parser_start, redis_parser_len, &processed_len);
     if (ret != pink::kRedisParserDone) {
       LOG(WARNING) << "Redis parser failed";
+      worker->cmds_.resize(worker->binlogs_.size());
       slave_partition->SetReplState(ReplState::kTryConnect);
+      worker->ApplyBatch(partition);
       delete index;
       delete task_arg;
       return;
     }
+    // The item is appended to local binlog as it is, without encoding again
+    worker->binlogs_.push_back(Slice(binlog_res.binlog()));
   }
+  uint64_t items = worker->binlogs_.size();
+  worker->ApplyBatch(partition);
   delete index;
   delete task_arg;
 
-  // Reply Ack to master immediately
+  // Ack to master, coalesced with acks of the following batches
   std::shared_ptr<Binlog> logger = partition->logger();
   logger->GetProducerStatus(&ack_end.filenum, &ack_end.offset);
   // keepalive case
@@ -149,13 +158,13 @@ void PikaReplBgWorker::HandleBGWorkerWriteBinlog(void* arg) {
     // set ack_end as 0
     ack_end = ack_start;
   }
-  g_pika_rm->SendPartitionBinlogSyncAckRequest(table_name, partition_id, ack_start, ack_end);
+  g_pika_rm->AddBinlogSyncAck(table_name, partition_id, ack_start, ack_end, items);
 }
 
 int PikaReplBgWorker::HandleWriteBinlog(pink::RedisParser* parser, const pink::RedisCmdArgsType& argv) {
   PikaReplBgWorker* worker = static_cast<PikaReplBgWorker*>(parser->data);
-  const BinlogItem& binlog_item = worker->binlog_item_;
-  g_pika_server->UpdateQueryNumAndExecCountTable(argv[0]);
+  int cmd_id = g_pika_cmd_table_manager->GetCmdId(argv);
+  g_pika_server->UpdateQueryNumAndExecCountTable(cmd_id);
 
   // Monitor related
   std::string monitor_message;
@@ -170,8 +179,8 @@ int PikaReplBgWorker::HandleWriteBinlog(pink::RedisParser* parser, const pink::R
     g_pika_server->AddMonitorMessage(monitor_message);
   }
 
-  std::string opt = argv[0];
-  std::shared_ptr<Cmd> c_ptr = g_pika_cmd_table_manager->GetCmd(slash::StringToLower(opt));
+  const std::string& opt = argv[0];
+  std::shared_ptr<Cmd> c_ptr = g_pika_cmd_table_manager->GetCmd(cmd_id);
   if (!c_ptr) {
     LOG(WARNING) << "Command " << opt << " not in the command table";
     return -1;
@@ -183,78 +192,59 @@ int PikaReplBgWorker::HandleWriteBinlog(pink::RedisParser* parser, const pink::R
     return -1;
   }
 
-  std::shared_ptr<Partition> partition = g_pika_server->GetTablePartitionById(worker->table_name_, worker->partition_id_);
-  std::shared_ptr<Binlog> logger = partition->logger();
+  worker->cmds_.push_back(c_ptr);
+  return 0;
+}
 
+void PikaReplBgWorker::ApplyBatch(const std::shared_ptr<Partition>& partition) {
+  if (binlogs_.empty()) {
+    return;
+  }
+  // One lock and one flush for the whole batch
+  std::shared_ptr<Binlog> logger = partition->logger();
   logger->Lock();
-  logger->Put(c_ptr->ToBinlog(binlog_item.exec_time(),
-                              std::to_string(binlog_item.server_id()),
-                              binlog_item.logic_id(),
-                              binlog_item.filenum(),
-                              binlog_item.offset()));
-  uint32_t filenum;
-  uint64_t offset;
-  logger->GetProducerStatus(&filenum, &offset);
+  Status s = logger->BatchPut(binlogs_);
   logger->Unlock();
+  if (!s.ok()) {
+    LOG(WARNING) << partition->GetPartitionName()
+      << " Writing binlog failed, maybe no space left on device " << s.ToString();
+  }
 
-  PikaCmdArgsType *v = new PikaCmdArgsType(argv);
-  BinlogItem *b = new BinlogItem(binlog_item);
-  std::string dispatch_key = argv.size() >= 2 ? argv[1] : argv[0];
-  g_pika_rm->ScheduleWriteDBTask(dispatch_key, v, b, worker->table_name_, worker->partition_id_);
-  return 0;
+  g_pika_rm->ScheduleWriteDBTask(partition, &cmds_);
+  binlogs_.clear();
+  cmds_.clear();
 }
 
 void PikaReplBgWorker::HandleBGWorkerWriteDB(void* arg) {
   ReplClientWriteDBTaskArg* task_arg = static_cast<ReplClientWriteDBTaskArg*>(arg);
-  PikaCmdArgsType* argv = task_arg->argv;
-  BinlogItem binlog_item = *(task_arg->binlog_item);
-  std::string table_name = task_arg->table_name;
-  uint32_t partition_id = task_arg->partition_id;
-  std::string opt = (*argv)[0];
-  slash::StringToLower(opt);
-
-  // Get command
-  std::shared_ptr<Cmd> c_ptr = g_pika_cmd_table_manager->GetCmd(slash::StringToLower(opt));
-  if (!c_ptr) {
-    LOG(WARNING) << "Error operation from binlog: " << opt;
-    delete task_arg;
-    return;
-  }
-
-  // Initial
-  c_ptr->Initial(*argv, table_name);
-  if (!c_ptr->res().ok()) {
-    LOG(WARNING) << "Fail to initial command from binlog: " << opt;
-    delete task_arg;
-    return;
-  }
-
-  uint64_t start_us = 0;
-  if (g_pika_conf->slowlog_slower_than() >= 0) {
-    start_us = slash::NowMicros();
-  }
-  std::shared_ptr<Partition> partition = g_pika_server->GetTablePartitionById(table_name, partition_id);
-  // Add read lock for no suspend command
-  if (!c_ptr->is_suspend()) {
-    partition->DbRWLockReader();
-  }
+  const std::shared_ptr<Partition>& partition = task_arg->partition;
 
-  c_ptr->Do(partition);
+  for (const auto& c_ptr : task_arg->cmds) {
+    uint64_t start_us = slash::NowMicros();
+    // Add read lock for no suspend command
+    if (!c_ptr->is_suspend()) {
+      partition->DbRWLockReader();
+    }
 
-  if (!c_ptr->is_suspend()) {
-    partition->DbRWUnLock();
-  }
+    c_ptr->Do(partition);
 
-  if (g_pika_conf->slowlog_slower_than() >= 0) {
-    int32_t start_time = start_us / 1000000;
-    int64_t duration = slash::NowMicros() - start_us;
-    if (duration > g_pika_conf->slowlog_slower_than()) {
-      g_pika_server->SlowlogPushEntry(*argv, start_time, duration);
-      if (g_pika_conf->slowlog_write_errorlog()) {
-        LOG(ERROR) << "command: " << opt << ", start_time(s): " << start_time << ", duration(us): " << duration;
+    if (!c_ptr->is_suspend()) {
+      partition->DbRWUnLock();
+    }
+    partition->MarkKeysDirty();
+    g_pika_server->UpdateCmdLatency(g_pika_cmd_table_manager->GetCmdId(c_ptr->name()),
+                                    slash::NowMicros() - start_us);
+
+    if (g_pika_conf->slowlog_slower_than() >= 0) {
+      int32_t start_time = start_us / 1000000;
+      int64_t duration = slash::NowMicros() - start_us;
+      if (duration > g_pika_conf->slowlog_slower_than()) {
+        g_pika_server->SlowlogPushEntry(c_ptr->argv(), start_time, duration);
+        if (g_pika_conf->slowlog_write_errorlog()) {
+          LOG(ERROR) << "command: " << c_ptr->name() << ", start_time(s): " << start_time << ", duration(us): " << duration;
+        }
       }
     }
   }
   delete task_arg;
 }
-
@@ -5,6 +5,8 @@
 
 #include "include/pika_repl_client.h"
 
+#include <algorithm>
+
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -12,19 +14,24 @@
 #include "pink/include/pink_cli.h"
 #include "pink/include/redis_cli.h"
 #include "slash/include/slash_coding.h"
+#include "slash/include/slash_mutex.h"
 #include "slash/include/env.h"
 #include "slash/include/slash_string.h"
 
 #include "include/pika_rm.h"
+#include "include/pika_data_distribution.h"
 #include "include/pika_server.h"
 
 extern PikaServer* g_pika_server;
 extern PikaReplicaManager* g_pika_rm;
 
-PikaReplClient::PikaReplClient(int cron_interval, int keepalive_timeout) : next_avail_(0) {
+PikaReplClient::PikaReplClient(int cron_interval, int keepalive_timeout)
+    : next_avail_(0),
+      binlog_worker_num_(g_pika_conf->sync_thread_num()),
+      apply_worker_num_(g_pika_conf->sync_apply_thread_num()) {
   client_thread_ = new PikaReplClientThread(cron_interval, keepalive_timeout);
   client_thread_->set_thread_name("PikaReplClient");
-  for (int i = 0; i < 2 * g_pika_conf->sync_thread_num(); ++i) {
+  for (int i = 0; i < binlog_worker_num_ + apply_worker_num_; ++i) {
     bg_workers_.push_back(new PikaReplBgWorker(PIKA_SYNC_BUFFER_SIZE));
   }
 }
@@ -69,24 +76,117 @@ void PikaReplClient::Schedule(pink::TaskFunc func, void* arg) {
 void PikaReplClient::ScheduleWriteBinlogTask(std::string table_partition,
     const std::shared_ptr<InnerMessage::InnerResponse> res,
     std::shared_ptr<pink::PbConn> conn, void* res_private_data) {
-  size_t index = GetHashIndex(table_partition, true);
+  size_t index = GetBinlogWorkerIndex(table_partition);
   ReplClientWriteBinlogTaskArg* task_arg =
     new ReplClientWriteBinlogTaskArg(res, conn, res_private_data, bg_workers_[index]);
   bg_workers_[index]->Schedule(&PikaReplBgWorker::HandleBGWorkerWriteBinlog, static_cast<void*>(task_arg));
 }
 
-void PikaReplClient::ScheduleWriteDBTask(const std::string& dispatch_key,
-    PikaCmdArgsType* argv, BinlogItem* binlog_item,
-    const std::string& table_name, uint32_t partition_id) {
-  size_t index = GetHashIndex(dispatch_key, false);
-  ReplClientWriteDBTaskArg* task_arg =
-    new ReplClientWriteDBTaskArg(argv, binlog_item, table_name, partition_id);
-  bg_workers_[index]->Schedule(&PikaReplBgWorker::HandleBGWorkerWriteDB, static_cast<void*>(task_arg));
+void PikaReplClient::ScheduleWriteDBTask(const std::shared_ptr<Partition>& partition,
+                                         std::vector<std::shared_ptr<Cmd>>* cmds) {
+  // One task per lane for the whole batch
+  std::vector<ReplClientWriteDBTaskArg*> lanes(bg_workers_.size(), NULL);
+  std::vector<size_t> all_lanes;
+  for (size_t index = binlog_worker_num_; index < bg_workers_.size(); ++index) {
+    all_lanes.push_back(index);
+  }
+  for (auto& c_ptr : *cmds) {
+    std::vector<size_t> cmd_lanes;
+    if (!GetApplyWorkerIndexes(c_ptr, &cmd_lanes)) {
+      cmd_lanes = all_lanes;
+    }
+    if (cmd_lanes.size() > 1) {
+      // Apply everything queued ahead of it on its lanes first, then
+      // apply it here in the binlog worker, the other lanes go on
+      for (const auto index : cmd_lanes) {
+        if (lanes[index] != NULL) {
+          bg_workers_[index]->Schedule(&PikaReplBgWorker::HandleBGWorkerWriteDB,
+                                       static_cast<void*>(lanes[index]));
+          lanes[index] = NULL;
+        }
+      }
+      DrainApplyWorkers(cmd_lanes);
+      ReplClientWriteDBTaskArg* task_arg = new ReplClientWriteDBTaskArg(partition);
+      task_arg->cmds.push_back(std::move(c_ptr));
+      PikaReplBgWorker::HandleBGWorkerWriteDB(static_cast<void*>(task_arg));
+      continue;
+    }
+    size_t index = cmd_lanes.front();
+    if (lanes[index] == NULL) {
+      lanes[index] = new ReplClientWriteDBTaskArg(partition);
+    }
+    lanes[index]->cmds.push_back(std::move(c_ptr));
+  }
+  ScheduleLanes(&lanes);
+}
+
+void PikaReplClient::ScheduleLanes(std::vector<ReplClientWriteDBTaskArg*>* lanes) {
+  for (size_t index = 0; index < lanes->size(); ++index) {
+    if ((*lanes)[index] != NULL) {
+      bg_workers_[index]->Schedule(&PikaReplBgWorker::HandleBGWorkerWriteDB,
+                                   static_cast<void*>((*lanes)[index]));
+      (*lanes)[index] = NULL;
+    }
+  }
+}
+
+struct ApplyBarrierArg {
+  slash::Mutex mu;
+  slash::CondVar cv;
+  int pending;
+  explicit ApplyBarrierArg(int _pending) : cv(&mu), pending(_pending) {}
+};
+
+static void HandleApplyBarrier(void* arg) {
+  ApplyBarrierArg* barrier = static_cast<ApplyBarrierArg*>(arg);
+  slash::MutexLock l(&barrier->mu);
+  if (--barrier->pending == 0) {
+    barrier->cv.Signal();
+  }
+}
+
+void PikaReplClient::DrainApplyWorkers(const std::vector<size_t>& indexes) {
+  // Lanes run their tasks in order, so once the barrier task is
+  // reached on a lane the tasks scheduled before it are applied
+  ApplyBarrierArg barrier(static_cast<int>(indexes.size()));
+  for (const auto index : indexes) {
+    bg_workers_[index]->Schedule(&HandleApplyBarrier, static_cast<void*>(&barrier));
+  }
+  slash::MutexLock l(&barrier.mu);
+  while (barrier.pending > 0) {
+    barrier.cv.Wait();
+  }
 }
 
-size_t PikaReplClient::GetHashIndex(std::string key, bool upper_half) {
-  size_t hash_base = bg_workers_.size() / 2;
-  return (str_hash(key) % hash_base) + (upper_half ? 0 : hash_base);
+size_t PikaReplClient::GetBinlogWorkerIndex(const std::string& table_partition) {
+  return str_hash(table_partition) % binlog_worker_num_;
+}
+
+size_t PikaReplClient::GetApplyWorkerIndex(const std::string& key) {
+  // Keys sharing a hash tag are applied on the same lane, so the
+  // multi key commands allowed on a slot seldom need a barrier
+  size_t tag_pos = 0, tag_len = 0;
+  if (HashTagOf(key, &tag_pos, &tag_len)) {
+    return (str_hash(key.substr(tag_pos, tag_len)) % apply_worker_num_) + binlog_worker_num_;
+  }
+  return (str_hash(key) % apply_worker_num_) + binlog_worker_num_;
+}
+
+bool PikaReplClient::GetApplyWorkerIndexes(const std::shared_ptr<Cmd>& c_ptr,
+                                           std::vector<size_t>* indexes) {
+  // Commands without keys, like FLUSHDB, and admin commands touch
+  // every lane
+  const std::vector<std::string>& keys = c_ptr->keys();
+  if (keys.empty() || c_ptr->is_admin()) {
+    return false;
+  }
+  for (const auto& key : keys) {
+    size_t index = GetApplyWorkerIndex(key);
+    if (std::find(indexes->begin(), indexes->end(), index) == indexes->end()) {
+      indexes->push_back(index);
+    }
+  }
+  return true;
 }
 
 Status PikaReplClient::Write(const std::string& ip, const int port, const std::string& msg) {
@@ -197,6 +297,12 @@ Status PikaReplClient::SendPartitionTrySync(const std::string& ip,
   binlog_offset->set_filenum(boffset.filenum);
   binlog_offset->set_offset(boffset.offset);
 
+  InnerMessage::CompressionType compression;
+  if (BinlogCompressionFromString(g_pika_conf->replication_compression(), &compression)
+    && compression != InnerMessage::kNoCompression) {
+    try_sync->set_compression(compression);
+  }
+
   std::string to_send;
   if (!request.SerializeToString(&to_send)) {
     LOG(WARNING) << "Serialize Partition TrySync Request Failed, to Master ("
@@ -206,17 +312,14 @@ Status PikaReplClient::SendPartitionTrySync(const std::string& ip,
   return client_thread_->Write(ip, port + kPortShiftReplServer, to_send);
 }
 
-Status PikaReplClient::SendPartitionBinlogSync(const std::string& ip,
-                                               uint32_t port,
-                                               const std::string& table_name,
-                                               uint32_t partition_id,
-                                               const BinlogOffset& ack_start,
-                                               const BinlogOffset& ack_end,
-                                               const std::string& local_ip,
-                                               bool is_first_send) {
-  InnerMessage::InnerRequest request;
-  request.set_type(InnerMessage::kBinlogSync);
-  InnerMessage::InnerRequest::BinlogSync* binlog_sync = request.mutable_binlog_sync();
+static void BuildBinlogSyncAck(const std::string& table_name,
+                               uint32_t partition_id,
+                               const BinlogOffset& ack_start,
+                               const BinlogOffset& ack_end,
+                               int32_t session_id,
+                               const std::string& local_ip,
+                               bool is_first_send,
+                               InnerMessage::InnerRequest::BinlogSync* binlog_sync) {
   InnerMessage::Node* node = binlog_sync->mutable_node();
   node->set_ip(local_ip);
   node->set_port(g_pika_server->port());
@@ -232,8 +335,22 @@ Status PikaReplClient::SendPartitionBinlogSync(const std::string& ip,
   ack_range_end->set_filenum(ack_end.filenum);
   ack_range_end->set_offset(ack_end.offset);
 
-  int32_t session_id = g_pika_rm->GetSlavePartitionSessionId(table_name, partition_id);
   binlog_sync->set_session_id(session_id);
+}
+
+Status PikaReplClient::SendPartitionBinlogSync(const std::string& ip,
+                                               uint32_t port,
+                                               const std::string& table_name,
+                                               uint32_t partition_id,
+                                               const BinlogOffset& ack_start,
+                                               const BinlogOffset& ack_end,
+                                               const std::string& local_ip,
+                                               bool is_first_send) {
+  InnerMessage::InnerRequest request;
+  request.set_type(InnerMessage::kBinlogSync);
+  int32_t session_id = g_pika_rm->GetSlavePartitionSessionId(table_name, partition_id);
+  BuildBinlogSyncAck(table_name, partition_id, ack_start, ack_end, session_id,
+                     local_ip, is_first_send, request.mutable_binlog_sync());
 
   std::string to_send;
   if (!request.SerializeToString(&to_send)) {
@@ -244,6 +361,57 @@ Status PikaReplClient::SendPartitionBinlogSync(const std::string& ip,
   return client_thread_->Write(ip, port + kPortShiftReplServer, to_send);
 }
 
+Status PikaReplClient::SendBinlogSyncAck(const std::string& ip,
+                                         uint32_t port,
+                                         const std::string& local_ip,
+                                         const BinlogSyncAck& ack) {
+  InnerMessage::InnerRequest request;
+  request.set_type(InnerMessage::kBinlogSync);
+  BuildBinlogSyncAck(ack.p_info.table_name_, ack.p_info.partition_id_,
+                     ack.ack_start, ack.ack_end, ack.session_id,
+                     local_ip, false, request.mutable_binlog_sync());
+
+  std::string to_send;
+  if (!request.SerializeToString(&to_send)) {
+    LOG(WARNING) << "Serialize BinlogSync Ack Request Failed, to Master ("
+      << ip << ":" << port << ")";
+    return Status::Corruption("Serialize Failed");
+  }
+  return client_thread_->Write(ip, port + kPortShiftReplServer, to_send);
+}
+
+Status PikaReplClient::SendBinlogSyncAcks(const std::string& ip,
+                                          uint32_t port,
+                                          const std::string& local_ip,
+                                          const std::vector<BinlogSyncAck>& acks,
+                                          bool batch) {
+  if (!batch || acks.size() == 1) {
+    for (const auto& ack : acks) {
+      Status s = SendBinlogSyncAck(ip, port, local_ip, ack);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+
+  InnerMessage::InnerRequest request;
+  request.set_type(InnerMessage::kBinlogSync);
+  for (const auto& ack : acks) {
+    BuildBinlogSyncAck(ack.p_info.table_name_, ack.p_info.partition_id_,
+                       ack.ack_start, ack.ack_end, ack.session_id,
+                       local_ip, false, request.add_binlog_sync_batch());
+  }
+
+  std::string to_send;
+  if (!request.SerializeToString(&to_send)) {
+    LOG(WARNING) << "Serialize BinlogSync Acks Request Failed, to Master ("
+      << ip << ":" << port << ")";
+    return Status::Corruption("Serialize Failed");
+  }
+  return client_thread_->Write(ip, port + kPortShiftReplServer, to_send);
+}
+
 Status PikaReplClient::SendRemoveSlaveNode(const std::string& ip,
                                            uint32_t port,
                                            const std::string& table_name,
@@ -75,6 +75,22 @@ int PikaReplClientConn::DealMessage() {
     }
     case InnerMessage::kBinlogSync:
     {
+      if (response->has_compressed_data()) {
+        uint64_t start_us = ThreadCpuMicros();
+        std::string raw;
+        slash::Status s = BinlogUncompress(response->compression(), response->compressed_data(),
+                                           response->raw_size(), &raw);
+        std::shared_ptr<InnerMessage::InnerResponse> raw_response =
+          std::make_shared<InnerMessage::InnerResponse>();
+        if (!s.ok() || !raw_response->ParseFromString(raw)) {
+          LOG(WARNING) << "Uncompress binlog sync response failed, "
+            << (s.ok() ? "parse failed" : s.ToString());
+          g_pika_server->SyncError();
+          return -1;
+        }
+        g_pika_rm->binlog_compression_statistic().AddUncompress(ThreadCpuMicros() - start_us);
+        response = raw_response;
+      }
       DispatchBinlogRes(response);
       break;
     }
@@ -215,9 +231,12 @@ void PikaReplClientConn::HandleTrySyncResponse(void* arg) {
     int32_t session_id = try_sync_response.session_id();
     partition->logger()->GetProducerStatus(&boffset.filenum, &boffset.offset);
     g_pika_rm->UpdateSyncSlavePartitionSessionId(PartitionInfo(table_name, partition_id), session_id);
+    // Masters without batch_ack only read binlog_sync
+    slave_partition->SetBatchAck(try_sync_response.batch_ack());
     g_pika_rm->SendPartitionBinlogSyncAckRequest(table_name, partition_id, boffset, boffset, true);
     slave_partition->SetReplState(ReplState::kConnected);
-    LOG(INFO)    << "Partition: " << partition_name << " TrySync Ok";
+    LOG(INFO)    << "Partition: " << partition_name << " TrySync Ok, Compression: "
+      << BinlogCompressionToString(try_sync_response.compression());
   } else if (try_sync_response.reply_code() == InnerMessage::InnerResponse::TrySync::kSyncPointBePurged) {
     slave_partition->SetReplState(ReplState::kTryDBSync);
     LOG(INFO)    << "Partition: " << partition_name << " Need To Try DBSync";
@@ -10,6 +10,7 @@
 #include "include/pika_rm.h"
 #include "include/pika_conf.h"
 #include "include/pika_server.h"
+#include "include/pika_binlog_compression.h"
 
 extern PikaConf* g_pika_conf;
 extern PikaServer* g_pika_server;
@@ -53,13 +54,15 @@ int PikaReplServer::Stop() {
 
 slash::Status PikaReplServer::SendSlaveBinlogChips(const std::string& ip,
                                                    int port,
-                                                   const std::vector<WriteTask>& tasks) {
+                                                   const std::vector<WriteTask>& tasks,
+                                                   InnerMessage::CompressionType compression) {
   InnerMessage::InnerResponse response;
   BuildBinlogSyncResp(tasks, &response);
 
   std::string binlog_chip_pb;
-  if (!response.SerializeToString(&binlog_chip_pb)) {
-    return Status::Corruption("Serialized Failed");
+  slash::Status s = SerializeBinlogSyncResp(response, compression, &binlog_chip_pb);
+  if (!s.ok()) {
+    return s;
   }
 
   if (binlog_chip_pb.size() > static_cast<size_t>(g_pika_conf->max_conn_rbuf_size())) {
@@ -68,10 +71,11 @@ slash::Status PikaReplServer::SendSlaveBinlogChips(const std::string& ip,
       std::vector<WriteTask> tmp_tasks;
       tmp_tasks.push_back(task);
       BuildBinlogSyncResp(tmp_tasks, &response);
-      if (!response.SerializeToString(&binlog_chip_pb)) {
-        return Status::Corruption("Serialized Failed");
+      s = SerializeBinlogSyncResp(response, compression, &binlog_chip_pb);
+      if (!s.ok()) {
+        return s;
       }
-      slash::Status s = Write(ip, port, binlog_chip_pb);
+      s = Write(ip, port, binlog_chip_pb);
       if (!s.ok()) {
         return s;
       }
@@ -82,6 +86,43 @@ slash::Status PikaReplServer::SendSlaveBinlogChips(const std::string& ip,
   return Write(ip, port, binlog_chip_pb);
 }
 
+slash::Status PikaReplServer::SerializeBinlogSyncResp(const InnerMessage::InnerResponse& response,
+                                                      InnerMessage::CompressionType compression,
+                                                      std::string* output) {
+  if (!response.SerializeToString(output)) {
+    return Status::Corruption("Serialized Failed");
+  }
+  if (compression == InnerMessage::kNoCompression
+    || output->size() < kBinlogCompressMinSize) {
+    return Status::OK();
+  }
+
+  uint64_t start_us = ThreadCpuMicros();
+  std::string compressed;
+  slash::Status s = BinlogCompress(compression, *output, &compressed);
+  if (!s.ok()) {
+    LOG(WARNING) << "Compress binlog failed, send it uncompressed, " << s.ToString();
+    return Status::OK();
+  }
+  // Not worth it, keep it uncompressed
+  if (compressed.size() >= output->size()) {
+    return Status::OK();
+  }
+  InnerMessage::InnerResponse compressed_response;
+  compressed_response.set_code(InnerMessage::kOk);
+  compressed_response.set_type(InnerMessage::Type::kBinlogSync);
+  compressed_response.set_compression(compression);
+  compressed_response.set_raw_size(output->size());
+  compressed_response.set_compressed_data(compressed);
+  uint64_t raw_size = output->size();
+  if (!compressed_response.SerializeToString(output)) {
+    return Status::Corruption("Serialized Failed");
+  }
+  g_pika_rm->binlog_compression_statistic().AddCompress(
+      raw_size, output->size(), ThreadCpuMicros() - start_us);
+  return Status::OK();
+}
+
 void PikaReplServer::BuildBinlogSyncResp(const std::vector<WriteTask>& tasks,
     InnerMessage::InnerResponse* response) {
   response->set_code(InnerMessage::kOk);
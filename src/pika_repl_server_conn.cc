@@ -195,6 +195,23 @@ void PikaReplServerConn::HandleTrySyncRequest(void* arg) {
     }
   }
 
+  if (pre_success) {
+    // Accept the codec asked by slave if it is compiled in
+    InnerMessage::CompressionType compression = InnerMessage::kNoCompression;
+    if (try_sync_request.has_compression()
+      && BinlogCompressionSupported(try_sync_request.compression())) {
+      compression = try_sync_request.compression();
+    }
+    Status s = g_pika_rm->SetSyncMasterPartitionSlaveCompression(
+        RmNode(node.ip(), node.port(), table_name, partition_id), compression);
+    if (!s.ok()) {
+      LOG(WARNING) << "Partition: " << partition_name << ", Set compression Failed, " << s.ToString();
+      compression = InnerMessage::kNoCompression;
+    }
+    try_sync_response->set_compression(compression);
+    try_sync_response->set_batch_ack(true);
+  }
+
   std::string reply_str;
   if (!response.SerializeToString(&reply_str)
     || conn->WriteResp(reply_str)) {
@@ -283,17 +300,13 @@ void PikaReplServerConn::HandleDBSyncRequest(void* arg) {
   delete task_arg;
 }
 
-void PikaReplServerConn::HandleBinlogSyncRequest(void* arg) {
-  ReplServerTaskArg* task_arg = static_cast<ReplServerTaskArg*>(arg);
-  const std::shared_ptr<InnerMessage::InnerRequest> req = task_arg->req;
-  std::shared_ptr<pink::PbConn> conn = task_arg->conn;
-  if (!req->has_binlog_sync()) {
-    LOG(WARNING) << "Pb parse error";
-    //conn->NotifyClose();
-    delete task_arg;
-    return;
-  }
-  const InnerMessage::InnerRequest::BinlogSync& binlog_req = req->binlog_sync();
+/*
+ * Handle the ack of one partition, return false if the connection
+ * is closed and the rest acks should be dropped
+ */
+static bool HandleBinlogSyncAck(const InnerMessage::InnerRequest::BinlogSync& binlog_req,
+                                std::shared_ptr<pink::PbConn> conn,
+                                bool* acked) {
   const InnerMessage::Node& node = binlog_req.node();
   const std::string& table_name = binlog_req.table_name();
   uint32_t partition_id = binlog_req.partition_id();
@@ -310,8 +323,7 @@ void PikaReplServerConn::HandleBinlogSyncRequest(void* arg) {
     LOG(WARNING) << "Check Session failed " << node.ip() << ":" << node.port()
         << ", " << table_name << "_" << partition_id;
     //conn->NotifyClose();
-    delete task_arg;
-    return;
+    return true;
   }
 
   // Set ack info from slave
@@ -322,44 +334,63 @@ void PikaReplServerConn::HandleBinlogSyncRequest(void* arg) {
     LOG(WARNING) << "SetMasterLastRecvTime failed " << node.ip() << ":" << node.port()
         << ", " << table_name << "_" << partition_id << " " << s.ToString();
     conn->NotifyClose();
-    delete task_arg;
-    return;
+    return false;
   }
 
   if (is_first_send) {
     if (!(range_start == range_end)) {
       LOG(WARNING) << "first binlogsync request pb argument invalid";
       conn->NotifyClose();
-      delete task_arg;
-      return;
+      return false;
     }
     Status s = g_pika_rm->ActivateBinlogSync(slave_node, range_start);
     if (!s.ok()) {
       LOG(WARNING) << "Activate Binlog Sync failed " << slave_node.ToString() << " " << s.ToString();
       conn->NotifyClose();
-      delete task_arg;
-      return;
+      return false;
     }
-    delete task_arg;
-    return;
+    return true;
   }
 
   // not the first_send the range_ack cant be 0
   // set this case as ping
   if (range_start == BinlogOffset() && range_end == BinlogOffset()) {
-    delete task_arg;
-    return;
+    return true;
   }
   s = g_pika_rm->UpdateSyncBinlogStatus(slave_node, range_start, range_end);
   if (!s.ok()) {
     LOG(WARNING) << "Update binlog ack failed " << table_name << " " << partition_id << " " << s.ToString();
     conn->NotifyClose();
+    return false;
+  }
+  *acked = true;
+  return true;
+}
+
+void PikaReplServerConn::HandleBinlogSyncRequest(void* arg) {
+  ReplServerTaskArg* task_arg = static_cast<ReplServerTaskArg*>(arg);
+  const std::shared_ptr<InnerMessage::InnerRequest> req = task_arg->req;
+  std::shared_ptr<pink::PbConn> conn = task_arg->conn;
+  if (!req->has_binlog_sync() && req->binlog_sync_batch_size() == 0) {
+    LOG(WARNING) << "Pb parse error";
+    //conn->NotifyClose();
     delete task_arg;
     return;
   }
+
+  // A slave acks partitions one by one, or several of them in a batch
+  bool acked = false;
+  bool conn_alive = true;
+  if (req->has_binlog_sync()) {
+    conn_alive = HandleBinlogSyncAck(req->binlog_sync(), conn, &acked);
+  }
+  for (int i = 0; conn_alive && i < req->binlog_sync_batch_size(); ++i) {
+    conn_alive = HandleBinlogSyncAck(req->binlog_sync_batch(i), conn, &acked);
+  }
   delete task_arg;
-  g_pika_server->SignalAuxiliary();
-  return;
+  if (acked) {
+    g_pika_server->SignalAuxiliary();
+  }
 }
 
 void PikaReplServerConn::HandleRemoveSlaveNodeRequest(void* arg) {
@@ -61,7 +61,8 @@ SlaveNode::SlaveNode(const std::string& ip, int port,
                      uint32_t partition_id, int session_id)
   : RmNode(ip, port, table_name, partition_id, session_id),
   slave_state(kSlaveNotSync),
-  b_state(kNotSync), sent_offset(), acked_offset() {
+  b_state(kNotSync), sent_offset(), acked_offset(),
+  compression(InnerMessage::kNoCompression) {
 }
 
 SlaveNode::~SlaveNode() {
@@ -93,6 +94,13 @@ void SlaveNode::ReleaseBinlogFileReader() {
   binlog_reader = nullptr;
 }
 
+void SlaveNode::ReleaseWriteQueue() {
+  if (write_queue != nullptr) {
+    g_pika_rm->UnregisterWriteQueue(write_queue);
+    write_queue = nullptr;
+  }
+}
+
 std::string SlaveNode::ToStringStatus() {
   std::stringstream tmp_stream;
   tmp_stream << "    Slave_state: " << SlaveStateMsg[slave_state] << "\r\n";
@@ -114,10 +122,19 @@ SyncPartition::SyncPartition(const std::string& table_name, uint32_t partition_i
 
 SyncMasterPartition::SyncMasterPartition(const std::string& table_name, uint32_t partition_id)
     : SyncPartition(table_name, partition_id),
-      session_id_(0) {}
+      session_id_(0),
+      shared_reader_(nullptr) {}
 
-bool SyncMasterPartition::CheckReadBinlogFromCache() {
-  return false;
+SyncMasterPartition::~SyncMasterPartition() {
+  if (shared_reader_ != nullptr) {
+    g_pika_rm->binlog_reader_mgr.ReleaseBinlogReader(RmNode(SyncPartitionInfo().table_name_,
+                                                            SyncPartitionInfo().partition_id_));
+  }
+}
+
+bool SyncMasterPartition::CheckReadBinlogFromCache(const std::shared_ptr<Binlog>& binlog,
+                                                   const BinlogOffset& offset) {
+  return g_pika_conf->binlog_cache_size() > 0 && binlog->cache()->Contains(offset);
 }
 
 int SyncMasterPartition::GetNumberOfSlaveNode() {
@@ -169,6 +186,10 @@ Status SyncMasterPartition::RemoveSlaveNode(const std::string& ip, int port) {
   for (size_t i  = 0; i < slaves_.size(); ++i) {
     std::shared_ptr<SlaveNode> slave = slaves_[i];
     if (ip == slave->Ip() && port == slave->Port()) {
+      {
+        slash::MutexLock l(&slave->slave_mu);
+        slave->ReleaseWriteQueue();
+      }
       slaves_.erase(slaves_.begin() + i);
       LOG(INFO) << "Remove Slave Node, Partition: " << SyncPartitionInfo().ToString()
         << ", ip_port: "<< ip << ":" << port;
@@ -178,6 +199,16 @@ Status SyncMasterPartition::RemoveSlaveNode(const std::string& ip, int port) {
   return Status::NotFound("RemoveSlaveNode" + ip + std::to_string(port));
 }
 
+void SyncMasterPartition::DetachWriteQueue(const std::shared_ptr<SlaveWriteQueue>& queue) {
+  slash::MutexLock l(&partition_mu_);
+  for (auto& slave : slaves_) {
+    slash::MutexLock l(&slave->slave_mu);
+    if (slave->write_queue == queue) {
+      slave->write_queue = nullptr;
+    }
+  }
+}
+
 Status SyncMasterPartition::ActivateSlaveBinlogSync(const std::string& ip,
                                                     int port,
                                                     const std::shared_ptr<Binlog> binlog,
@@ -189,19 +220,27 @@ Status SyncMasterPartition::ActivateSlaveBinlogSync(const std::string& ip,
   if (!s.ok()) {
     return s;
   }
-  bool read_cache = CheckReadBinlogFromCache();
+  bool read_cache = CheckReadBinlogFromCache(binlog, offset);
 
   slave_ptr->Lock();
   slave_ptr->slave_state = kSlaveBinlogSync;
   slave_ptr->sent_offset = offset;
   slave_ptr->acked_offset = offset;
+  slave_ptr->logger = binlog;
+  // Binlog sent in the former session will never be acked
+  slave_ptr->sync_win.Reset();
+  slave_ptr->ReleaseWriteQueue();
+  slave_ptr->write_queue = g_pika_rm->RegisterWriteQueue(ip, port, slave_ptr->compression);
   if (read_cache) {
-    slave_ptr->Unlock();
-    // RegistToBinlogCacheWindow(ip, port, offset);
-    slave_ptr->Lock();
+    if (slave_ptr->binlog_reader != nullptr) {
+      slave_ptr->ReleaseBinlogFileReader();
+    }
     slave_ptr->b_state = kReadFromCache;
   } else {
     // read binlog file from file
+    if (slave_ptr->binlog_reader != nullptr) {
+      slave_ptr->ReleaseBinlogFileReader();
+    }
     s = slave_ptr->InitBinlogFileReader(binlog, offset);
     if (!s.ok()) {
       slave_ptr->Unlock();
@@ -255,38 +294,170 @@ Status SyncMasterPartition::ActivateSlaveDbSync(const std::string& ip, int port)
 }
 
 Status SyncMasterPartition::ReadCachedBinlogToWq(const std::shared_ptr<SlaveNode>& slave_ptr) {
+  // Nothing read is lost, the slave goes on from sent_offset when it
+  // activates binlog sync again
+  if (slave_ptr->write_queue == nullptr) {
+    return Status::Incomplete("write queue of " + slave_ptr->Ip() + ":"
+                              + std::to_string(slave_ptr->Port()) + " detached");
+  }
+  int cnt = slave_ptr->sync_win.Remainings();
+  std::vector<BinlogCacheItem> items;
+  Status s = slave_ptr->logger->cache()->Read(slave_ptr->sent_offset, cnt, &items);
+  if (s.IsNotFound()) {
+    // Fall behind the cache window, go on with the binlog file
+    LOG(INFO) << SyncPartitionInfo().ToString() << " Slave " << slave_ptr->Ip()
+      << ":" << slave_ptr->Port() << " falls behind binlog cache, read from file "
+      << slave_ptr->sent_offset.ToString();
+    s = slave_ptr->InitBinlogFileReader(slave_ptr->logger, slave_ptr->sent_offset);
+    if (!s.ok()) {
+      LOG(WARNING) << SyncPartitionInfo().ToString()
+        << " Init binlog file reader failed: " << s.ToString();
+      return s;
+    }
+    slave_ptr->b_state = kReadFromFile;
+    return ReadBinlogFileToWq(slave_ptr);
+  }
+
+  std::vector<WriteTask> tasks;
+  RmNode rm_node(slave_ptr->Ip(), slave_ptr->Port(), slave_ptr->TableName(), slave_ptr->PartitionId(), slave_ptr->SessionId());
+  for (const auto& item : items) {
+    slave_ptr->sync_win.Push(SyncWinItem(item.end_offset, item.produce_time));
+    slave_ptr->sent_offset = item.end_offset;
+    tasks.push_back(WriteTask(rm_node, BinlogChip(item.end_offset, item.item)));
+  }
+
+  if (!tasks.empty()) {
+    slave_ptr->SetLastSendTime(slash::NowMicros());
+    slave_ptr->write_queue->Produce(&tasks);
+  }
   return Status::OK();
 }
 
 Status SyncMasterPartition::ReadBinlogFileToWq(const std::shared_ptr<SlaveNode>& slave_ptr) {
+  if (slave_ptr->write_queue == nullptr) {
+    return Status::Incomplete("write queue of " + slave_ptr->Ip() + ":"
+                              + std::to_string(slave_ptr->Port()) + " detached");
+  }
   int cnt = slave_ptr->sync_win.Remainings();
-  std::shared_ptr<PikaBinlogReader> reader = slave_ptr->binlog_reader;
+  BinlogOffset sent_offset = slave_ptr->sent_offset;
+  std::vector<BinlogCacheItem> items;
+  bool read_to_end = false;
+  Status s;
+
+  // Nobody follows the shared reader, take it over
+  bool follow_shared = shared_reader_ != nullptr && shared_window_.Contains(sent_offset);
+  if (!follow_shared && !HasSharedReaderFollower(slave_ptr)) {
+    s = SeekSharedReader(slave_ptr->logger, sent_offset);
+    if (!s.ok()) {
+      return s;
+    }
+    follow_shared = true;
+  }
+
+  if (follow_shared) {
+    if (slave_ptr->binlog_reader != nullptr) {
+      slave_ptr->ReleaseBinlogFileReader();
+    }
+    shared_window_.Read(sent_offset, cnt, &items);
+    // Reached the end of window, the shared reader goes on
+    if (static_cast<int>(items.size()) < cnt) {
+      size_t decoded = items.size();
+      s = ReadBinlogFromReader(shared_reader_, cnt - items.size(), &items, &read_to_end);
+      for (size_t i = decoded; i < items.size(); ++i) {
+        shared_window_.Push(items[i].item, items[i].end_offset,
+                            kBinlogSharedReadWindowSize, items[i].produce_time);
+      }
+    }
+  } else {
+    if (slave_ptr->binlog_reader == nullptr) {
+      s = slave_ptr->InitBinlogFileReader(slave_ptr->logger, sent_offset);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    s = ReadBinlogFromReader(slave_ptr->binlog_reader, cnt, &items, &read_to_end);
+  }
+  if (!s.ok()) {
+    LOG(WARNING) << SyncPartitionInfo().ToString()
+      << " Read Binlog error : " << s.ToString();
+    return s;
+  }
+
   std::vector<WriteTask> tasks;
+  RmNode rm_node(slave_ptr->Ip(), slave_ptr->Port(), slave_ptr->TableName(), slave_ptr->PartitionId(), slave_ptr->SessionId());
+  for (const auto& item : items) {
+    slave_ptr->sync_win.Push(SyncWinItem(item.end_offset, item.produce_time));
+    slave_ptr->sent_offset = item.end_offset;
+    tasks.push_back(WriteTask(rm_node, BinlogChip(item.end_offset, item.item)));
+  }
+
+  if (!tasks.empty()) {
+    slave_ptr->SetLastSendTime(slash::NowMicros());
+    slave_ptr->write_queue->Produce(&tasks);
+  }
+
+  // Caught up, the following binlog can be served from cache
+  if (read_to_end && slave_ptr->logger != nullptr
+    && CheckReadBinlogFromCache(slave_ptr->logger, slave_ptr->sent_offset)) {
+    if (slave_ptr->binlog_reader != nullptr) {
+      slave_ptr->ReleaseBinlogFileReader();
+    }
+    slave_ptr->b_state = kReadFromCache;
+  }
+  return Status::OK();
+}
+
+Status SyncMasterPartition::ReadBinlogFromReader(const std::shared_ptr<PikaBinlogReader>& reader,
+                                                 int cnt,
+                                                 std::vector<BinlogCacheItem>* items,
+                                                 bool* read_to_end) {
   for (int i = 0; i < cnt; ++i) {
     std::string msg;
     uint32_t filenum;
     uint64_t offset;
     Status s = reader->Get(&msg, &filenum, &offset);
     if (s.IsEndFile()) {
+      *read_to_end = true;
       break;
     } else if (s.IsCorruption() || s.IsIOError()) {
-      LOG(WARNING) << SyncPartitionInfo().ToString()
-        << " Read Binlog error : " << s.ToString();
       return s;
     }
-    slave_ptr->sync_win.Push(SyncWinItem(filenum, offset));
+    items->push_back(BinlogCacheItem(BinlogOffset(filenum, offset), msg, slash::NowMicros()));
+  }
+  return Status::OK();
+}
 
-    BinlogOffset sent_offset = BinlogOffset(filenum, offset);
-    slave_ptr->sent_offset = sent_offset;
-    slave_ptr->SetLastSendTime(slash::NowMicros());
-    RmNode rm_node(slave_ptr->Ip(), slave_ptr->Port(), slave_ptr->TableName(), slave_ptr->PartitionId(), slave_ptr->SessionId());
-    WriteTask task(rm_node, BinlogChip(sent_offset, msg));
-    tasks.push_back(task);
+bool SyncMasterPartition::HasSharedReaderFollower(const std::shared_ptr<SlaveNode>& slave_ptr) {
+  if (shared_reader_ == nullptr) {
+    return false;
   }
+  for (const auto& slave : slaves_) {
+    if (slave != slave_ptr
+      && slave->slave_state == kSlaveBinlogSync
+      && slave->b_state == kReadFromFile
+      && slave->binlog_reader == nullptr) {
+      return true;
+    }
+  }
+  return false;
+}
 
-  if (!tasks.empty()) {
-    g_pika_rm->ProduceWriteQueue(slave_ptr->Ip(), slave_ptr->Port(), tasks);
+Status SyncMasterPartition::SeekSharedReader(const std::shared_ptr<Binlog>& binlog,
+                                             const BinlogOffset& offset) {
+  if (shared_reader_ == nullptr) {
+    Status s = g_pika_rm->binlog_reader_mgr.FetchBinlogReader(
+        RmNode(SyncPartitionInfo().table_name_, SyncPartitionInfo().partition_id_), &shared_reader_);
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  if (shared_reader_->Seek(binlog, offset.filenum, offset.offset)) {
+    g_pika_rm->binlog_reader_mgr.ReleaseBinlogReader(
+        RmNode(SyncPartitionInfo().table_name_, SyncPartitionInfo().partition_id_));
+    shared_reader_ = nullptr;
+    return Status::Corruption(SyncPartitionInfo().ToString() + " shared binlog reader init failed");
   }
+  shared_window_.Reset(offset);
   return Status::OK();
 }
 
@@ -358,12 +529,29 @@ Status SyncMasterPartition::GetSlaveState(const std::string& ip,
   return Status::OK();
 }
 
+Status SyncMasterPartition::SetSlaveCompression(const std::string& ip, int port,
+                                                InnerMessage::CompressionType compression) {
+  slash::MutexLock l(&partition_mu_);
+  std::shared_ptr<SlaveNode> slave_ptr = nullptr;
+  Status s = GetSlaveNode(ip, port, &slave_ptr);
+  if (!s.ok()) {
+    return s;
+  }
+
+  {
+  slash::MutexLock l(&slave_ptr->slave_mu);
+  slave_ptr->compression = compression;
+  }
+  return Status::OK();
+}
+
 Status SyncMasterPartition::WakeUpSlaveBinlogSync() {
   slash::MutexLock l(&partition_mu_);
   for (auto& slave_ptr : slaves_) {
     {
     slash::MutexLock l(&slave_ptr->slave_mu);
-    if (slave_ptr->sent_offset == slave_ptr->acked_offset) {
+    // Refill as long as the window has room, not only when all acked
+    if (slave_ptr->sync_win.Remainings() > 0) {
       if (slave_ptr->b_state == kReadFromFile) {
         ReadBinlogFileToWq(slave_ptr);
       } else if (slave_ptr->b_state == kReadFromCache) {
@@ -526,6 +714,10 @@ Status SyncMasterPartition::CheckSyncTimeout(uint64_t now) {
   for (auto& node : to_del) {
     for (size_t i = 0; i < slaves_.size(); ++i) {
       if (node.Ip() == slaves_[i]->Ip() && node.Port() == slaves_[i]->Port()) {
+        {
+          slash::MutexLock l(&slaves_[i]->slave_mu);
+          slaves_[i]->ReleaseWriteQueue();
+        }
         slaves_.erase(slaves_.begin() + i);
         LOG(WARNING) << SyncPartitionInfo().ToString() << " Master del Recv Timeout slave success " << node.ToString();
         break;
@@ -618,7 +810,8 @@ SyncSlavePartition::SyncSlavePartition(const std::string& table_name,
   : SyncPartition(table_name, partition_id),
     m_info_(),
     repl_state_(kNoConnect),
-    local_ip_("") {
+    local_ip_(""),
+    batch_ack_(false) {
   m_info_.SetLastRecvTime(slash::NowMicros());
 }
 
@@ -673,6 +866,8 @@ void SyncSlavePartition::Activate(const RmNode& master, const ReplState& repl_st
   m_info_ = master;
   repl_state_ = repl_state;
   m_info_.SetLastRecvTime(slash::NowMicros());
+  // Learned again from the TrySync response of the master
+  batch_ack_ = false;
 }
 
 void SyncSlavePartition::Deactivate() {
@@ -687,54 +882,252 @@ std::string SyncSlavePartition::ToStringStatus() {
     "  SyncStatus " + ReplStateMsg[repl_state_] + "\r\n";
 }
 
+/* ReplLagStatistic */
+
+ReplLagStatistic::ReplLagStatistic() {
+  Reset();
+}
+
+int ReplLagStatistic::BucketIndex(uint64_t lag) {
+  if (lag < kSubBuckets) {
+    return static_cast<int>(lag);
+  }
+  int msb = 63 - __builtin_clzll(lag);
+  int sub = static_cast<int>((lag >> (msb - 2)) & (kSubBuckets - 1));
+  return (msb - 1) * kSubBuckets + sub;
+}
+
+uint64_t ReplLagStatistic::BucketUpperBound(int index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  int msb = index / kSubBuckets + 1;
+  uint64_t sub = index % kSubBuckets;
+  return ((kSubBuckets + sub + 1) << (msb - 2)) - 1;
+}
+
+void ReplLagStatistic::Add(uint64_t lag) {
+  buckets_[BucketIndex(lag)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void ReplLagStatistic::Reset() {
+  for (int i = 0; i < kBuckets; ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t ReplLagStatistic::Count() {
+  uint64_t count = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    count += buckets_[i].load(std::memory_order_relaxed);
+  }
+  return count;
+}
+
+uint64_t ReplLagStatistic::Percentile(double percentile) {
+  uint64_t counts[kBuckets];
+  uint64_t total = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = static_cast<uint64_t>(total * percentile / 100);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      return BucketUpperBound(i);
+    }
+  }
+  return BucketUpperBound(kBuckets - 1);
+}
+
+/* BinlogAckStatistic */
+
+BinlogAckStatistic::BinlogAckStatistic()
+    : last_time_us_(0), last_frames_(0), last_acks_(0), last_items_(0) {
+  Reset();
+}
+
+void BinlogAckStatistic::Add(uint64_t frames, uint64_t acks, uint64_t items) {
+  frames_.fetch_add(frames, std::memory_order_relaxed);
+  acks_.fetch_add(acks, std::memory_order_relaxed);
+  items_.fetch_add(items, std::memory_order_relaxed);
+}
+
+void BinlogAckStatistic::Reset() {
+  frames_.store(0);
+  acks_.store(0);
+  items_.store(0);
+  frames_per_sec_.store(0);
+  acks_per_sec_.store(0);
+  items_per_sec_.store(0);
+}
+
+void BinlogAckStatistic::Refresh(uint64_t now) {
+  if (now < last_time_us_ + 1000000) {
+    return;
+  }
+  uint64_t frames = frames_.load(), acks = acks_.load(), items = items_.load();
+  // Counters were reset
+  if (frames < last_frames_ || acks < last_acks_ || items < last_items_) {
+    last_frames_ = last_acks_ = last_items_ = 0;
+  }
+  uint64_t delta_time_us = now - last_time_us_;
+  if (last_time_us_ != 0) {
+    frames_per_sec_.store((frames - last_frames_) * 1000000 / delta_time_us);
+    acks_per_sec_.store((acks - last_acks_) * 1000000 / delta_time_us);
+    items_per_sec_.store((items - last_items_) * 1000000 / delta_time_us);
+  }
+  last_time_us_ = now;
+  last_frames_ = frames;
+  last_acks_ = acks;
+  last_items_ = items;
+}
+
 /* SyncWindow */
 
+static bool SyncWinOffsetLess(const BinlogOffset& a, const BinlogOffset& b) {
+  return a.filenum < b.filenum
+    || (a.filenum == b.filenum && a.offset < b.offset);
+}
+
+SyncWindow::SyncWindow()
+    : win_(kInitCapacity), head_(0), size_(0) {
+}
+
 void SyncWindow::Push(const SyncWinItem& item) {
-  win_.push_back(item);
+  if (size_ == win_.size()) {
+    Grow();
+  }
+  At(size_++) = item;
 }
 
-bool SyncWindow::Update(const SyncWinItem& start_item,
-    const SyncWinItem& end_item, BinlogOffset* acked_offset) {
-  size_t start_pos = win_.size(), end_pos = win_.size();
-  for (size_t i = 0; i < win_.size(); ++i) {
-    if (win_[i] == start_item) {
-      start_pos = i;
-    }
-    if (win_[i] == end_item) {
-      end_pos = i;
-      break;
+void SyncWindow::Grow() {
+  std::vector<SyncWinItem> win(win_.size() * 2);
+  for (size_t i = 0; i < size_; ++i) {
+    win[i] = At(i);
+  }
+  win_.swap(win);
+  head_ = 0;
+}
+
+size_t SyncWindow::Find(const SyncWinItem& item) const {
+  size_t low = 0, high = size_;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    if (SyncWinOffsetLess(At(mid).offset_, item.offset_)) {
+      low = mid + 1;
+    } else {
+      high = mid;
     }
   }
-  if (start_pos == win_.size() || end_pos == win_.size()) {
+  if (low < size_ && At(low) == item) {
+    return low;
+  }
+  return size_;
+}
+
+bool SyncWindow::Update(const SyncWinItem& start_item,
+    const SyncWinItem& end_item, BinlogOffset* acked_offset) {
+  // Acks come in order, the range mostly starts from the oldest item
+  size_t start_pos = (size_ != 0 && At(0) == start_item) ? 0 : Find(start_item);
+  size_t end_pos = Find(end_item);
+  if (start_pos == size_ || end_pos == size_ || start_pos > end_pos) {
     LOG(WARNING) << "Ack offset Start: " <<
       start_item.ToString() << "End: " << end_item.ToString() <<
       " not found in binlog controller window." <<
       std::endl << "window status "<< std::endl << ToStringStatus();
     return false;
   }
+  uint64_t now = slash::NowMicros();
   for (size_t i = start_pos; i <= end_pos; ++i) {
-    win_[i].acked_ = true;
-  }
-  while (!win_.empty()) {
-    if (win_[0].acked_) {
-      *acked_offset = win_[0].offset_;
-      win_.pop_front();
-    } else {
-      break;
+    SyncWinItem& item = At(i);
+    item.acked_ = true;
+    if (item.produce_time_ != 0 && now > item.produce_time_) {
+      g_pika_rm->repl_lag_statistic().Add(now - item.produce_time_);
     }
   }
+  while (size_ != 0 && At(0).acked_) {
+    *acked_offset = At(0).offset_;
+    head_ = (head_ + 1) & (win_.size() - 1);
+    --size_;
+  }
   return true;
 }
 
 int SyncWindow::Remainings() {
-  std::size_t remaining_size = g_pika_conf->sync_window_size() - win_.size();
-  return remaining_size > 0? remaining_size:0 ;
+  int remaining_size = g_pika_conf->sync_window_size() - static_cast<int>(size_);
+  return remaining_size > 0 ? remaining_size : 0;
+}
+
+void SyncWindow::Reset() {
+  head_ = 0;
+  size_ = 0;
+}
+
+/* SlaveWriteQueue */
+
+SlaveWriteQueue::SlaveWriteQueue(const std::string& ip, int port,
+                                 InnerMessage::CompressionType compression)
+    : ip_(ip), port_(port), compression_(compression) {
+  head_ = tail_ = new Node();
+}
+
+SlaveWriteQueue::~SlaveWriteQueue() {
+  while (head_ != nullptr) {
+    Node* next = head_->next.load(std::memory_order_relaxed);
+    delete head_;
+    head_ = next;
+  }
+}
+
+void SlaveWriteQueue::Produce(std::vector<WriteTask>* tasks) {
+  Node* node = new Node();
+  node->tasks.swap(*tasks);
+  tail_->next.store(node, std::memory_order_release);
+  tail_ = node;
+}
+
+void SlaveWriteQueue::Consume(size_t count, size_t max_bytes,
+                              std::vector<WriteTask>* tasks) {
+  Node* next = head_->next.load(std::memory_order_acquire);
+  while (next != nullptr) {
+    for (auto& task : next->tasks) {
+      pending_.push_back(std::move(task));
+    }
+    next->tasks.clear();
+    delete head_;
+    head_ = next;
+    next = head_->next.load(std::memory_order_acquire);
+  }
+
+  size_t batch_size = 0;
+  size_t taken = tasks->size();
+  while (!pending_.empty() && tasks->size() < count) {
+    batch_size += pending_.front().binlog_chip_.binlog_.size();
+    // make sure SerializeToString will not over 2G, one item over
+    // max_bytes still goes alone, or it would never be sent
+    if (batch_size > max_bytes && tasks->size() > taken) {
+      break;
+    }
+    tasks->push_back(std::move(pending_.front()));
+    pending_.pop_front();
+  }
 }
 
 /* PikaReplicaManger */
 
 PikaReplicaManager::PikaReplicaManager()
-    : last_meta_sync_timestamp_(0) {
+    : pending_ack_items_(0),
+      pending_ack_since_(0),
+      last_meta_sync_timestamp_(0) {
   std::set<std::string> ips;
   ips.insert("0.0.0.0");
   int port = g_pika_conf->port() + kPortShiftReplServer;
@@ -742,12 +1135,14 @@ PikaReplicaManager::PikaReplicaManager()
   pika_repl_server_ = new PikaReplServer(ips, port, 3000);
   InitPartition();
   pthread_rwlock_init(&partitions_rw_, NULL);
+  pthread_rwlock_init(&write_queues_rw_, NULL);
 }
 
 PikaReplicaManager::~PikaReplicaManager() {
   delete pika_repl_client_;
   delete pika_repl_server_;
   pthread_rwlock_destroy(&partitions_rw_);
+  pthread_rwlock_destroy(&write_queues_rw_);
 }
 
 void PikaReplicaManager::Start() {
@@ -781,80 +1176,79 @@ void PikaReplicaManager::InitPartition() {
   }
 }
 
-void PikaReplicaManager::ProduceWriteQueue(const std::string& ip, int port, const std::vector<WriteTask>& tasks) {
-  slash::MutexLock l(&write_queue_mu_);
-  std::string index = ip + ":" + std::to_string(port);
-  for (auto& task : tasks) {
-    write_queues_[index].push(task);
+std::shared_ptr<SlaveWriteQueue> PikaReplicaManager::RegisterWriteQueue(
+    const std::string& ip, int port, InnerMessage::CompressionType compression) {
+  std::shared_ptr<SlaveWriteQueue> queue =
+    std::make_shared<SlaveWriteQueue>(ip, port, compression);
+  slash::RWLock l(&write_queues_rw_, true);
+  write_queues_.push_back(queue);
+  return queue;
+}
+
+void PikaReplicaManager::UnregisterWriteQueue(
+    const std::shared_ptr<SlaveWriteQueue>& queue) {
+  slash::RWLock l(&write_queues_rw_, true);
+  for (auto iter = write_queues_.begin(); iter != write_queues_.end(); ++iter) {
+    if (*iter == queue) {
+      write_queues_.erase(iter);
+      break;
+    }
   }
 }
 
 int PikaReplicaManager::ConsumeWriteQueue() {
-  std::vector<std::string> to_delete;
-  std::unordered_map<std::string, std::vector<std::vector<WriteTask>>> to_send_map;
-  int counter = 0;
+  std::vector<std::shared_ptr<SlaveWriteQueue>> queues;
   {
-    slash::MutexLock l(&write_queue_mu_);
-    std::vector<std::string> to_delete;
-    for (auto& iter : write_queues_) {
-      std::queue<WriteTask>& queue = iter.second;
-      for (int i = 0; i < kBinlogSendPacketNum; ++i) {
-        if (queue.empty()) {
-          break;
-        }
-        size_t batch_index = queue.size() > kBinlogSendBatchNum ? kBinlogSendBatchNum : queue.size();
-        std::vector<WriteTask> to_send;
-        int batch_size = 0;
-        for (size_t i = 0; i < batch_index; ++i) {
-          WriteTask& task = queue.front();
-          batch_size +=  task.binlog_chip_.binlog_.size();
-          // make sure SerializeToString will not over 2G
-          if (batch_size > PIKA_MAX_CONN_RBUF_HB) {
-            break;
-          }
-          to_send.push_back(queue.front());
-          queue.pop();
-          counter++;
-        }
-        if (!to_send.empty()) {
-          to_send_map[iter.first].push_back(std::move(to_send));
-        }
-      }
-    }
+    slash::RWLock l(&write_queues_rw_, false);
+    queues = write_queues_;
   }
 
-  for (auto& iter : to_send_map) {
-    std::string ip;
-    int port = 0;
-    if (!slash::ParseIpPortString(iter.first, ip, port)) {
-      LOG(WARNING) << "Parse ip_port error " << iter.first;
-      continue;
-    }
-    for (auto& to_send : iter.second) {
-      Status s = pika_repl_server_->SendSlaveBinlogChips(ip, port, to_send);
+  int counter = 0;
+  for (auto& queue : queues) {
+    for (int i = 0; i < kBinlogSendPacketNum; ++i) {
+      std::vector<WriteTask> to_send;
+      queue->Consume(kBinlogSendBatchNum, PIKA_MAX_CONN_RBUF_HB, &to_send);
+      if (to_send.empty()) {
+        break;
+      }
+      counter += to_send.size();
+      Status s = pika_repl_server_->SendSlaveBinlogChips(queue->Ip(), queue->Port(), to_send,
+                                                         queue->compression());
       if (!s.ok()) {
-        LOG(WARNING) << "send binlog to " << ip << ":" << port << " failed, " << s.ToString();
-        to_delete.push_back(iter.first);
-        continue;
+        LOG(WARNING) << "send binlog to " << queue->Ip() << ":" << queue->Port()
+          << " failed, " << s.ToString();
+        UnregisterWriteQueue(queue);
+        DetachWriteQueue(queue);
+        break;
       }
     }
   }
+  return counter;
+}
 
-  if (!to_delete.empty()) {
-    {
-      slash::MutexLock l(&write_queue_mu_);
-      for (auto& del_queue : to_delete) {
-        write_queues_.erase(del_queue);
-      }
-    }
+void PikaReplicaManager::DetachWriteQueue(const std::shared_ptr<SlaveWriteQueue>& queue) {
+  slash::RWLock l(&partitions_rw_, false);
+  for (auto& iter : sync_master_partitions_) {
+    iter.second->DetachWriteQueue(queue);
   }
-  return counter;
 }
 
 void PikaReplicaManager::DropItemInWriteQueue(const std::string& ip, int port) {
-  slash::MutexLock l(&write_queue_mu_);
-  std::string index = ip + ":" + std::to_string(port);
-  write_queues_.erase(index);
+  std::vector<std::shared_ptr<SlaveWriteQueue>> queues;
+  {
+    slash::RWLock l(&write_queues_rw_, false);
+    for (const auto& queue : write_queues_) {
+      if (queue->Ip() == ip && queue->Port() == port) {
+        queues.push_back(queue);
+      }
+    }
+  }
+  // Detached under the slave locks first, so no producer is left
+  // feeding a queue nobody consumes
+  for (const auto& queue : queues) {
+    DetachWriteQueue(queue);
+    UnregisterWriteQueue(queue);
+  }
 }
 
 void PikaReplicaManager::ScheduleReplServerBGTask(pink::TaskFunc func, void* arg) {
@@ -872,10 +1266,9 @@ void PikaReplicaManager::ScheduleWriteBinlogTask(const std::string& table_partit
   pika_repl_client_->ScheduleWriteBinlogTask(table_partition, res, conn, res_private_data);
 }
 
-void PikaReplicaManager::ScheduleWriteDBTask(const std::string& dispatch_key,
-        PikaCmdArgsType* argv, BinlogItem* binlog_item,
-        const std::string& table_name, uint32_t partition_id) {
-  pika_repl_client_->ScheduleWriteDBTask(dispatch_key, argv, binlog_item, table_name, partition_id);
+void PikaReplicaManager::ScheduleWriteDBTask(const std::shared_ptr<Partition>& partition,
+                                             std::vector<std::shared_ptr<Cmd>>* cmds) {
+  pika_repl_client_->ScheduleWriteDBTask(partition, cmds);
 }
 
 void PikaReplicaManager::ReplServerRemoveClientConn(int fd) {
@@ -931,6 +1324,16 @@ Status PikaReplicaManager::GetSyncMasterPartitionSlaveState(const RmNode& slave,
   return Status::OK();
 }
 
+Status PikaReplicaManager::SetSyncMasterPartitionSlaveCompression(const RmNode& slave,
+                                                                  InnerMessage::CompressionType compression) {
+  slash::RWLock l(&partitions_rw_, false);
+  if (sync_master_partitions_.find(slave.NodePartitionInfo()) == sync_master_partitions_.end()) {
+    return Status::NotFound(slave.ToString() + " not found");
+  }
+  std::shared_ptr<SyncMasterPartition> partition = sync_master_partitions_[slave.NodePartitionInfo()];
+  return partition->SetSlaveCompression(slave.Ip(), slave.Port(), compression);
+}
+
 bool PikaReplicaManager::CheckPartitionSlaveExist(const RmNode& slave) {
   slash::RWLock l(&partitions_rw_, false);
   if (sync_master_partitions_.find(slave.NodePartitionInfo()) == sync_master_partitions_.end()) {
@@ -1075,6 +1478,39 @@ Status PikaReplicaManager::WakeUpBinlogSync() {
   return Status::OK();
 }
 
+void PikaReplicaManager::SignalBinlogProduced(const PartitionInfo& p_info) {
+  {
+    slash::MutexLock l(&produced_mu_);
+    produced_partitions_.insert(p_info);
+  }
+  g_pika_server->SignalAuxiliary();
+}
+
+Status PikaReplicaManager::WakeUpProducedBinlogSync() {
+  std::unordered_set<PartitionInfo, hash_partition_info> produced;
+  {
+    slash::MutexLock l(&produced_mu_);
+    produced.swap(produced_partitions_);
+  }
+  for (const auto& p_info : produced) {
+    // Clear before reading, so binlog written from now on notifies again
+    std::shared_ptr<Partition> partition =
+      g_pika_server->GetTablePartitionById(p_info.table_name_, p_info.partition_id_);
+    if (partition) {
+      partition->ClearBinlogProduced();
+    }
+    std::shared_ptr<SyncMasterPartition> master_partition = GetSyncMasterPartitionByName(p_info);
+    if (!master_partition) {
+      continue;
+    }
+    Status s = master_partition->WakeUpSlaveBinlogSync();
+    if (!s.ok()) {
+      return s;
+    }
+  }
+  return Status::OK();
+}
+
 int32_t PikaReplicaManager::GenPartitionSessionId(const std::string& table_name,
                                                   uint32_t partition_id) {
   slash::RWLock l(&partitions_rw_, false);
@@ -1429,6 +1865,118 @@ Status PikaReplicaManager::SendPartitionBinlogSyncAckRequest(
           is_first_send);
 }
 
+void PikaReplicaManager::AddBinlogSyncAck(const std::string& table,
+                                          uint32_t partition_id,
+                                          const BinlogOffset& ack_start,
+                                          const BinlogOffset& ack_end,
+                                          uint64_t items) {
+  PartitionInfo p_info(table, partition_id);
+  int32_t session_id = GetSlavePartitionSessionId(table, partition_id);
+  bool keepalive = ack_start == BinlogOffset() && ack_end == BinlogOffset();
+  uint64_t now = slash::NowMicros();
+  bool due = keepalive;
+  bool first_pending = false;
+  {
+    slash::MutexLock l(&pending_acks_mu_);
+    auto iter = pending_acks_.find(p_info);
+    if (iter == pending_acks_.end() || iter->second.session_id != session_id) {
+      BinlogSyncAck& ack = pending_acks_[p_info];
+      ack.p_info = p_info;
+      ack.ack_start = ack_start;
+      ack.ack_end = ack_end;
+      ack.session_id = session_id;
+      ack.items = items;
+    } else if (!keepalive) {
+      BinlogSyncAck& ack = iter->second;
+      // A pending keepalive is taken over by the real range
+      if (ack.ack_start == BinlogOffset() && ack.ack_end == BinlogOffset()) {
+        ack.ack_start = ack_start;
+      }
+      ack.ack_end = ack_end;
+      ack.items += items;
+    }
+    pending_ack_items_ += items;
+    if (pending_ack_since_ == 0) {
+      pending_ack_since_ = now;
+      first_pending = true;
+    }
+    due = due || pending_ack_items_ >= static_cast<uint64_t>(g_pika_conf->binlog_ack_batch_items())
+      || now >= pending_ack_since_ + g_pika_conf->binlog_ack_interval_us();
+  }
+  if (due) {
+    CheckBinlogSyncAcks(0);
+  } else if (first_pending) {
+    // Let auxiliary thread wait no longer than the ack interval
+    g_pika_server->SignalAuxiliary();
+  }
+}
+
+uint64_t PikaReplicaManager::CheckBinlogSyncAcks(uint64_t now) {
+  std::vector<BinlogSyncAck> acks;
+  {
+    slash::MutexLock l(&pending_acks_mu_);
+    if (pending_acks_.empty()) {
+      return 0;
+    }
+    // now 0 means the caller found them due
+    uint64_t deadline = pending_ack_since_ + g_pika_conf->binlog_ack_interval_us();
+    if (now != 0 && now < deadline) {
+      return deadline - now;
+    }
+    for (const auto& iter : pending_acks_) {
+      acks.push_back(iter.second);
+    }
+    pending_acks_.clear();
+    pending_ack_items_ = 0;
+    pending_ack_since_ = 0;
+  }
+  SendBinlogSyncAcks(acks);
+  return 0;
+}
+
+void PikaReplicaManager::SendBinlogSyncAcks(const std::vector<BinlogSyncAck>& acks) {
+  // master ip:port to the acks of partitions synced from it
+  std::unordered_map<std::string, std::vector<BinlogSyncAck>> master_acks;
+  std::unordered_map<std::string, std::string> local_ips;
+  std::unordered_map<std::string, bool> batch_acks;
+  for (const auto& ack : acks) {
+    std::shared_ptr<SyncSlavePartition> slave_partition =
+      GetSyncSlavePartitionByName(ack.p_info);
+    // Acks of the former session will not be accepted by master
+    if (!slave_partition || slave_partition->MasterSessionId() != ack.session_id) {
+      continue;
+    }
+    std::string master = slave_partition->MasterIp() + ":"
+      + std::to_string(slave_partition->MasterPort());
+    master_acks[master].push_back(ack);
+    local_ips[master] = slave_partition->LocalIp();
+    if (batch_acks.find(master) == batch_acks.end()) {
+      batch_acks[master] = true;
+    }
+    batch_acks[master] = batch_acks[master] && slave_partition->BatchAck();
+  }
+
+  for (const auto& iter : master_acks) {
+    std::string ip;
+    int port = 0;
+    if (!slash::ParseIpPortString(iter.first, ip, port)) {
+      LOG(WARNING) << "Parse ip_port error " << iter.first;
+      continue;
+    }
+    Status s = pika_repl_client_->SendBinlogSyncAcks(ip, port, local_ips[iter.first],
+                                                      iter.second, batch_acks[iter.first]);
+    if (!s.ok()) {
+      LOG(WARNING) << "Send binlog sync acks to " << iter.first << " failed, " << s.ToString();
+      continue;
+    }
+    uint64_t items = 0;
+    for (const auto& ack : iter.second) {
+      items += ack.items;
+    }
+    binlog_ack_statistic_.Add(1, iter.second.size(), items);
+  }
+}
+
 Status PikaReplicaManager::CloseReplClientConn(const std::string& ip, int32_t port) {
   return pika_repl_client_->Close(ip, port);
 }
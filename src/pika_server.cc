@@ -5,7 +5,9 @@
 
 #include "include/pika_server.h"
 
+#include <new>
 #include <ctime>
+#include <stdlib.h>
 #include <fstream>
 #include <iterator>
 #include <algorithm>
@@ -48,6 +50,7 @@ void DoDBSync(void* arg) {
 PikaServer::PikaServer() :
   exit_(false),
   slot_state_(INFREE),
+  slot_state_cv_(&slot_state_mu_),
   have_scheduled_crontask_(false),
   last_check_compact_time_({0, 0}),
   master_ip_(""),
@@ -88,11 +91,24 @@ PikaServer::PikaServer() :
   pika_dispatch_thread_ = new PikaDispatchThread(ips, port_, worker_num_, 3000,
                                                  worker_queue_limit, g_pika_conf->max_conn_rbuf_size());
   pika_monitor_thread_ = new PikaMonitorThread();
+  pika_slots_migrator_ = new PikaSlotsMigrator();
   pika_rsync_service_ = new PikaRsyncService(g_pika_conf->db_sync_path(),
                                              g_pika_conf->port() + kPortShiftRSync);
   pika_pubsub_thread_ = new pink::PubSubThread();
   pika_auxiliary_thread_ = new PikaAuxiliaryThread();
-  pika_thread_pool_ = new pink::ThreadPool(g_pika_conf->thread_pool_size(), 100000);
+  // Every shard owns a task queue, the threads are spread over shards
+  int thread_pool_size = g_pika_conf->thread_pool_size();
+  int shards = g_pika_conf->thread_pool_shards();
+  for (int i = 0; i < shards; i++) {
+    int shard_size = thread_pool_size / shards + (i < thread_pool_size % shards ? 1 : 0);
+    pika_thread_pools_.push_back(new pink::ThreadPool(shard_size, 100000 / shards));
+  }
+  next_thread_pool_shard_ = 0;
+  pika_prior_thread_pool_ = g_pika_conf->prior_thread_pool_size() > 0
+    ? new pink::ThreadPool(g_pika_conf->prior_thread_pool_size(), 100000) : NULL;
+  pika_slow_thread_pool_ = g_pika_conf->slow_thread_pool_size() > 0
+    ? new pink::ThreadPool(g_pika_conf->slow_thread_pool_size(), 100000) : NULL;
+  LOG(INFO) << "Thread pool size " << thread_pool_size << ", shards " << shards;
 
   pthread_rwlock_init(&state_protector_, NULL);
   pthread_rwlock_init(&slowlog_protector_, NULL);
@@ -102,7 +118,15 @@ PikaServer::~PikaServer() {
 
   // DispatchThread will use queue of worker thread,
   // so we need to delete dispatch before worker.
-  pika_thread_pool_->stop_thread_pool();
+  for (const auto& thread_pool : pika_thread_pools_) {
+    thread_pool->stop_thread_pool();
+  }
+  if (pika_prior_thread_pool_) {
+    pika_prior_thread_pool_->stop_thread_pool();
+  }
+  if (pika_slow_thread_pool_) {
+    pika_slow_thread_pool_->stop_thread_pool();
+  }
   delete pika_dispatch_thread_;
 
   {
@@ -117,11 +141,17 @@ PikaServer::~PikaServer() {
   delete pika_pubsub_thread_;
   delete pika_auxiliary_thread_;
   delete pika_rsync_service_;
-  delete pika_thread_pool_;
+  for (const auto& thread_pool : pika_thread_pools_) {
+    delete thread_pool;
+  }
+  delete pika_prior_thread_pool_;
+  delete pika_slow_thread_pool_;
   delete pika_monitor_thread_;
+  delete pika_slots_migrator_;
 
   bgsave_thread_.StopThread();
   key_scan_thread_.StopThread();
+  binlog_sync_thread_.StopThread();
 
   tables_.clear();
 
@@ -224,10 +254,19 @@ void PikaServer::Start() {
   // We Init Table Struct Before Start The following thread
   InitTableStruct();
 
-  ret = pika_thread_pool_->start_thread_pool();
-  if (ret != pink::kSuccess) {
-    tables_.clear();
-    LOG(FATAL) << "Start ThreadPool Error: " << ret << (ret == pink::kCreateThreadError ? ": create thread error " : ": other error");
+  std::vector<pink::ThreadPool*> thread_pools = pika_thread_pools_;
+  if (pika_prior_thread_pool_) {
+    thread_pools.push_back(pika_prior_thread_pool_);
+  }
+  if (pika_slow_thread_pool_) {
+    thread_pools.push_back(pika_slow_thread_pool_);
+  }
+  for (const auto& thread_pool : thread_pools) {
+    ret = thread_pool->start_thread_pool();
+    if (ret != pink::kSuccess) {
+      tables_.clear();
+      LOG(FATAL) << "Start ThreadPool Error: " << ret << (ret == pink::kCreateThreadError ? ": create thread error " : ": other error");
+    }
   }
   ret = pika_dispatch_thread_->StartThread();
   if (ret != pink::kSuccess) {
@@ -247,6 +286,13 @@ void PikaServer::Start() {
     LOG(FATAL) << "Start Auxiliary Thread Error: " << ret << (ret == pink::kCreateThreadError ? ": create thread error " : ": other error");
   }
 
+  ret = binlog_sync_thread_.StartThread();
+  if (ret != pink::kSuccess) {
+    tables_.clear();
+    LOG(FATAL) << "Start Binlog Sync Thread Error: " << ret << (ret == pink::kCreateThreadError ? ": create thread error " : ": other error");
+  }
+  binlog_sync_thread_.DelaySchedule(1000, &DoBinlogSync, static_cast<void*>(this));
+
   time(&start_time_s_);
 
   std::string slaveof = g_pika_conf->slaveof();
@@ -261,6 +307,19 @@ void PikaServer::Start() {
     }
   }
 
+  // Cleanups of split partitions stopped by the last shutdown
+  for (const auto& table_struct : g_pika_conf->table_structs()) {
+    std::shared_ptr<Table> table = GetTable(table_struct.table_name);
+    if (!table) {
+      continue;
+    }
+    for (uint32_t partition_id : table_struct.split_cleaning) {
+      LOG(INFO) << "Resume cleaning split partition " << partition_id
+        << " of " << table_struct.table_name;
+      table->CleanSplitPartition(partition_id);
+    }
+  }
+
   LOG(INFO) << "Pika Server going to start";
   while (!exit_) {
     DoTimingTask();
@@ -316,8 +375,7 @@ bool PikaServer::readonly(const std::string& table_name, const std::string& key)
       // swallow this error will process later
       return false;
     }
-    uint32_t index = g_pika_cmd_table_manager->DistributeKey(
-        key, table->PartitionNum());
+    uint32_t index = table->PartitionIdOfKey(key);
     int role = 0;
     Status s = g_pika_rm->CheckPartitionRole(table_name, index, &role);
     if (!s.ok()) {
@@ -391,7 +449,8 @@ void PikaServer::InitTableStruct() {
     std::string name = table.table_name;
     uint32_t num = table.partition_num;
     std::shared_ptr<Table> table_ptr = std::make_shared<Table>(
-        name, num, db_path, log_path);
+        name, num, db_path, log_path, table.key_hash, table.hash_tag);
+    table_ptr->SetHashMods(table.hash_mods);
     table_ptr->AddPartitions(table.partition_ids);
     tables_.emplace(name, table_ptr);
   }
@@ -522,6 +581,24 @@ Status PikaServer::DoSameThingSpecificTable(const TaskType& type, const std::set
   return Status::OK();
 }
 
+bool PikaServer::TryLockSlotState() {
+  SlotState expected = INFREE;
+  return std::atomic_compare_exchange_strong(&slot_state_, &expected, INBUSY);
+}
+
+void PikaServer::LockSlotState() {
+  slash::MutexLock l(&slot_state_mu_);
+  while (!TryLockSlotState()) {
+    slot_state_cv_.Wait();
+  }
+}
+
+void PikaServer::UnlockSlotState() {
+  slash::MutexLock l(&slot_state_mu_);
+  slot_state_.store(INFREE);
+  slot_state_cv_.SignalAll();
+}
+
 void PikaServer::PreparePartitionTrySync() {
   slash::RWLock rwl(&tables_rw_, false);
   ReplState state = force_full_sync_ ?
@@ -615,6 +692,9 @@ Status PikaServer::DoSameThingEveryPartition(const TaskType& type) {
         case TaskType::kPurgeLog:
           partition_item.second->PurgeLogs();
           break;
+        case TaskType::kSyncBinlog:
+          partition_item.second->SyncBinlog();
+          break;
         case TaskType::kCompactAll:
           partition_item.second->Compact(blackwidow::kAll);
           break;
@@ -854,8 +934,43 @@ void PikaServer::SetLoopPartitionStateMachine(bool need_loop) {
   loop_partition_state_machine_ = need_loop;
 }
 
-void PikaServer::Schedule(pink::TaskFunc func, void* arg) {
-  pika_thread_pool_->Schedule(func, arg);
+void PikaServer::Schedule(pink::TaskFunc func, void* arg, size_t shard,
+                          ExecMode mode) {
+  if (mode == kExecPriorPool && pika_prior_thread_pool_) {
+    pika_prior_thread_pool_->Schedule(func, arg);
+    return;
+  }
+  if (mode == kExecSlowPool && pika_slow_thread_pool_) {
+    pika_slow_thread_pool_->Schedule(func, arg);
+    return;
+  }
+  pika_thread_pools_[shard % pika_thread_pools_.size()]->Schedule(func, arg);
+}
+
+size_t PikaServer::ThreadPoolShards() {
+  return pika_thread_pools_.size();
+}
+
+bool PikaServer::HasThreadPool(ExecMode mode) {
+  switch (mode) {
+    case kExecPriorPool:
+      return pika_prior_thread_pool_ != NULL;
+    case kExecSlowPool:
+      return pika_slow_thread_pool_ != NULL;
+    default:
+      return true;
+  }
+}
+
+size_t PikaServer::ThreadPoolQueueSize(size_t shard) {
+  size_t qsize = 0;
+  pika_thread_pools_[shard % pika_thread_pools_.size()]->cur_queue_size(&qsize);
+  return qsize;
+}
+
+size_t PikaServer::NextThreadPoolShard() {
+  return next_thread_pool_shard_.fetch_add(1, std::memory_order_relaxed)
+    % pika_thread_pools_.size();
 }
 
 void PikaServer::BGSaveTaskSchedule(pink::TaskFunc func, void* arg) {
@@ -868,6 +983,15 @@ void PikaServer::PurgelogsTaskSchedule(pink::TaskFunc func, void* arg) {
   purge_thread_.Schedule(func, arg);
 }
 
+void PikaServer::DoBinlogSync(void* arg) {
+  PikaServer* p = static_cast<PikaServer*>(arg);
+  if (g_pika_conf->binlog_sync_policy() == kBinlogSyncEverysec) {
+    p->DoSameThingEveryPartition(TaskType::kSyncBinlog);
+  }
+  // Policy may be changed by config set, so keep scheduling
+  p->binlog_sync_thread_.DelaySchedule(1000, &DoBinlogSync, arg);
+}
+
 void PikaServer::PurgeDir(const std::string& path) {
   std::string* dir_path = new std::string(path);
   PurgeDirTaskSchedule(&DoPurgeDir, static_cast<void*>(dir_path));
@@ -1053,6 +1177,10 @@ void PikaServer::KeyScanTaskSchedule(pink::TaskFunc func, void* arg) {
   key_scan_thread_.Schedule(func, arg);
 }
 
+PikaSlotsMigrator* PikaServer::slots_migrator() {
+  return pika_slots_migrator_;
+}
+
 void PikaServer::ClientKillAll() {
   pika_dispatch_thread_->ClientKillAll();
   pika_monitor_thread_->ThreadClientKill();
@@ -1148,14 +1276,79 @@ void PikaServer::SlowlogPushEntry(const PikaCmdArgsType& argv, int32_t time, int
   SlowlogTrim();
 }
 
+ThreadStatistic::ThreadStatistic(size_t cmd_num)
+    : querynum_(0), cmd_num_(cmd_num), cmd_stats_(nullptr) {
+  size_t bytes = (sizeof(CmdStat) * cmd_num + kCacheLineSize - 1)
+    / kCacheLineSize * kCacheLineSize;
+  void* mem = nullptr;
+  if (posix_memalign(&mem, kCacheLineSize, bytes ? bytes : kCacheLineSize) != 0) {
+    LOG(FATAL) << "Alloc thread statistic failed";
+  }
+  cmd_stats_ = static_cast<CmdStat*>(mem);
+  for (size_t id = 0; id < cmd_num_; ++id) {
+    new (&cmd_stats_[id]) CmdStat();
+  }
+}
+
+ThreadStatistic::~ThreadStatistic() {
+  for (size_t id = 0; id < cmd_num_; ++id) {
+    cmd_stats_[id].~CmdStat();
+  }
+  free(cmd_stats_);
+}
+
+void ThreadStatistic::Reset() {
+  querynum_.store(0);
+  for (int mode = 0; mode < kExecModeNum; ++mode) {
+    exec_mode_stats_[mode].calls.store(0);
+    exec_mode_stats_[mode].usec.store(0);
+  }
+  for (size_t id = 0; id < cmd_num_; ++id) {
+    cmd_stats_[id].calls.store(0);
+    cmd_stats_[id].usec.store(0);
+  }
+}
+
+ThreadStatistic* PikaServer::CurrentThreadStatistic() {
+  static thread_local ThreadStatistic* stat = nullptr;
+  if (stat == nullptr) {
+    stat = new ThreadStatistic(statistic_data_.cmd_index.size());
+    slash::MutexLock l(&statistic_data_.thread_stats_mu);
+    statistic_data_.thread_stats.push_back(stat);
+  }
+  return stat;
+}
+
 void PikaServer::ResetStat() {
   statistic_data_.accumulative_connections.store(0);
-  statistic_data_.thread_querynum.store(0);
+  {
+  slash::MutexLock l(&statistic_data_.thread_stats_mu);
+  for (auto stat : statistic_data_.thread_stats) {
+    stat->Reset();
+  }
+  }
   statistic_data_.last_thread_querynum.store(0);
+  {
+  slash::RWLock table_rwl(&tables_rw_, false);
+  for (const auto& table_item : tables_) {
+    slash::RWLock partition_rwl(&table_item.second->partitions_rw_, false);
+    for (const auto& partition_item : table_item.second->partitions_) {
+      partition_item.second->KeyLocks()->ResetStatistic();
+    }
+  }
+  }
+  g_pika_rm->repl_lag_statistic().Reset();
+  g_pika_rm->binlog_ack_statistic().Reset();
+  g_pika_rm->binlog_compression_statistic().Reset();
 }
 
 uint64_t PikaServer::ServerQueryNum() {
-  return statistic_data_.thread_querynum.load();
+  uint64_t querynum = 0;
+  slash::MutexLock l(&statistic_data_.thread_stats_mu);
+  for (auto stat : statistic_data_.thread_stats) {
+    querynum += stat->querynum();
+  }
+  return querynum;
 }
 
 uint64_t PikaServer::ServerCurrentQps() {
@@ -1173,7 +1366,7 @@ void PikaServer::incr_accumulative_connections() {
 // only one thread invoke this right now
 void PikaServer::ResetLastSecQuerynum() {
   uint64_t last_query = statistic_data_.last_thread_querynum.load();
-  uint64_t cur_query = statistic_data_.thread_querynum.load();
+  uint64_t cur_query = ServerQueryNum();
   uint64_t last_time_us = statistic_data_.last_time_us.load();
   if (cur_query < last_query) {
     cur_query = last_query;
@@ -1190,28 +1383,74 @@ void PikaServer::ResetLastSecQuerynum() {
   statistic_data_.last_time_us.store(cur_time_us);
 }
 
-void PikaServer::UpdateQueryNumAndExecCountTable(const std::string& command) {
-  std::string cmd(command);
-  statistic_data_.thread_querynum++;
-  statistic_data_.exec_count_table[slash::StringToUpper(cmd)]++;
+void PikaServer::UpdateQueryNumAndExecCountTable(int cmd_id) {
+  ThreadStatistic* stat = CurrentThreadStatistic();
+  stat->AddQuery();
+  if (cmd_id >= 0) {
+    stat->AddCmdCall(cmd_id);
+  }
+}
+
+void PikaServer::UpdateCmdLatency(int cmd_id, uint64_t usec) {
+  if (cmd_id >= 0) {
+    CurrentThreadStatistic()->AddCmdLatency(cmd_id, usec);
+  }
 }
 
 std::unordered_map<std::string, uint64_t> PikaServer::ServerExecCountTable() {
   std::unordered_map<std::string, uint64_t> res;
-  for (auto& cmd : statistic_data_.exec_count_table) {
-    res[cmd.first] = cmd.second.load();
+  for (const auto& item : ServerCmdStats()) {
+    std::string name = item.first;
+    res[slash::StringToUpper(name)] = item.second.calls;
   }
   return res;
 }
 
+std::vector<CmdStatInfo> PikaServer::ServerCmdStatsById() {
+  std::vector<CmdStatInfo> infos(statistic_data_.cmd_index.size());
+  {
+  slash::MutexLock l(&statistic_data_.thread_stats_mu);
+  for (auto stat : statistic_data_.thread_stats) {
+    for (size_t id = 0; id < infos.size(); ++id) {
+      CmdStat& cmd_stat = stat->cmd_stat(id);
+      infos[id].calls += cmd_stat.calls.load(std::memory_order_relaxed);
+      infos[id].usec += cmd_stat.usec.load(std::memory_order_relaxed);
+    }
+  }
+  }
+  return infos;
+}
+
+std::map<std::string, CmdStatInfo> PikaServer::ServerCmdStats() {
+  std::vector<CmdStatInfo> infos = ServerCmdStatsById();
+  std::map<std::string, CmdStatInfo> res;
+  for (size_t id = 0; id < infos.size(); ++id) {
+    res[statistic_data_.cmd_index.name(id)] = infos[id];
+  }
+  return res;
+}
+
+void PikaServer::UpdateExecModeLatency(ExecMode mode, uint64_t usec) {
+  CurrentThreadStatistic()->AddExecBatch(mode, usec);
+}
+
+CmdStatInfo PikaServer::ServerExecModeStat(ExecMode mode) {
+  CmdStatInfo info;
+  slash::MutexLock l(&statistic_data_.thread_stats_mu);
+  for (auto stat : statistic_data_.thread_stats) {
+    CmdStat& mode_stat = stat->exec_mode_stat(mode);
+    info.calls += mode_stat.calls.load(std::memory_order_relaxed);
+    info.usec += mode_stat.usec.load(std::memory_order_relaxed);
+  }
+  return info;
+}
+
 int PikaServer::SendToPeer() {
   return g_pika_rm->ConsumeWriteQueue();
 }
 
 void PikaServer::SignalAuxiliary() {
-  pika_auxiliary_thread_->mu_.Lock();
-  pika_auxiliary_thread_->cv_.Signal();
-  pika_auxiliary_thread_->mu_.Unlock();
+  pika_auxiliary_thread_->Signal();
 }
 
 Status PikaServer::TriggerSendBinlogSync() {
@@ -1263,6 +1502,26 @@ void PikaServer::DoTimingTask() {
   AutoDeleteExpiredDump();
   // Cheek Rsync Status
   AutoKeepAliveRSync();
+  // Pick the commands for the slow lane
+  AutoClassifySlowCmds();
+  // Free the config snapshots nobody reads any more
+  g_pika_conf->FreeRetiredSnapshots();
+}
+
+void PikaServer::AutoClassifySlowCmds() {
+  std::vector<CmdStatInfo> cmd_stats = ServerCmdStatsById();
+  if (last_cmd_stats_.size() == cmd_stats.size()) {
+    for (size_t id = 0; id < cmd_stats.size(); ++id) {
+      uint64_t calls = cmd_stats[id].calls - last_cmd_stats_[id].calls;
+      uint64_t usec = cmd_stats[id].usec - last_cmd_stats_[id].usec;
+      // Keep the former choice while it is not called
+      if (calls == 0 || cmd_stats[id].calls < last_cmd_stats_[id].calls) {
+        continue;
+      }
+      g_pika_cmd_table_manager->SetSlowByCost(id, usec / calls > kSlowCmdMeanUsec);
+    }
+  }
+  last_cmd_stats_ = cmd_stats;
 }
 
 void PikaServer::AutoCompactRange() {
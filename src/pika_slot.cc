@@ -3,14 +3,12 @@
 // LICENSE file in the root directory of this source tree. An additional grant
 // of patent rights can be found in the PATENTS file in the same directory.
 
-#include "include/pika_rm.h"
 #include "include/pika_slot.h"
 #include "include/pika_table.h"
 #include "include/pika_server.h"
 #include "include/pika_cmd_table_manager.h"
 
 extern PikaCmdTableManager* g_pika_cmd_table_manager;
-extern PikaReplicaManager* g_pika_rm;
 extern PikaServer* g_pika_server;
 extern PikaConf* g_pika_conf;
 
@@ -35,9 +33,11 @@ void SlotsInfoCmd::Do(std::shared_ptr<Partition> partition) {
     res_.SetRes(CmdRes::kNotFound, kCmdNameSlotsInfo);
     return;
   }
-  table_ptr->KeyScan();
-  // this get will get last time scan info
-  KeyScanInfo key_scan_info = table_ptr->GetKeyScanInfo();
+  // The counts are approximate: each is the one of the last count of
+  // the slot, which is only done again in background, for slots written
+  // since then, or holding keys with a ttl and counted over
+  // kKeyNumExpireRecountSec ago. A slot untouched since is exact
+  table_ptr->RefreshKeyNum();
 
   std::map<uint32_t, KeyScanInfo> infos;
   Status s = table_ptr->GetPartitionsKeyScanInfo(&infos);
@@ -76,18 +76,90 @@ void SlotsHashKeyCmd::DoInitial() {
 void SlotsHashKeyCmd::Do(std::shared_ptr<Partition> partition) {
   res_.AppendArrayLen(argv_.size() - 1);
   std::shared_ptr<Table> table_ptr = g_pika_server->GetTable(g_pika_conf->default_table());
-  uint32_t partition_num = table_ptr->PartitionNum();
   if (!table_ptr) {
     res_.SetRes(CmdRes::kInvalidParameter, kCmdNameSlotsHashKey);
+    return;
   }
   // iter starts from real key, first item in argv_ is command name
   std::vector<std::string>::const_iterator iter = argv_.begin() + 1;
   for (; iter != argv_.end(); iter++) {
-    res_.AppendInteger(g_pika_cmd_table_manager->DistributeKey(*iter, partition_num));
+    res_.AppendInteger(table_ptr->PartitionIdOfKey(*iter));
   }
   return;
 }
 
+// Parse "host port timeout" of the slotsmgrt commands, the rest is left
+// to the caller
+static bool ParseMigrateTarget(const PikaCmdArgsType& argv, const std::string& cmd_name,
+                               SlotsMigrateArgs* args, CmdRes* res) {
+  args->dest_ip = argv[1];
+  slash::StringToLower(args->dest_ip);
+  if (!slash::string2l(argv[2].data(), argv[2].size(), &args->dest_port)
+    || args->dest_port <= 0) {
+    res->SetRes(CmdRes::kInvalidInt, cmd_name);
+    return false;
+  }
+  if ((args->dest_ip == "127.0.0.1" || args->dest_ip == g_pika_server->host())
+    && args->dest_port == g_pika_server->port()) {
+    res->SetRes(CmdRes::kErrOther, "destination address error");
+    return false;
+  }
+  if (!slash::string2l(argv[3].data(), argv[3].size(), &args->timeout_ms)
+    || args->timeout_ms < 0) {
+    res->SetRes(CmdRes::kInvalidInt, cmd_name);
+    return false;
+  }
+  args->table = g_pika_conf->default_table();
+  return true;
+}
+
+static bool ParseMigrateSlot(const std::string& str, const std::string& cmd_name,
+                             SlotsMigrateArgs* args, CmdRes* res) {
+  if (!slash::string2l(str.data(), str.size(), &args->slot)
+    || args->slot < 0 || args->slot >= g_pika_conf->default_slot_num()) {
+    res->SetRes(CmdRes::kInvalidInt, cmd_name);
+    return false;
+  }
+  return true;
+}
+
+// Parse "host port timeout maxbulks maxbytes slot numkeys"
+static bool ParseMigrateAsyncArgs(const PikaCmdArgsType& argv, const std::string& cmd_name,
+                                  SlotsMigrateArgs* args, CmdRes* res) {
+  if (!ParseMigrateTarget(argv, cmd_name, args, res)) {
+    return false;
+  }
+  if (!slash::string2l(argv[4].data(), argv[4].size(), &args->max_bulks)
+    || args->max_bulks < 0
+    || !slash::string2l(argv[5].data(), argv[5].size(), &args->max_bytes)
+    || args->max_bytes < 0) {
+    res->SetRes(CmdRes::kInvalidInt, cmd_name);
+    return false;
+  }
+  if (!ParseMigrateSlot(argv[6], cmd_name, args, res)) {
+    return false;
+  }
+  if (!slash::string2l(argv[7].data(), argv[7].size(), &args->batch_keys)
+    || args->batch_keys <= 0) {
+    res->SetRes(CmdRes::kInvalidInt, cmd_name);
+    return false;
+  }
+  return true;
+}
+
+static void MigrateSlotAsync(const SlotsMigrateArgs& args, CmdRes* res) {
+  int64_t moved = 0;
+  int64_t remained = 0;
+  Status s = g_pika_server->slots_migrator()->MigrateAsync(args, &moved, &remained);
+  if (!s.ok()) {
+    res->SetRes(CmdRes::kErrOther, s.ToString());
+    return;
+  }
+  res->AppendArrayLen(2);
+  res->AppendInteger(moved);
+  res->AppendInteger(remained);
+}
+
 // slotsmgrtslot-async host port timeout maxbulks maxbytes slot numkeys
 void SlotsMgrtSlotAsyncCmd::DoInitial() {
   if (!CheckArg(argv_.size())) {
@@ -96,19 +168,16 @@ void SlotsMgrtSlotAsyncCmd::DoInitial() {
   }
 
   if (g_pika_conf->classic_mode()) {
-    res_.SetRes(CmdRes::kErrOther, "SLOTSMGRTTAGSLOT-ASYNC only support on sharding mode");
+    res_.SetRes(CmdRes::kErrOther, "SLOTSMGRTSLOT-ASYNC only support on sharding mode");
     return;
   }
 
+  ParseMigrateAsyncArgs(argv_, kCmdNameSlotsMgrtSlotAsync, &args_, &res_);
   return;
 }
 
 void SlotsMgrtSlotAsyncCmd::Do(std::shared_ptr<Partition> partition) {
-  int64_t moved = 0;
-  int64_t remained = 0;
-  res_.AppendArrayLen(2);
-  res_.AppendInteger(moved);
-  res_.AppendInteger(remained);
+  MigrateSlotAsync(args_, &res_);
 }
 
 // SLOTSMGRTTAGSLOT-ASYNC host port timeout maxbulks maxbytes slot numkeys
@@ -123,57 +192,15 @@ void SlotsMgrtTagSlotAsyncCmd::DoInitial() {
     return;
   }
 
-  PikaCmdArgsType::const_iterator it = argv_.begin() + 1; //Remember the first args is the opt name
-  dest_ip_ = *it++;
-  slash::StringToLower(dest_ip_);
-
-  std::string str_dest_port = *it++;
-  if (!slash::string2l(str_dest_port.data(), str_dest_port.size(), &dest_port_) || dest_port_ <= 0) {
-    res_.SetRes(CmdRes::kInvalidInt, kCmdNameSlotsMgrtTagSlotAsync);
-    return;
-  }
-
-  if ((dest_ip_ == "127.0.0.1" || dest_ip_ == g_pika_server->host()) && dest_port_ == g_pika_server->port()) {
-    res_.SetRes(CmdRes::kErrOther, "destination address error");
-    return;
-  }
-
-  std::string str_timeout_ms = *it++;
-
-  std::string str_max_bulks = *it++;
-
-  std::string str_max_bytes_ = *it++;
-
-  std::string str_slot_num = *it++;
-  if (!slash::string2l(str_slot_num.data(), str_slot_num.size(), &slot_num_)
-      || slot_num_ < 0 || slot_num_ >= g_pika_conf->default_slot_num()) {
-    res_.SetRes(CmdRes::kInvalidInt, kCmdNameSlotsMgrtTagSlotAsync);
-    return;
-  }
-
-  std::string str_keys_num = *it++;
+  ParseMigrateAsyncArgs(argv_, kCmdNameSlotsMgrtTagSlotAsync, &args_, &res_);
+  args_.with_tag = true;
   return;
 }
 
+// Keys sharing a tag are sent and deleted in one batch, so the tag is
+// never served by two servers at once
 void SlotsMgrtTagSlotAsyncCmd::Do(std::shared_ptr<Partition> partition) {
-  int64_t moved = 0;
-  int64_t remained = 0;
-  // check if this slave node exist.
-  // if exist, dont mark migrate done
-  // cache coming request in codis proxy and keep retrying
-  // Until sync done, new node slaveof no one.
-  // mark this migrate done
-  // proxy retry cached request in new node
-  bool is_exist = g_pika_rm->CheckPartitionSlaveExist(
-      RmNode(dest_ip_, dest_port_, g_pika_conf->default_table(), slot_num_));
-  if (is_exist) {
-    remained = 1;
-  } else {
-    remained = 0;
-  }
-  res_.AppendArrayLen(2);
-  res_.AppendInteger(moved);
-  res_.AppendInteger(remained);
+  MigrateSlotAsync(args_, &res_);
 }
 
 // SLOTSSCAN slotnum cursor [COUNT count]
@@ -330,10 +357,82 @@ void SlotsMgrtExecWrapperCmd::Do(std::shared_ptr<Partition> partition) {
   // return 0 means proxy will request to new slot server
   // return 1 means proxy will keey trying
   // return 2 means return this key directly
+  std::shared_ptr<Partition> cur_partition =
+    g_pika_server->GetTablePartitionByKey(table_name_, key_);
+  if (!cur_partition) {
+    res_.AppendArrayLen(2);
+    res_.AppendInteger(0);
+    res_.AppendString("key not found");
+    return;
+  }
+
+  PikaCmdArgsType argv(argv_.begin() + 2, argv_.end());
+  std::shared_ptr<Cmd> c_ptr =
+    g_pika_cmd_table_manager->GetCmd(g_pika_cmd_table_manager->GetCmdId(argv));
+  if (!c_ptr) {
+    res_.SetRes(CmdRes::kErrOther, "unknown command \'" + argv[0] + "\'");
+    return;
+  }
+  c_ptr->SetConn(GetConn());
+  c_ptr->Initial(argv, table_name_);
+  if (!c_ptr->res().ok()) {
+    res_.AppendArrayLen(2);
+    res_.AppendInteger(2);
+    res_.AppendStringRaw(c_ptr->res().TakeMessage());
+    return;
+  }
+
+  // Locks are only taken in the partition of key
+  for (const auto& key : c_ptr->keys()) {
+    if (g_pika_server->GetTablePartitionByKey(table_name_, key) != cur_partition) {
+      res_.SetRes(CmdRes::kCrossSlot, "keys of the command are not in the slot of " + key_);
+      return;
+    }
+  }
+
+  // The migrator marks the keys it is about to send under the same locks
+  // and unmarks them once deleted, so the command runs either before the
+  // dump, or after the keys are gone, never in between
+  std::vector<std::string> lock_keys = c_ptr->keys();
+  lock_keys.push_back(key_);
+  std::vector<uint32_t> lock_stripes;
+  cur_partition->KeyLocks()->Lock(lock_keys, &lock_stripes);
+  // Any key being sent holds the command back, and it is only sent to
+  // the new server once none of its keys is left here
+  bool migrating = false;
+  for (const auto& key : lock_keys) {
+    if (g_pika_server->slots_migrator()->IsMigrating(key)) {
+      migrating = true;
+      break;
+    }
+  }
+  int64_t reply_code = 2;
+  std::string reply;
+  std::map<blackwidow::DataType, blackwidow::Status> type_status;
+  if (migrating) {
+    reply_code = 1;
+    reply = "key is being migrated, try again later";
+  } else if (cur_partition->db()->Exists(lock_keys, &type_status) <= 0) {
+    reply_code = 0;
+    reply = "key not found";
+  } else {
+    if (c_ptr->is_write() && g_pika_server->readonly(table_name_, key_)) {
+      c_ptr->res().SetRes(CmdRes::kErrOther, "Server in read-only");
+    } else {
+      c_ptr->SetKeysLocked(true);
+      c_ptr->Execute();
+    }
+    reply = c_ptr->res().TakeMessage();
+  }
+  cur_partition->KeyLocks()->Unlock(lock_stripes);
+
   res_.AppendArrayLen(2);
-  res_.AppendInteger(1);
-  res_.AppendInteger(1);
-  return;
+  res_.AppendInteger(reply_code);
+  if (reply_code == 2) {
+    res_.AppendStringRaw(reply);
+  } else {
+    res_.AppendString(reply);
+  }
 }
 
 // slotsmgrt-async-status
@@ -353,23 +452,24 @@ void SlotsMgrtAsyncStatusCmd::DoInitial() {
 
 void SlotsMgrtAsyncStatusCmd::Do(std::shared_ptr<Partition> partition) {
   std::string status;
-  std::string ip = "none";
-  int64_t port = -1, slot = -1, moved = -1, remained = -1;
-  std::string mstatus = "no";
+  SlotsMigrateStatus migrate_status = g_pika_server->slots_migrator()->GetStatus();
+  std::string ip = migrate_status.dest_ip.empty() ? "none" : migrate_status.dest_ip;
+  int64_t port = migrate_status.dest_ip.empty() ? -1 : migrate_status.dest_port;
+  std::string mstatus = migrate_status.migrating ? "yes" : "no";
   res_.AppendArrayLen(5);
   status = "dest server: " + ip + ":" + std::to_string(port);
   res_.AppendStringLen(status.size());
   res_.AppendContent(status);
-  status = "slot number: " + std::to_string(slot);
+  status = "slot number: " + std::to_string(migrate_status.slot);
   res_.AppendStringLen(status.size());
   res_.AppendContent(status);
   status = "migrating  : " + mstatus;
   res_.AppendStringLen(status.size());
   res_.AppendContent(status);
-  status = "moved keys : " + std::to_string(moved);
+  status = "moved keys : " + std::to_string(migrate_status.moved);
   res_.AppendStringLen(status.size());
   res_.AppendContent(status);
-  status = "remain keys: " + std::to_string(remained);
+  status = "remain keys: " + std::to_string(migrate_status.remained);
   res_.AppendStringLen(status.size());
   res_.AppendContent(status);
   return;
@@ -391,46 +491,167 @@ void SlotsMgrtAsyncCancelCmd::DoInitial() {
 }
 
 void SlotsMgrtAsyncCancelCmd::Do(std::shared_ptr<Partition> partition) {
+  g_pika_server->slots_migrator()->Cancel();
   res_.SetRes(CmdRes::kOk);
   return;
 }
 
+// A key of the partition, false if it is empty
+static bool AnyKeyOfPartition(const std::shared_ptr<Partition>& partition,
+                              std::string* key) {
+  int64_t cursor = 0;
+  do {
+    std::vector<std::string> keys;
+    cursor = partition->db()->Scan(blackwidow::DataType::kAll, cursor, "*", 1, &keys);
+    if (!keys.empty()) {
+      *key = keys.front();
+      return true;
+    }
+  } while (cursor != 0);
+  return false;
+}
+
+// Move one key of the slot, with the keys sharing its tag if with_tag,
+// reply moved and remained, remained is 1 until the slot is empty
+static void MigrateSlotOneKey(const SlotsMigrateArgs& args, bool with_tag, CmdRes* res) {
+  std::shared_ptr<Table> table_ptr = g_pika_server->GetTable(args.table);
+  if (!table_ptr) {
+    res->SetRes(CmdRes::kInvalidTable);
+    return;
+  }
+  std::shared_ptr<Partition> partition = table_ptr->GetPartitionById(args.slot);
+  if (!partition) {
+    res->SetRes(CmdRes::kErrOther, "slot " + std::to_string(args.slot) + " not found");
+    return;
+  }
+  int64_t moved = 0;
+  std::string key;
+  if (AnyKeyOfPartition(partition, &key)) {
+    std::vector<std::string> keys = with_tag
+      ? KeysOfTag(table_ptr, partition, key) : std::vector<std::string>{key};
+    Status s = g_pika_server->slots_migrator()->MigrateKeys(args, keys, &moved);
+    if (!s.ok()) {
+      res->SetRes(CmdRes::kErrOther, s.ToString());
+      return;
+    }
+  }
+  res->AppendArrayLen(2);
+  res->AppendInteger(moved);
+  res->AppendInteger(AnyKeyOfPartition(partition, &key) ? 1 : 0);
+}
+
+// Move key to the target, with the keys sharing its tag if with_tag,
+// reply the number of them that were here
+static void MigrateOneKey(SlotsMigrateArgs* args, const std::string& key,
+                          bool with_tag, CmdRes* res) {
+  std::shared_ptr<Table> table_ptr = g_pika_server->GetTable(args->table);
+  if (!table_ptr) {
+    res->SetRes(CmdRes::kInvalidTable);
+    return;
+  }
+  args->slot = table_ptr->PartitionIdOfKey(key);
+  std::vector<std::string> keys{key};
+  std::shared_ptr<Partition> partition = table_ptr->GetPartitionById(args->slot);
+  if (with_tag && partition) {
+    keys = KeysOfTag(table_ptr, partition, key);
+  }
+  int64_t moved = 0;
+  Status s = g_pika_server->slots_migrator()->MigrateKeys(*args, keys, &moved);
+  if (!s.ok()) {
+    res->SetRes(CmdRes::kErrOther, s.ToString());
+    return;
+  }
+  res->AppendInteger(moved);
+}
+
 // slotsmgrtslot host port timeout slot
 void SlotsMgrtSlotCmd::DoInitial() {
-  res_.SetRes(CmdRes::kErrOther, kCmdNameSlotsMgrtSlot + " NOT supported");
+  if (!CheckArg(argv_.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameSlotsMgrtSlot);
+    return;
+  }
+
+  if (g_pika_conf->classic_mode()) {
+    res_.SetRes(CmdRes::kErrOther, "SLOTSMGRTSLOT only support on sharding mode");
+    return;
+  }
+
+  if (ParseMigrateTarget(argv_, kCmdNameSlotsMgrtSlot, &args_, &res_)) {
+    ParseMigrateSlot(argv_[4], kCmdNameSlotsMgrtSlot, &args_, &res_);
+  }
   return;
 }
 
 void SlotsMgrtSlotCmd::Do(std::shared_ptr<Partition> partition) {
+  MigrateSlotOneKey(args_, false, &res_);
   return;
 }
 
 // slotsmgrttagslot host port timeout slot
 void SlotsMgrtTagSlotCmd::DoInitial() {
-  res_.SetRes(CmdRes::kErrOther, kCmdNameSlotsMgrtTagSlot + " NOT supported");
+  if (!CheckArg(argv_.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameSlotsMgrtTagSlot);
+    return;
+  }
+
+  if (g_pika_conf->classic_mode()) {
+    res_.SetRes(CmdRes::kErrOther, "SLOTSMGRTTAGSLOT only support on sharding mode");
+    return;
+  }
+
+  if (ParseMigrateTarget(argv_, kCmdNameSlotsMgrtTagSlot, &args_, &res_)) {
+    ParseMigrateSlot(argv_[4], kCmdNameSlotsMgrtTagSlot, &args_, &res_);
+  }
   return;
 }
 
 void SlotsMgrtTagSlotCmd::Do(std::shared_ptr<Partition> partition) {
+  MigrateSlotOneKey(args_, true, &res_);
   return;
 }
 
 // slotsmgrtone host port timeout key
 void SlotsMgrtOneCmd::DoInitial() {
-  res_.SetRes(CmdRes::kErrOther, kCmdNameSlotsMgrtOne + " NOT supported");
+  if (!CheckArg(argv_.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameSlotsMgrtOne);
+    return;
+  }
+
+  if (g_pika_conf->classic_mode()) {
+    res_.SetRes(CmdRes::kErrOther, "SLOTSMGRTONE only support on sharding mode");
+    return;
+  }
+
+  if (ParseMigrateTarget(argv_, kCmdNameSlotsMgrtOne, &args_, &res_)) {
+    key_ = argv_[4];
+  }
   return;
 }
 
 void SlotsMgrtOneCmd::Do(std::shared_ptr<Partition> partition) {
+  MigrateOneKey(&args_, key_, false, &res_);
   return;
 }
 
 // slotsmgrttagone host port timeout key
 void SlotsMgrtTagOneCmd::DoInitial() {
-  res_.SetRes(CmdRes::kErrOther, kCmdNameSlotsMgrtTagOne + " NOT supported");
+  if (!CheckArg(argv_.size())) {
+    res_.SetRes(CmdRes::kWrongNum, kCmdNameSlotsMgrtTagOne);
+    return;
+  }
+
+  if (g_pika_conf->classic_mode()) {
+    res_.SetRes(CmdRes::kErrOther, "SLOTSMGRTTAGONE only support on sharding mode");
+    return;
+  }
+
+  if (ParseMigrateTarget(argv_, kCmdNameSlotsMgrtTagOne, &args_, &res_)) {
+    key_ = argv_[4];
+  }
   return;
 }
 
 void SlotsMgrtTagOneCmd::Do(std::shared_ptr<Partition> partition) {
+  MigrateOneKey(&args_, key_, true, &res_);
   return;
 }
@@ -0,0 +1,600 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+#include "include/pika_slot_migrator.h"
+
+#include <unordered_map>
+
+#include <glog/logging.h>
+
+#include "slash/include/slash_string.h"
+
+#include "include/pika_conf.h"
+#include "include/pika_table.h"
+#include "include/pika_server.h"
+#include "include/pika_cmd_table_manager.h"
+#include "include/pika_data_distribution.h"
+
+extern PikaCmdTableManager* g_pika_cmd_table_manager;
+extern PikaServer* g_pika_server;
+extern PikaConf* g_pika_conf;
+
+// fields, elements or members carried by one command of a collection
+static const int64_t kSlotsMigrateChunk = 128;
+static const int64_t kSlotsMigrateDefaultTimeoutMs = 1000;
+
+// Commands queued for the target and not replied yet
+struct SlotsMigratePipeline {
+  std::string buf;
+  int64_t bulks;
+  SlotsMigratePipeline() : bulks(0) {}
+};
+
+static void AppendCommand(const pink::RedisCmdArgsType& argv,
+                          SlotsMigratePipeline* pipeline) {
+  std::string cmd;
+  pink::SerializeRedisCommand(argv, &cmd);
+  pipeline->buf.append(cmd);
+  pipeline->bulks++;
+}
+
+// Send the queued commands, every reply should be OK or an integer
+static Status FlushPipeline(pink::PinkCli* cli, SlotsMigratePipeline* pipeline) {
+  if (pipeline->bulks == 0) {
+    return Status::OK();
+  }
+  Status s = cli->Send(&pipeline->buf);
+  if (!s.ok()) {
+    return s;
+  }
+  pink::RedisCmdArgsType reply;
+  for (int64_t i = 0; i < pipeline->bulks; i++) {
+    reply.clear();
+    s = cli->Recv(&reply);
+    if (!s.ok()) {
+      return s;
+    }
+    long long ival;
+    if (reply.empty()
+      || (reply[0] != "OK"
+        && !slash::string2ll(reply[0].data(), reply[0].size(), &ival))) {
+      return Status::Corruption("target replied "
+                                + (reply.empty() ? std::string("nothing") : reply[0]));
+    }
+  }
+  pipeline->buf.clear();
+  pipeline->bulks = 0;
+  return Status::OK();
+}
+
+static bool PipelineFull(const SlotsMigrateArgs& args,
+                         const SlotsMigratePipeline& pipeline) {
+  return (args.max_bulks > 0 && pipeline.bulks >= args.max_bulks)
+    || (args.max_bytes > 0 && static_cast<int64_t>(pipeline.buf.size()) >= args.max_bytes);
+}
+
+// Queue the commands rebuilding key of every type at the target a chunk
+// at a time, flushing whenever the pipeline is full, so a big collection
+// is never held whole, found is false if the key is gone. The db is only
+// locked while reading, not while waiting for the target
+static Status DumpKey(pink::PinkCli* cli, const SlotsMigrateArgs& args,
+                      const std::shared_ptr<Partition>& partition,
+                      const std::string& key,
+                      SlotsMigratePipeline* pipeline, bool* found) {
+  std::shared_ptr<blackwidow::BlackWidow> db = partition->db();
+  *found = false;
+  auto emit = [&](const pink::RedisCmdArgsType& argv) -> Status {
+    // Drop what the target had of key before its first chunk
+    if (!*found) {
+      AppendCommand({"del", key}, pipeline);
+      *found = true;
+    }
+    AppendCommand(argv, pipeline);
+    return PipelineFull(args, *pipeline) ? FlushPipeline(cli, pipeline) : Status::OK();
+  };
+  Status es;
+
+  std::string value;
+  partition->DbRWLockReader();
+  rocksdb::Status s = db->Get(key, &value);
+  partition->DbRWUnLock();
+  if (s.ok()) {
+    es = emit({"set", key, value});
+    if (!es.ok()) {
+      return es;
+    }
+  } else if (!s.IsNotFound()) {
+    return Status::Corruption("get " + key + " " + s.ToString());
+  }
+
+  int64_t cursor = 0;
+  do {
+    std::vector<blackwidow::FieldValue> fvs;
+    partition->DbRWLockReader();
+    s = db->HScan(key, cursor, "*", kSlotsMigrateChunk, &fvs, &cursor);
+    partition->DbRWUnLock();
+    if (!s.ok() && !s.IsNotFound()) {
+      return Status::Corruption("hscan " + key + " " + s.ToString());
+    }
+    if (!s.ok() || fvs.empty()) {
+      break;
+    }
+    pink::RedisCmdArgsType argv = {"hmset", key};
+    for (const auto& fv : fvs) {
+      argv.push_back(fv.field);
+      argv.push_back(fv.value);
+    }
+    es = emit(argv);
+    if (!es.ok()) {
+      return es;
+    }
+  } while (cursor != 0);
+
+  for (int64_t start = 0; ; start += kSlotsMigrateChunk) {
+    std::vector<std::string> values;
+    partition->DbRWLockReader();
+    s = db->LRange(key, start, start + kSlotsMigrateChunk - 1, &values);
+    partition->DbRWUnLock();
+    if (!s.ok() && !s.IsNotFound()) {
+      return Status::Corruption("lrange " + key + " " + s.ToString());
+    }
+    if (!s.ok() || values.empty()) {
+      break;
+    }
+    pink::RedisCmdArgsType argv = {"rpush", key};
+    argv.insert(argv.end(), values.begin(), values.end());
+    es = emit(argv);
+    if (!es.ok()) {
+      return es;
+    }
+    if (static_cast<int64_t>(values.size()) < kSlotsMigrateChunk) {
+      break;
+    }
+  }
+
+  cursor = 0;
+  do {
+    std::vector<std::string> members;
+    partition->DbRWLockReader();
+    s = db->SScan(key, cursor, "*", kSlotsMigrateChunk, &members, &cursor);
+    partition->DbRWUnLock();
+    if (!s.ok() && !s.IsNotFound()) {
+      return Status::Corruption("sscan " + key + " " + s.ToString());
+    }
+    if (!s.ok() || members.empty()) {
+      break;
+    }
+    pink::RedisCmdArgsType argv = {"sadd", key};
+    argv.insert(argv.end(), members.begin(), members.end());
+    es = emit(argv);
+    if (!es.ok()) {
+      return es;
+    }
+  } while (cursor != 0);
+
+  cursor = 0;
+  do {
+    std::vector<blackwidow::ScoreMember> score_members;
+    partition->DbRWLockReader();
+    s = db->ZScan(key, cursor, "*", kSlotsMigrateChunk, &score_members, &cursor);
+    partition->DbRWUnLock();
+    if (!s.ok() && !s.IsNotFound()) {
+      return Status::Corruption("zscan " + key + " " + s.ToString());
+    }
+    if (!s.ok() || score_members.empty()) {
+      break;
+    }
+    pink::RedisCmdArgsType argv = {"zadd", key};
+    char buf[32];
+    for (const auto& sm : score_members) {
+      int len = slash::d2string(buf, sizeof(buf), sm.score);
+      argv.push_back(std::string(buf, len));
+      argv.push_back(sm.member);
+    }
+    es = emit(argv);
+    if (!es.ok()) {
+      return es;
+    }
+  } while (cursor != 0);
+
+  if (!*found) {
+    return Status::OK();
+  }
+
+  // Types of a key share the expire set by EXPIRE, take the longest
+  std::map<blackwidow::DataType, blackwidow::Status> type_status;
+  partition->DbRWLockReader();
+  std::map<blackwidow::DataType, int64_t> ttls = db->TTL(key, &type_status);
+  partition->DbRWUnLock();
+  int64_t ttl = -1;
+  for (const auto& item : ttls) {
+    ttl = std::max(ttl, item.second);
+  }
+  if (ttl > 0) {
+    AppendCommand({"expire", key, std::to_string(ttl)}, pipeline);
+  }
+  return Status::OK();
+}
+
+// Keys of a partition with a {tag}, by their tag
+typedef std::unordered_map<std::string, std::vector<std::string>> TagKeysMap;
+
+// tag as a literal scan pattern
+static std::string EscapePattern(const std::string& tag) {
+  std::string escaped;
+  for (const char c : tag) {
+    if (c == '*' || c == '?' || c == '[' || c == ']' || c == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(c);
+  }
+  return escaped;
+}
+
+std::vector<std::string> KeysOfTag(const std::shared_ptr<Table>& table,
+                                   const std::shared_ptr<Partition>& partition,
+                                   const std::string& key) {
+  std::vector<std::string> tag_keys{key};
+  size_t tag_pos = 0, tag_len = 0;
+  if (!table->hash_tag() || !HashTagOf(key, &tag_pos, &tag_len)) {
+    return tag_keys;
+  }
+  std::string tag = key.substr(tag_pos, tag_len);
+  // The pattern keeps the keys holding "{tag}" anywhere, those with
+  // another tag before it are left out after
+  std::string pattern = "*{" + EscapePattern(tag) + "}*";
+  std::unordered_set<std::string> seen{key};
+  int64_t cursor = 0;
+  do {
+    std::vector<std::string> keys;
+    cursor = partition->db()->Scan(blackwidow::DataType::kAll, cursor, pattern,
+                                   PIKA_SCAN_STEP_LENGTH, &keys);
+    for (const auto& found : keys) {
+      // A key may be of several types
+      if (HashTagOf(found, &tag_pos, &tag_len)
+        && found.compare(tag_pos, tag_len, tag) == 0
+        && seen.insert(found).second) {
+        tag_keys.push_back(found);
+      }
+    }
+  } while (cursor != 0);
+  return tag_keys;
+}
+
+// Count the keys of partition, indexing those with a {tag} in tag_keys
+// if given
+static int64_t ScanPartition(const std::shared_ptr<Partition>& partition,
+                             const std::atomic<bool>& cancel,
+                             TagKeysMap* tag_keys) {
+  int64_t count = 0;
+  int64_t cursor = 0;
+  size_t tag_pos = 0, tag_len = 0;
+  do {
+    std::vector<std::string> keys;
+    cursor = partition->db()->Scan(blackwidow::DataType::kAll, cursor, "*",
+                                   PIKA_SCAN_STEP_LENGTH, &keys);
+    count += keys.size();
+    if (!tag_keys) {
+      continue;
+    }
+    for (const auto& key : keys) {
+      if (HashTagOf(key, &tag_pos, &tag_len)) {
+        (*tag_keys)[key.substr(tag_pos, tag_len)].push_back(key);
+      }
+    }
+  } while (cursor != 0 && !cancel.load());
+  return count;
+}
+
+// keys with the keys sharing a {tag} with them, so a batch never leaves
+// part of a tag behind, it may grow past batch_keys for that. A tag is
+// taken out of tag_keys once grouped, keys given it later in the pass
+// go with the pass after
+static std::vector<std::string> GroupKeysByTag(const std::vector<std::string>& keys,
+                                               TagKeysMap* tag_keys) {
+  std::vector<std::string> grouped;
+  std::unordered_set<std::string> seen;
+  size_t tag_pos = 0, tag_len = 0;
+  for (const auto& key : keys) {
+    if (seen.insert(key).second) {
+      grouped.push_back(key);
+    }
+    if (!HashTagOf(key, &tag_pos, &tag_len)) {
+      continue;
+    }
+    auto iter = tag_keys->find(key.substr(tag_pos, tag_len));
+    if (iter == tag_keys->end()) {
+      continue;
+    }
+    for (const auto& tag_key : iter->second) {
+      if (seen.insert(tag_key).second) {
+        grouped.push_back(tag_key);
+      }
+    }
+    tag_keys->erase(iter);
+  }
+  return grouped;
+}
+
+static bool SameMigration(const SlotsMigrateArgs& a, const SlotsMigrateArgs& b) {
+  return a.dest_ip == b.dest_ip && a.dest_port == b.dest_port
+    && a.table == b.table && a.slot == b.slot;
+}
+
+PikaSlotsMigrator::PikaSlotsMigrator()
+    : migrating_(false),
+      moved_(0),
+      remained_(0),
+      cancel_(false) {
+  migrate_thread_.set_thread_name("SlotsMigrateThread");
+}
+
+PikaSlotsMigrator::~PikaSlotsMigrator() {
+  cancel_.store(true);
+  migrate_thread_.StopThread();
+}
+
+Status PikaSlotsMigrator::MigrateAsync(const SlotsMigrateArgs& args,
+                                       int64_t* moved, int64_t* remained) {
+  slash::MutexLock l(&mu_);
+  if (migrating_) {
+    if (!SameMigration(args, args_)) {
+      return Status::Busy("slot " + std::to_string(args_.slot) + " is migrating to "
+                          + args_.dest_ip + ":" + std::to_string(args_.dest_port));
+    }
+    args_.timeout_ms = args.timeout_ms;
+    args_.max_bulks = args.max_bulks;
+    args_.max_bytes = args.max_bytes;
+    args_.batch_keys = args.batch_keys;
+    *moved = moved_;
+    *remained = remained_;
+    return Status::OK();
+  }
+  if (!last_status_.ok()) {
+    Status s = last_status_;
+    last_status_ = Status::OK();
+    return s;
+  }
+
+  std::shared_ptr<Partition> partition =
+    g_pika_server->GetTablePartitionById(args.table, args.slot);
+  if (!partition) {
+    return Status::NotFound("slot " + std::to_string(args.slot) + " not found");
+  }
+  // The last count of the slot for now, migrate_thread_ counts again
+  int64_t count = 0;
+  for (const auto& key_info : partition->GetKeyScanInfo().key_infos) {
+    count += key_info.keys;
+  }
+
+  args_ = args;
+  moved_ = 0;
+  remained_ = count;
+  *moved = 0;
+  *remained = count;
+  migrating_ = true;
+  cancel_.store(false);
+  migrate_thread_.StartThread();
+  migrate_thread_.Schedule(&DoMigrateSlot, static_cast<void*>(this));
+  LOG(INFO) << "Start migrating slot " << args.slot << " of " << args.table
+    << " to " << args.dest_ip << ":" << args.dest_port << ", about " << count << " keys";
+  return Status::OK();
+}
+
+Status PikaSlotsMigrator::MigrateKeys(const SlotsMigrateArgs& args,
+                                      const std::vector<std::string>& keys,
+                                      int64_t* moved) {
+  *moved = 0;
+  std::shared_ptr<Partition> partition =
+    g_pika_server->GetTablePartitionById(args.table, args.slot);
+  if (!partition) {
+    return Status::NotFound("slot " + std::to_string(args.slot) + " not found");
+  }
+  {
+    slash::MutexLock l(&mu_);
+    if (migrating_ && args.table == args_.table && args.slot == args_.slot) {
+      return Status::Busy("slot " + std::to_string(args.slot) + " is migrating");
+    }
+  }
+  pink::PinkCli* cli = pink::NewRedisCli();
+  Status s = Connect(args, cli);
+  if (s.ok()) {
+    s = MigrateBatch(cli, args, partition, keys, moved);
+  }
+  cli->Close();
+  delete cli;
+  return s;
+}
+
+void PikaSlotsMigrator::Cancel() {
+  cancel_.store(true);
+}
+
+SlotsMigrateStatus PikaSlotsMigrator::GetStatus() {
+  slash::MutexLock l(&mu_);
+  SlotsMigrateStatus status;
+  status.dest_ip = args_.dest_ip;
+  status.dest_port = args_.dest_port;
+  status.slot = args_.slot;
+  status.migrating = migrating_;
+  status.moved = moved_;
+  status.remained = remained_;
+  return status;
+}
+
+bool PikaSlotsMigrator::IsMigrating(const std::string& key) {
+  slash::MutexLock l(&mu_);
+  return migrating_keys_.find(key) != migrating_keys_.end();
+}
+
+void PikaSlotsMigrator::DoMigrateSlot(void* arg) {
+  PikaSlotsMigrator* migrator = static_cast<PikaSlotsMigrator*>(arg);
+  migrator->MigrateSlot();
+}
+
+void PikaSlotsMigrator::MigrateSlot() {
+  SlotsMigrateArgs args;
+  {
+    slash::MutexLock l(&mu_);
+    args = args_;
+  }
+  pink::PinkCli* cli = pink::NewRedisCli();
+  Status s = Connect(args, cli);
+  std::shared_ptr<Table> table = g_pika_server->GetTable(args.table);
+  std::shared_ptr<Partition> partition =
+    g_pika_server->GetTablePartitionById(args.table, args.slot);
+  if (s.ok() && (!table || !partition)) {
+    s = Status::NotFound("slot " + std::to_string(args.slot) + " not found");
+  }
+  // Tags are indexed once a pass rather than looked up once a key
+  bool with_tag = s.ok() && args.with_tag && table->hash_tag();
+  TagKeysMap tag_keys;
+  if (s.ok()) {
+    int64_t count = ScanPartition(partition, cancel_, with_tag ? &tag_keys : nullptr);
+    slash::MutexLock l(&mu_);
+    remained_ = count;
+  }
+
+  // Keys sent are deleted, so a pass over the slot moving nothing
+  // means it is empty, apart from the keys refused by the target
+  int64_t cursor = 0;
+  int64_t pass_moved = 0;
+  while (s.ok()) {
+    if (cancel_.load()) {
+      s = Status::Incomplete("cancelled");
+      break;
+    }
+    {
+      slash::MutexLock l(&mu_);
+      args = args_;
+    }
+    std::vector<std::string> keys;
+    cursor = partition->db()->Scan(blackwidow::DataType::kAll, cursor, "*",
+                                   args.batch_keys, &keys);
+    if (with_tag) {
+      keys = GroupKeysByTag(keys, &tag_keys);
+    }
+    int64_t moved = 0;
+    if (!keys.empty()) {
+      s = MigrateBatch(cli, args, partition, keys, &moved);
+    }
+    pass_moved += moved;
+    {
+      slash::MutexLock l(&mu_);
+      moved_ += moved;
+      remained_ = std::max(remained_ - moved, static_cast<int64_t>(0));
+    }
+    if (cursor == 0) {
+      if (pass_moved == 0) {
+        break;
+      }
+      pass_moved = 0;
+      if (with_tag) {
+        tag_keys.clear();
+        ScanPartition(partition, cancel_, &tag_keys);
+      }
+    }
+  }
+  cli->Close();
+  delete cli;
+
+  slash::MutexLock l(&mu_);
+  if (s.ok()) {
+    remained_ = 0;
+    LOG(INFO) << "Slot " << args.slot << " migrated to " << args.dest_ip << ":"
+      << args.dest_port << ", " << moved_ << " keys moved";
+  } else {
+    LOG(WARNING) << "Migrating slot " << args.slot << " to " << args.dest_ip << ":"
+      << args.dest_port << " stopped, " << moved_ << " keys moved, " << s.ToString();
+    if (!s.IsIncomplete()) {
+      last_status_ = s;
+    }
+  }
+  migrating_keys_.clear();
+  migrating_ = false;
+}
+
+Status PikaSlotsMigrator::Connect(const SlotsMigrateArgs& args, pink::PinkCli* cli) {
+  int timeout_ms = args.timeout_ms > 0
+    ? static_cast<int>(args.timeout_ms) : kSlotsMigrateDefaultTimeoutMs;
+  cli->set_connect_timeout(timeout_ms);
+  cli->set_send_timeout(timeout_ms);
+  cli->set_recv_timeout(timeout_ms);
+  Status s = cli->Connect(args.dest_ip, args.dest_port, "");
+  if (!s.ok()) {
+    return Status::IOError("connect " + args.dest_ip + ":"
+                           + std::to_string(args.dest_port) + " " + s.ToString());
+  }
+  const std::string& requirepass = g_pika_conf->requirepass();
+  if (!requirepass.empty()) {
+    SlotsMigratePipeline pipeline;
+    AppendCommand({"auth", requirepass}, &pipeline);
+    s = FlushPipeline(cli, &pipeline);
+    if (!s.ok()) {
+      return Status::IOError("auth " + args.dest_ip + ":"
+                             + std::to_string(args.dest_port) + " " + s.ToString());
+    }
+  }
+  return Status::OK();
+}
+
+Status PikaSlotsMigrator::MigrateBatch(pink::PinkCli* cli, const SlotsMigrateArgs& args,
+                                       const std::shared_ptr<Partition>& partition,
+                                       const std::vector<std::string>& keys,
+                                       int64_t* moved) {
+  // Marked under the key locks, SLOTSMGRT-EXEC-WRAPPER checks the mark
+  // under the same locks, so a write through it either lands before the
+  // dump or is told to retry until the keys are deleted here. The locks
+  // are not held while talking to the target
+  {
+    std::vector<uint32_t> lock_stripes;
+    partition->KeyLocks()->Lock(keys, &lock_stripes);
+    {
+      slash::MutexLock l(&mu_);
+      migrating_keys_.insert(keys.begin(), keys.end());
+    }
+    partition->KeyLocks()->Unlock(lock_stripes);
+  }
+
+  Status s;
+  SlotsMigratePipeline pipeline;
+  std::vector<std::string> sent;
+  for (const auto& key : keys) {
+    bool found = false;
+    s = DumpKey(cli, args, partition, key, &pipeline, &found);
+    if (!s.ok()) {
+      break;
+    }
+    if (found) {
+      sent.push_back(key);
+    }
+  }
+  if (s.ok()) {
+    s = FlushPipeline(cli, &pipeline);
+  }
+
+  // Every key of the batch is at the target now, drop them here through
+  // DEL, so they leave the binlog as well
+  if (s.ok()) {
+    for (const auto& key : sent) {
+      std::shared_ptr<Cmd> del = g_pika_cmd_table_manager->GetCmd(kCmdNameDel);
+      del->Initial(PikaCmdArgsType{kCmdNameDel, key}, args.table);
+      del->Execute();
+      if (!del->res().ok()) {
+        s = Status::Corruption("delete " + key + " " + del->res().message());
+        break;
+      }
+      (*moved)++;
+    }
+  }
+
+  {
+    slash::MutexLock l(&mu_);
+    for (const auto& key : keys) {
+      migrating_keys_.erase(key);
+    }
+  }
+  return s;
+}
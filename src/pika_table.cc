@@ -5,9 +5,11 @@
 
 #include "include/pika_table.h"
 
+#include "include/pika_conf.h"
 #include "include/pika_server.h"
 #include "include/pika_cmd_table_manager.h"
 
+extern PikaConf* g_pika_conf;
 extern PikaServer* g_pika_server;
 extern PikaCmdTableManager* g_pika_cmd_table_manager;
 
@@ -21,9 +23,15 @@ std::string TablePath(const std::string& path,
 Table::Table(const std::string& table_name,
              uint32_t partition_num,
              const std::string& db_path,
-             const std::string& log_path) :
+             const std::string& log_path,
+             KeyHashType key_hash,
+             bool hash_tag) :
   table_name_(table_name),
-  partition_num_(partition_num) {
+  partition_num_(partition_num),
+  key_hash_(key_hash),
+  hash_tag_(hash_tag),
+  max_hash_mod_(partition_num),
+  key_num_refreshing_(false) {
 
   db_path_ = TablePath(db_path, table_name_);
   log_path_ = TablePath(log_path, "log_" + table_name_);
@@ -99,7 +107,7 @@ uint32_t Table::PartitionNum() {
 Status Table::AddPartitions(const std::set<uint32_t>& partition_ids) {
   slash::RWLock l(&partitions_rw_, true);
   for (const uint32_t& id : partition_ids) {
-    if (id >= partition_num_) {
+    if (id >= partition_num_ && hash_mods_.find(id) == hash_mods_.end()) {
       return Status::Corruption("partition index out of range[0, "
               + std::to_string(partition_num_ - 1) + "]");
     } else if (partitions_.find(id) != partitions_.end()) {
@@ -109,8 +117,13 @@ Status Table::AddPartitions(const std::set<uint32_t>& partition_ids) {
   }
 
   for (const uint32_t& id : partition_ids) {
-    partitions_.emplace(id, std::make_shared<Partition>(
-          table_name_, id, db_path_, log_path_));
+    std::shared_ptr<Partition> partition = std::make_shared<Partition>(
+          table_name_, id, db_path_, log_path_, key_hash_, hash_tag_);
+    auto iter = hash_mods_.find(id);
+    if (iter != hash_mods_.end()) {
+      partition->SetHashMod(iter->second);
+    }
+    partitions_.emplace(id, partition);
   }
   return Status::OK();
 }
@@ -203,6 +216,35 @@ Status Table::GetPartitionsKeyScanInfo(std::map<uint32_t, KeyScanInfo>* infos) {
   return Status::OK();
 }
 
+void Table::RefreshKeyNum() {
+  if (key_num_refreshing_.exchange(true)) {
+    return;
+  }
+  BgTaskArg* bg_task_arg = new BgTaskArg();
+  bg_task_arg->table = shared_from_this();
+  g_pika_server->KeyScanTaskSchedule(&DoRefreshKeyNum, reinterpret_cast<void*>(bg_task_arg));
+}
+
+void Table::DoRefreshKeyNum(void* arg) {
+  BgTaskArg* bg_task_arg = reinterpret_cast<BgTaskArg*>(arg);
+  std::shared_ptr<Table> table = bg_task_arg->table;
+  std::vector<std::shared_ptr<Partition>> partitions;
+  {
+    slash::RWLock rwl(&table->partitions_rw_, false);
+    for (const auto& item : table->partitions_) {
+      partitions.push_back(item.second);
+    }
+  }
+  for (const auto& partition : partitions) {
+    Status s = partition->RefreshKeyNum();
+    if (!s.ok()) {
+      LOG(WARNING) << partition->GetPartitionName() << " count keys failed, " << s.ToString();
+    }
+  }
+  table->key_num_refreshing_.store(false);
+  delete bg_task_arg;
+}
+
 KeyScanInfo Table::GetKeyScanInfo() {
   slash::MutexLock lm(&key_scan_protector_);
   return key_scan_info_;
@@ -254,8 +296,143 @@ std::shared_ptr<Partition> Table::GetPartitionById(uint32_t partition_id) {
 
 std::shared_ptr<Partition> Table::GetPartitionByKey(const std::string& key) {
   assert(partition_num_ != 0);
-  uint32_t index = g_pika_cmd_table_manager->DistributeKey(key, partition_num_);
   slash::RWLock rwl(&partitions_rw_, false);
-  auto iter = partitions_.find(index);
+  auto iter = partitions_.find(RoutePartitionId(key));
   return (iter == partitions_.end()) ? NULL : iter->second;
 }
+
+void Table::SetHashMods(const std::map<uint32_t, uint32_t>& hash_mods) {
+  slash::RWLock rwl(&partitions_rw_, true);
+  hash_mods_ = hash_mods;
+  for (const auto& item : hash_mods_) {
+    max_hash_mod_ = std::max(max_hash_mod_, item.second);
+  }
+}
+
+uint32_t Table::PartitionIdOfKey(const std::string& key) {
+  slash::RWLock rwl(&partitions_rw_, false);
+  return RoutePartitionId(key);
+}
+
+bool Table::hash_tag() const {
+  return hash_tag_;
+}
+
+uint32_t Table::RoutePartitionId(const std::string& key) {
+  if (hash_mods_.empty()) {
+    return g_pika_cmd_table_manager->DistributeKey(key, partition_num_, key_hash_, hash_tag_);
+  }
+  // Take one more bit of the hash for every split on the way
+  uint32_t hash = g_pika_cmd_table_manager->DistributeKey(
+      key, max_hash_mod_, key_hash_, hash_tag_);
+  uint32_t hash_mod = partition_num_;
+  uint32_t id = hash & (hash_mod - 1);
+  auto iter = hash_mods_.find(id);
+  while (iter != hash_mods_.end() && iter->second > hash_mod) {
+    hash_mod <<= 1;
+    id = hash & (hash_mod - 1);
+    iter = hash_mods_.find(id);
+  }
+  return id;
+}
+
+Status Table::SplitPartition(uint32_t partition_id, Cmd* split_cmd, uint32_t* child_id) {
+  if (partition_num_ < 2 || (partition_num_ & (partition_num_ - 1)) != 0) {
+    return Status::NotSupported("partition num "
+            + std::to_string(partition_num_) + " is not a power of 2");
+  }
+  std::shared_ptr<Partition> partition = GetPartitionById(partition_id);
+  if (!partition) {
+    return Status::NotFound("partition " + std::to_string(partition_id) + " not found");
+  }
+  uint32_t hash_mod = partition->hash_mod() == 0 ? partition_num_ : partition->hash_mod();
+  if (hash_mod >= kMaxPartitionHashMod) {
+    return Status::NotSupported("partition "
+            + std::to_string(partition_id) + " can not be split any more");
+  }
+  *child_id = partition_id + hash_mod;
+  std::string child_db_path = PartitionPath(db_path_, *child_id);
+  if (GetPartitionById(*child_id) || slash::FileExists(child_db_path)) {
+    return Status::Corruption("partition " + std::to_string(*child_id) + " already exist");
+  }
+
+  // Writes to the partition wait until their keys route to the child,
+  // those in flight are in the binlog before split_cmd
+  std::vector<uint32_t> lock_stripes;
+  partition->KeyLocks()->LockAll(&lock_stripes);
+  partition->DbRWLockWriter();
+  Status s = partition->Checkpoint(child_db_path);
+  if (s.ok()) {
+    s = g_pika_conf->SplitTablePartition(table_name_, partition_id, *child_id,
+                                         hash_mod << 1, split_cmd != nullptr);
+    if (!s.ok()) {
+      slash::DeleteDirIfExist(child_db_path);
+    }
+  }
+  if (s.ok()) {
+    std::shared_ptr<Partition> child = std::make_shared<Partition>(
+          table_name_, *child_id, db_path_, log_path_, key_hash_, hash_tag_);
+    child->SetHashMod(hash_mod << 1);
+    slash::RWLock rwl(&partitions_rw_, true);
+    hash_mods_[partition_id] = hash_mod << 1;
+    hash_mods_[*child_id] = hash_mod << 1;
+    max_hash_mod_ = std::max(max_hash_mod_, hash_mod << 1);
+    partitions_.emplace(*child_id, child);
+    partition->SetHashMod(hash_mod << 1);
+  }
+  if (s.ok() && split_cmd && g_pika_conf->write_binlog()) {
+    Status bs = split_cmd->WriteBinlog(partition);
+    if (!bs.ok()) {
+      LOG(ERROR) << partition->GetPartitionName()
+        << " split not written to binlog, its slaves need a full sync, " << bs.ToString();
+    }
+  }
+  partition->DbRWUnLock();
+  partition->KeyLocks()->Unlock(lock_stripes);
+  if (s.ok()) {
+    LOG(INFO) << partition->GetPartitionName() << " split, child partition "
+      << *child_id << ", hash mod " << (hash_mod << 1);
+  }
+  return s;
+}
+
+void Table::CleanSplitPartition(uint32_t partition_id) {
+  std::shared_ptr<Partition> partition = GetPartitionById(partition_id);
+  if (!partition) {
+    return;
+  }
+  BgTaskArg* bg_task_arg = new BgTaskArg();
+  bg_task_arg->table = shared_from_this();
+  bg_task_arg->partition = partition;
+  g_pika_server->KeyScanTaskSchedule(&DoCleanSplitPartition, reinterpret_cast<void*>(bg_task_arg));
+}
+
+void Table::DoCleanSplitPartition(void* arg) {
+  BgTaskArg* bg_task_arg = reinterpret_cast<BgTaskArg*>(arg);
+  std::shared_ptr<Partition> partition = bg_task_arg->partition;
+  int64_t cursor = 0;
+  uint64_t deleted = 0;
+  do {
+    std::vector<std::string> keys;
+    cursor = partition->db()->Scan(blackwidow::DataType::kAll, cursor, "*",
+                                   PIKA_SCAN_STEP_LENGTH, &keys);
+    for (const auto& key : keys) {
+      if (partition->OwnsKey(key)) {
+        continue;
+      }
+      // Through DEL, so the slaves of the partition drop it too
+      std::shared_ptr<Cmd> del = g_pika_cmd_table_manager->GetCmd(kCmdNameDel);
+      del->Initial(PikaCmdArgsType{kCmdNameDel, key}, bg_task_arg->table->GetTableName());
+      del->ProcessCommand(partition);
+      deleted++;
+    }
+  } while (cursor != 0);
+  LOG(INFO) << partition->GetPartitionName() << " split clean finished, "
+    << deleted << " keys of the other half deleted";
+  Status s = g_pika_conf->FinishSplitClean(partition->GetTableName(), partition->GetPartitionId());
+  if (!s.ok()) {
+    LOG(WARNING) << partition->GetPartitionName()
+      << " split clean not recorded, it runs again at restart, " << s.ToString();
+  }
+  delete bg_task_arg;
+}
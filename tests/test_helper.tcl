@@ -48,6 +48,8 @@ set ::all_tests {
     unit/bitops
     unit/memefficiency
     unit/hyperloglog
+    unit/hashtag
+    unit/splitslot
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
@@ -0,0 +1,68 @@
+proc slot_of {level key} {
+    lindex [r $level slotshashkey $key] 0
+}
+
+start_server {tags {"hashtag"} overrides {instance-mode sharding default-slot-num 16 sharding-hash-tag yes}} {
+    r pkcluster addslots 0-15
+
+    test {Keys sharing a {tag} hash to the same slot} {
+        set slots [r slotshashkey "{user1000}.following" "{user1000}.followers" "a{user1000}b"]
+        llength [lsort -unique $slots]
+    } {1}
+
+    test {Only the first {tag} of a key is hashed} {
+        expr {[slot_of 0 "{user1000}{x}"] == [slot_of 0 "{user1000}.a"]}
+    } {1}
+
+    test {Multi key commands on one {tag} are served} {
+        r mset "{user1000}.a" 1 "{user1000}.b" 2
+        r mget "{user1000}.a" "{user1000}.b"
+    } {1 2}
+
+    test {Multi key commands across slots are rejected with a bare CROSSSLOT} {
+        set i 1
+        while {[slot_of 0 key:$i] == [slot_of 0 key:0]} {
+            incr i
+        }
+        catch {r mset key:0 1 key:$i 2} err
+        list $err [r exists key:0]
+    } {{CROSSSLOT*} 0}
+
+    start_server {overrides {instance-mode sharding default-slot-num 16 sharding-hash-tag yes}} {
+        r pkcluster addslots 0-15
+
+        test {SLOTSMGRTTAGONE moves a {tag} and back} {
+            r -1 set "{t}.str" v
+            r -1 hset "{t}.hash" f v
+            r -1 rpush "{t}.list" a b
+            set moved [r -1 slotsmgrttagone [srv 0 host] [srv 0 port] 3000 "{t}.str"]
+            set here [r -1 exists "{t}.str" "{t}.hash" "{t}.list"]
+            set there [list [r get "{t}.str"] [r hget "{t}.hash" f] [r lrange "{t}.list" 0 -1]]
+            set back [r slotsmgrttagone [srv -1 host] [srv -1 port] 3000 "{t}.hash"]
+            list $moved $here $there $back [r -1 get "{t}.str"] [r exists "{t}.str"]
+        } {3 0 {v v {a b}} 3 v 0}
+
+        test {SLOTSMGRTTAGONE finds the {tag} in the middle of keys} {
+            r -1 set "user:{m}:name" a
+            r -1 set "b{m}" b
+            r -1 set "x{n}{m}" c
+            set moved [r -1 slotsmgrttagone [srv 0 host] [srv 0 port] 3000 "b{m}"]
+            list $moved [r get "user:{m}:name"] [r get "b{m}"] [r -1 get "x{n}{m}"]
+        } {2 a b c}
+
+        test {SLOTSMGRTTAGSLOT-ASYNC moves a {tag} whole} {
+            for {set j 0} {$j < 100} {incr j} {
+                r -1 set "{t}.$j" $j
+            }
+            set slot [slot_of -1 "{t}.str"]
+            r -1 slotsmgrttagslot-async [srv 0 host] [srv 0 port] 3000 200 1048576 $slot 10
+            wait_for_condition 50 100 {
+                [lindex [r -1 slotsmgrt-async-status] 2] eq {migrating  : no}
+            } else {
+                fail "Slot migration did not finish"
+            }
+            list [r -1 exists "{t}.0" "{t}.99" "{t}.str"] \
+                [r get "{t}.0"] [r get "{t}.99"] [r get "{t}.str"]
+        } {0 0 99 v}
+    }
+}
@@ -0,0 +1,105 @@
+proc slot_keys {level slot} {
+    set keys {}
+    set cursor 0
+    while 1 {
+        set res [r $level slotsscan $slot $cursor count 1000]
+        set cursor [lindex $res 0]
+        set keys [concat $keys [lindex $res 1]]
+        if {$cursor == 0} break
+    }
+    return $keys
+}
+
+# Keys stored in a slot that route to another one
+proc misplaced_keys {level slot} {
+    set n 0
+    foreach key [slot_keys $level $slot] {
+        if {[lindex [r $level slotshashkey $key] 0] != $slot} {
+            incr n
+        }
+    }
+    return $n
+}
+
+# Kill the server without a chance to finish its background work and
+# start it again on the same config and data
+proc restart_server_now {level} {
+    set srv [lindex $::servers end+$level]
+    catch {exec kill -9 [dict get $srv pid]}
+    while {[is_alive $srv]} {
+        after 10
+    }
+    send_data_packet $::test_server_fd server-killed [dict get $srv pid]
+    set pid [exec src/redis-server -c [dict get $srv config_file] \
+        >> [dict get $srv stdout] 2>> [dict get $srv stderr] &]
+    send_data_packet $::test_server_fd server-spawned $pid
+    dict set srv pid $pid
+    lset ::servers end+$level $srv
+    if {![server_is_up [dict get $srv host] [dict get $srv port] 100]} {
+        fail "Server did not come back after restart"
+    }
+    reconnect $level
+}
+
+start_server {tags {"splitslot"} overrides {instance-mode sharding default-slot-num 16}} {
+    r pkcluster addslots 0-15
+
+    start_server {overrides {instance-mode sharding default-slot-num 16}} {
+        r pkcluster addslots 0-15
+        for {set j 0} {$j < 2000} {incr j} {
+            r set key:$j $j
+        }
+        r -1 pkcluster slotsslaveof [srv 0 host] [srv 0 port] all
+        wait_for_condition 50 100 {
+            [r -1 get key:1999] eq {1999}
+        } else {
+            fail "Slave did not sync with its master"
+        }
+
+        test {SPLITSLOT under write load survives a restart before the cleanup} {
+            set load [start_write_load [srv 0 host] [srv 0 port] 10]
+            after 500
+            set child [r pkcluster splitslot 3]
+            stop_write_load $load
+            restart_server_now 0
+
+            wait_for_condition 100 100 {
+                [misplaced_keys 0 3] == 0 && [misplaced_keys 0 $child] == 0
+            } else {
+                fail "Master kept keys of the other half after the split"
+            }
+            set lost 0
+            for {set j 0} {$j < 2000} {incr j} {
+                if {[r get key:$j] ne $j} {
+                    incr lost
+                }
+            }
+            list $child $lost
+        } {19 0}
+
+        test {Slave of a split slot keeps only the keys of each half} {
+            wait_for_condition 100 100 {
+                [misplaced_keys -1 3] == 0 && [misplaced_keys -1 19] == 0
+            } else {
+                fail "Slave kept keys of the other half after the split"
+            }
+            wait_for_condition 100 100 {
+                [r -1 get key:1999] eq {1999}
+            } else {
+                fail "Slave did not follow its master after the restart"
+            }
+            set lost 0
+            for {set j 0} {$j < 2000} {incr j} {
+                if {[r -1 get key:$j] ne $j} {
+                    incr lost
+                }
+            }
+            set routed [expr {[r -1 slotshashkey key:0 key:1 key:2] eq
+                [r slotshashkey key:0 key:1 key:2]}]
+            list $routed $lost
+        } {1 0}
+
+        # The restarted master is not the process start_server knows of
+        kill_server [lindex $::servers end]
+    }
+}
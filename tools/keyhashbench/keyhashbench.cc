@@ -0,0 +1,88 @@
+// Copyright (c) 2015-present, Qihoo, Inc.  All rights reserved.
+// This source code is licensed under the BSD-style license found in the
+// LICENSE file in the root directory of this source tree. An additional grant
+// of patent rights can be found in the PATENTS file in the same directory.
+
+// Time the crc32 and crc32c key hash per key size, the routing cost
+// alone without a server, build by "make keyhashbench",
+// usage: output/bin/keyhashbench [rounds] [key sizes...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include <string>
+#include <vector>
+
+#include "include/pika_data_distribution.h"
+
+static const uint32_t kPartitionNum = 1024;
+static const size_t kKeyNum = 1024;
+
+static uint64_t NowMicros() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return static_cast<uint64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
+
+static double NanosPerKey(PikaDataDistribution* distribution,
+                          const std::vector<std::string>& keys,
+                          size_t rounds) {
+  uint32_t sink = 0;
+  uint64_t start = NowMicros();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      sink += distribution->Distribute(keys[i], kPartitionNum);
+    }
+  }
+  uint64_t elapsed = NowMicros() - start;
+  // Keep the result alive so the loop is not optimized away
+  if (sink == 0xffffffff) {
+    printf("\n");
+  }
+  return elapsed * 1000.0 / (rounds * keys.size());
+}
+
+int main(int argc, char* argv[]) {
+  size_t rounds = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+  std::vector<size_t> sizes;
+  for (int i = 2; i < argc; i++) {
+    sizes.push_back(strtoul(argv[i], NULL, 10));
+  }
+  if (sizes.empty()) {
+    sizes = {16, 256, 1024, 4096};
+  }
+  if (rounds == 0) {
+    fprintf(stderr, "usage: %s [rounds] [key sizes...]\n", argv[0]);
+    return 1;
+  }
+
+  Crc32 crc32;
+  crc32.Init();
+  Crc32c crc32c;
+  crc32c.Init();
+
+#ifdef __SSE4_2__
+  printf("crc32c: sse4.2 crc32 instruction\n");
+#else
+  printf("crc32c: table\n");
+#endif
+  printf("%10s %14s %14s\n", "key size", "crc32 ns/key", "crc32c ns/key");
+  srand(0);
+  for (size_t n = 0; n < sizes.size(); n++) {
+    std::vector<std::string> keys(kKeyNum);
+    for (size_t i = 0; i < kKeyNum; i++) {
+      keys[i].resize(sizes[n]);
+      for (size_t j = 0; j < sizes[n]; j++) {
+        keys[i][j] = 'a' + rand() % 26;
+      }
+    }
+    // Warm up the caches and the crc32 table
+    NanosPerKey(&crc32, keys, 1);
+    NanosPerKey(&crc32c, keys, 1);
+    printf("%10zu %14.1f %14.1f\n", sizes[n],
+           NanosPerKey(&crc32, keys, rounds),
+           NanosPerKey(&crc32c, keys, rounds));
+  }
+  return 0;
+}